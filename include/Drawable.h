@@ -39,7 +39,7 @@ class Drawable: public ExportableToLua {
     void stop_movement();
     Movement* get_movement();
     const Rectangle& get_xy();
-    void set_xy(const Rectangle& xy);
+    virtual void set_xy(const Rectangle& xy);
 
     void start_transition(Transition& transition, int callback_ref, LuaContext* lua_context);
     void stop_transition();
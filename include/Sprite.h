@@ -19,6 +19,7 @@
 
 #include "Common.h"
 #include "Drawable.h"
+#include "lowlevel/PoolAllocator.h"
 #include <map>
 
 /**
@@ -34,13 +35,14 @@
  * A sprite can be drawn directly on a surface, or it can
  * be attached to a map entity.
  */
-class Sprite: public Drawable {
+class Sprite: public Drawable, public PoolAllocated<Sprite, 256> {
 
   public:
 
     // initialization
     static void initialize();
     static void quit();
+    static void unload_unused_animation_sets();
 
     // creation and destruction
     Sprite(const std::string& id);
@@ -90,6 +92,10 @@ class Sprite: public Drawable {
     bool is_last_frame_reached() const;
     bool has_frame_changed() const;
 
+    // position
+    void set_xy(const Rectangle& xy);
+    void set_map_entities(MapEntities* map_entities);
+
     // effects
     bool is_blinking() const;
     void set_blinking(uint32_t blink_delay);
@@ -111,9 +117,13 @@ class Sprite: public Drawable {
   private:
 
     LuaContext* lua_context;           /**< The Solarus Lua API (NULL means no callbacks for this sprite). TODO move this to ExportableToLua */
+    MapEntities* map_entities;         /**< entities of the map where this sprite is drawn, notified
+                                        * when the sprite is displaced (or NULL) */
 
     // animation set
     static std::map<std::string, SpriteAnimationSet*> all_animation_sets;
+    static std::map<std::string, int> animation_set_refcounts; /**< number of sprites using
+                                                                * each animation set */
     const std::string animation_set_id;  /**< id of this sprite's animation set */
     SpriteAnimationSet& animation_set;   /**< animation set of this sprite */
 
@@ -145,6 +155,7 @@ class Sprite: public Drawable {
     uint32_t blink_next_change_date;   /**< date of the next change when blinking: visible or not */
 
     static SpriteAnimationSet& get_animation_set(const std::string& id);
+    static void release_animation_set(const std::string& id);
     int get_next_frame() const;
     Surface& get_intermediate_surface();
     void set_frame_changed(bool frame_changed);
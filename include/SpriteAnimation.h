@@ -18,6 +18,7 @@
 #define SOLARUS_SPRITE_ANIMATION_H
 
 #include "Common.h"
+#include "lowlevel/Rectangle.h"
 #include <string>
 #include <vector>
 
@@ -56,10 +57,14 @@ class SpriteAnimation {
     void do_enable_pixel_collisions();
     void disable_pixel_collisions();
 
+    const std::string
+        image_file_name;         /**< name of the image file, or "tileset" */
     Surface* src_image;          /**< image from which the frames are extracted;
                                   * this image is the same for
                                   * all directions of the sprite's animation */
-    bool src_image_loaded;       /**< indicates that src_image was loaded from this instance */
+    Rectangle src_image_position; /**< position and size of the image in src_image
+                                   * (src_image may be a sprite atlas page) */
+    bool src_image_loaded;       /**< indicates that src_image was obtained from the sprite atlas */
     std::vector<SpriteAnimationDirection*>
         directions;               /**< list of directions:
                                    * each direction is a sequence of images */
@@ -20,6 +20,7 @@
 #include "Common.h"
 #include "lowlevel/Rectangle.h"
 #include <vector>
+#include <map>
 
 /**
  * \brief A sequence of frames representing a sprite animated in a particular direction.
@@ -45,22 +46,53 @@ class SpriteAnimationDirection {
     int get_nb_frames() const;
     const Rectangle& get_frame(int frame) const;
     void draw(Surface& dst_surface, const Rectangle& dst_position,
-        int current_frame, Surface& src_image);
+        int current_frame, Surface& src_image, const Rectangle& src_image_position);
 
     // pixel collisions
-    void enable_pixel_collisions(Surface* src_image);
+    void enable_pixel_collisions(Surface* src_image, const Rectangle& src_image_position,
+        bool shared);
     void disable_pixel_collisions();
     bool are_pixel_collisions_enabled() const;
     PixelBits& get_pixel_bits(int frame) const;
 
   private:
 
+    /**
+     * \brief Identifies the pixels of a frame: a region of a surface.
+     */
+    struct PixelBitsKey {
+      const Surface* surface;            /**< the surface containing the frame */
+      Rectangle position;                /**< position of the frame on this surface */
+
+      bool operator<(const PixelBitsKey& other) const;
+    };
+
+    /**
+     * \brief Pixel bits shared by all frames with the same pixels.
+     */
+    struct SharedPixelBits {
+      PixelBits* pixel_bits;             /**< the bit mask */
+      int refcount;                      /**< number of frames using it */
+    };
+
+    Rectangle get_frame_in_image(int frame) const;
+    void release_pixel_bits(int frame);
+
     std::vector<Rectangle> frames;       /**< position of each frame of the sequence on the image */
     Rectangle origin;                    /**< coordinates of the sprite's origin from the
                                           * upper-left corner of its image. */
 
-    std::vector<PixelBits*> pixel_bits;  /**< bit masks representing the non-transparent pixels of each frame,
-                                          * computed only if enable_pixel_collisions() is called */
+    Surface* pixel_bits_image;           /**< surface where the frames are, if pixel collisions are enabled */
+    Rectangle pixel_bits_image_position; /**< position of the animation image on pixel_bits_image */
+    bool pixel_bits_shared;              /**< whether the bit masks can be shared with other directions
+                                          * (only if pixel_bits_image lives at least as long as them) */
+    mutable std::vector<PixelBits*>
+        pixel_bits;                      /**< bit masks representing the non-transparent pixels of each frame,
+                                          * computed the first time they are needed once
+                                          * enable_pixel_collisions() is called (NULL until then) */
+
+    static std::map<PixelBitsKey, SharedPixelBits>
+        all_shared_pixel_bits;           /**< bit masks that can be shared, indexed by their pixels */
 };
 
 #endif
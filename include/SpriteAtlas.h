@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SPRITE_ATLAS_H
+#define SOLARUS_SPRITE_ATLAS_H
+
+#include "Common.h"
+#include "lowlevel/Rectangle.h"
+#include "lowlevel/Color.h"
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * \brief Packs the images of sprites into a few big surfaces.
+ *
+ * Instead of loading its own surface, each sprite animation gets the
+ * region of a shared page where its image file was copied.
+ * An image file used by several animations is only loaded once,
+ * and sprites drawn one after another mostly read from the same surfaces.
+ *
+ * Images are packed in rows (shelves) of pages of page_size x page_size
+ * pixels, in the order they are requested.
+ * Images with an alpha channel, images with a transparency color and opaque
+ * images go to different pages so that their pixels keep the same meaning.
+ * Images with a transparency color only share pages with images of the
+ * same transparency color.
+ * Images bigger than a page get their own page.
+ *
+ * Images are reference-counted. The room of a released image becomes a
+ * free rectangle of its page, merged with the adjacent free rectangles of
+ * the same width or height. New images first go to the smallest free
+ * rectangle where they fit, and the rest of this rectangle stays free.
+ * A page is freed when none of its images is used anymore.
+ */
+class SpriteAtlas {
+
+  public:
+
+    static void quit();
+
+    static Surface& get_image(const std::string& file_name, Rectangle& position);
+    static void release_image(const std::string& file_name);
+
+  private:
+
+    /**
+     * \brief A big surface where images are packed.
+     */
+    struct Page {
+      Surface* surface;         /**< the pixels (NULL if the page was freed) */
+      bool alpha;               /**< whether this page has an alpha channel */
+      bool colorkey;            /**< whether this page has a transparency color */
+      Color transparency_color; /**< the transparency color if any */
+      int shelf_x;              /**< x coordinate where the next image of the current shelf goes */
+      int shelf_y;              /**< y coordinate of the current shelf */
+      int shelf_height;         /**< height of the current shelf */
+      int nb_images;            /**< number of images used in this page */
+      std::vector<Rectangle>
+          free_rectangles;      /**< room of released images, available again */
+    };
+
+    /**
+     * \brief An image file packed in a page.
+     */
+    struct Image {
+      int page;                 /**< index of the page in pages */
+      Rectangle position;       /**< position of the image in its page */
+      int refcount;             /**< number of users of this image */
+    };
+
+    SpriteAtlas();
+
+    static int add_image(Surface& image, Rectangle& position);
+    static bool can_hold(const Page& page, Surface& image);
+    static bool place_image(Page& page, const Rectangle& size, Rectangle& position);
+    static bool place_image_in_free_room(Page& page, const Rectangle& size,
+        Rectangle& position);
+    static void add_free_rectangle(Page& page, const Rectangle& rectangle);
+
+    static const int page_size = 1024;          /**< width and height of a page in pixels */
+
+    static std::vector<Page> pages;             /**< all pages */
+    static std::map<std::string, Image> images; /**< images packed, indexed by file name */
+};
+
+#endif
+
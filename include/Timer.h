@@ -19,16 +19,45 @@
 
 #include "Common.h"
 #include "lua/ExportableToLua.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief Represents a timer that any class can start.
  *
  * Timers are mostly used by the scripts.
+ *
+ * A timer measures time with the system clock, unless it is attached to
+ * a Timer::Clock. In this case, all its dates are expressed in the time of
+ * that clock, so that pausing the clock suspends the timer without touching
+ * it.
  */
-class Timer: public ExportableToLua {
+class Timer: public ExportableToLua, public PoolAllocated<Timer> {
 
   public:
 
+    /**
+     * \brief A time reference that can be paused, shared by several timers.
+     *
+     * The time of a clock is the system time minus the total duration of its
+     * pauses.
+     */
+    class Clock {
+
+      public:
+
+        Clock();
+
+        uint32_t now() const;
+        bool is_paused() const;
+        void set_paused(bool paused);
+
+      private:
+
+        bool paused;                 /**< whether the clock is paused */
+        uint32_t when_paused;        /**< system date of the current pause */
+        uint32_t paused_duration;    /**< total duration of previous pauses */
+    };
+
     Timer(uint32_t duration);
     ~Timer();
 
@@ -40,6 +69,10 @@ class Timer: public ExportableToLua {
     void set_suspended_with_map(bool suspend_with_map);
     bool is_finished();
 
+    const Clock* get_clock();
+    void set_clock(const Clock* clock);
+    uint32_t get_next_update_date();
+
     void update();
     void notify_map_suspended(bool suspended);
 
@@ -47,7 +80,11 @@ class Timer: public ExportableToLua {
 
   private:
 
+    uint32_t now();
+
     // timer
+    const Clock* clock;              /**< clock of the dates below (NULL means
+                                      * the system clock) */
     uint32_t expiration_date;        /**< date when the timer is finished */
     bool finished;                   /**< indicates that the timer is finished */
 
@@ -52,16 +52,15 @@ class TransitionScrolling: public Transition {
     void scroll();
     Rectangle get_previous_map_dst_position(int scrolling_direction);
 
-    Surface* both_maps_surface;           /**< an intermediate surface where the two map surfaces will be blitted */
     int scrolling_direction;              /**< direction of the scrolling (0 to 3) */
     uint32_t next_scroll_date;            /**< date of the next scrolling step */
 
     int dx;                               /**< x change for each scrolling step */
     int dy;                               /**< y change for each scrolling step */
 
-    Rectangle previous_map_dst_position;  /**< position where the previous map is blitted on both_maps_surface */
-    Rectangle current_map_dst_position;   /**< position where the current map is blitted on both_maps_surface */
-    Rectangle current_scrolling_position; /**< the rectangle from both_maps_surface that is currently visible */
+    Rectangle previous_map_dst_position;  /**< position of the previous map in the area containing both maps */
+    Rectangle current_map_dst_position;   /**< position of the current map in the area containing both maps */
+    Rectangle current_scrolling_position; /**< the rectangle of the area containing both maps that is currently visible */
 };
 
 #endif
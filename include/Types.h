@@ -51,9 +51,14 @@ class Music;
 class SpcDecoder;
 class ItDecoder;
 class Random;
+class PoolAllocator;
 class Geometry;
 class Rectangle;
 class PixelBits;
+class Compositor;
+class SurfacePool;
+class FrameProfiler;
+class Replay;
 class InputEvent;
 class Debug;
 class StringConcat;
@@ -82,6 +87,7 @@ class Sprite;
 class SpriteAnimationSet;
 class SpriteAnimation;
 class SpriteAnimationDirection;
+class SpriteAtlas;
 class Drawable;
 
 // transition effects
@@ -92,6 +98,7 @@ class TransitionScrolling;
 
 // map entities
 class MapEntities;
+class EntityGrid;
 class MapEntity;
 class Hero;
 class HeroSprites;
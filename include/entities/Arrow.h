@@ -19,11 +19,12 @@
 
 #include "Common.h"
 #include "entities/MapEntity.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief An arrow thrown by the bow on the map.
  */
-class Arrow: public MapEntity {
+class Arrow: public MapEntity, public PoolAllocated<Arrow> {
 
   private:
 
@@ -19,6 +19,7 @@
 
 #include "Common.h"
 #include "entities/MapEntity.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief An item carried or thrown by the hero.
@@ -28,7 +29,7 @@
  * As soon as he throws it, the item becomes attached to the map and the hero
  * may lift another item.
  */
-class CarriedItem: public MapEntity {
+class CarriedItem: public MapEntity, public PoolAllocated<CarriedItem> {
 
   public:
 
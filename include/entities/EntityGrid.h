@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_ENTITY_GRID_H
+#define SOLARUS_ENTITY_GRID_H
+
+#include "Common.h"
+#include "lowlevel/Rectangle.h"
+#include <vector>
+#include <map>
+
+/**
+ * \brief Spatial index of the entities of a map.
+ *
+ * The map is divided in square cells and each cell knows the entities
+ * that overlap it. Finding the entities in a region then only visits
+ * the cells of this region instead of all entities of the map.
+ *
+ * The box indexed for an entity is its bounding box, extended if necessary
+ * to contain its origin point.
+ * Entities must notify the grid when this box changes.
+ * Entities outside the map are stored in the border cells.
+ *
+ * Queries return entities in a deterministic order: the order of the cells,
+ * and then the order of the entities in each cell, which only depends on
+ * the sequence of additions and removals.
+ */
+class EntityGrid {
+
+  public:
+
+    EntityGrid();
+
+    void set_size(int width, int height);
+    void clear();
+
+    void add(MapEntity& entity);
+    void remove(MapEntity& entity);
+    void notify_bounding_box_changed(MapEntity& entity);
+
+    void get_entities_in_rectangle(const Rectangle& rectangle,
+        std::vector<MapEntity*>& entities) const;
+
+  private:
+
+    static const int cell_size = 64;            /**< width and height of a cell in pixels */
+
+    /**
+     * \brief An entity stored in a cell.
+     */
+    struct CellEntry {
+      MapEntity* entity;                        /**< the entity */
+      int first_column;                         /**< first column of the cells of this entity */
+      int first_row;                            /**< first row of the cells of this entity */
+    };
+
+    static Rectangle get_indexed_box(const MapEntity& entity);
+    Rectangle get_cell_range(const Rectangle& box) const;
+    void add_to_cells(MapEntity* entity, const Rectangle& cell_range);
+    void remove_from_cells(MapEntity* entity, const Rectangle& cell_range);
+
+    int num_columns;                            /**< number of cells on a row */
+    int num_rows;                               /**< number of cells on a column */
+    std::vector<std::vector<CellEntry> > cells; /**< entities overlapping each cell,
+                                                 * row by row */
+    std::map<MapEntity*, Rectangle> cell_ranges; /**< cells covered by each entity
+                                                 * (in cell coordinates) */
+};
+
+#endif
+
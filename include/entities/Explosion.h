@@ -19,6 +19,7 @@
 
 #include "Common.h"
 #include "entities/Detector.h"
+#include "lowlevel/PoolAllocator.h"
 #include <list>
 
 /**
@@ -26,7 +27,7 @@
  *
  * An explosion can hurt the hero, the enemies and open weak walls.
  */
-class Explosion: public Detector {
+class Explosion: public Detector, public PoolAllocated<Explosion> {
 
   private:
 
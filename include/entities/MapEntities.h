@@ -23,8 +23,11 @@
 #include "entities/Layer.h"
 #include "entities/EntityType.h"
 #include "entities/Enemy.h"
+#include "entities/EntityGrid.h"
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
 
 /**
  * \brief Manages the whole content of a map.
@@ -47,21 +50,31 @@ class MapEntities {
     Ground get_tile_ground(Layer layer, int x, int y);
     Ground get_ground(Layer layer, int x, int y);
     Ground get_ground(Layer layer, const Rectangle& xy);
-    const std::list<MapEntity*>& get_obstacle_entities(Layer layer);
-    const std::list<MapEntity*>& get_ground_observers(Layer layer);
-    const std::list<Detector*>& get_detectors();
-    const std::list<Stairs*>& get_stairs(Layer layer);
-    const std::list<CrystalBlock*>& get_crystal_blocks(Layer layer);
-    const std::list<Separator*>& get_separators();
+    const std::vector<MapEntity*>& get_obstacle_entities(Layer layer);
+    const std::vector<MapEntity*>& get_ground_observers(Layer layer);
+    const std::vector<Detector*>& get_detectors();
+    const std::vector<Stairs*>& get_stairs(Layer layer);
+    const std::vector<CrystalBlock*>& get_crystal_blocks(Layer layer);
+    const std::vector<Separator*>& get_separators();
     Destination* get_default_destination();
 
     MapEntity* get_entity(const std::string& name);
     MapEntity* find_entity(const std::string& name);
     std::list<MapEntity*> get_entities_with_prefix(const std::string& prefix);
     std::list<MapEntity*> get_entities_with_prefix(EntityType type, const std::string& prefix);
+    void get_entities_with_prefix(const std::string& prefix,
+        std::vector<MapEntity*>& entities);
+    void get_entities_by_type(EntityType type, std::vector<MapEntity*>& entities,
+        const std::string& prefix = "", Layer layer = LAYER_NB);
+    int get_entities_count_with_prefix(const std::string& prefix);
     bool has_entity_with_prefix(const std::string& prefix);
+    void get_entities_in_rectangle(const Rectangle& rectangle,
+        std::vector<MapEntity*>& entities, Layer layer = LAYER_NB);
+    void get_entities_in_radius(int x, int y, int radius,
+        std::vector<MapEntity*>& entities, Layer layer = LAYER_NB);
 
     // handle entities
+    void add_tile(Layer layer, int x, int y, int width, int height, int tile_pattern_id);
     void add_entity(MapEntity* entity);
     void remove_entity(MapEntity* entity);
     void remove_entity(const std::string& name);
@@ -71,6 +84,9 @@ class MapEntities {
     void destroy_entity(MapEntity* entity);
     static bool compare_y(MapEntity* first, MapEntity* second);
     void set_entity_layer(MapEntity& entity, Layer layer);
+    void notify_entity_bounding_box_changed(MapEntity& entity);
+    void notify_sprite_created(Sprite& sprite);
+    void notify_sprite_displaced(Sprite& sprite);
 
     // specific to some entity types
     bool overlaps_raised_blocks(Layer layer, const Rectangle& rectangle);
@@ -81,7 +97,7 @@ class MapEntities {
     // map events
     void notify_map_started();
     void notify_map_opening_transition_finished();
-    void notify_tileset_changed();
+    void notify_tileset_changed(const std::set<int>& changed_tile_patterns);
 
     // game loop
     void set_suspended(bool suspended);
@@ -92,12 +108,58 @@ class MapEntities {
 
     friend class MapLoader;            /**< the map loader initializes the private fields of MapEntities */
 
-    void add_tile(Tile* tile);
+    /**
+     * \brief Compact description of a tile.
+     *
+     * Most tiles are only drawn once on the non-animated tiles surfaces,
+     * so they are stored like this rather than as Tile entities.
+     */
+    struct TileInfo {
+      int x;                           /**< x coordinate of the top-left corner */
+      int y;                           /**< y coordinate of the top-left corner */
+      int width;                       /**< width (the pattern can be repeated) */
+      int height;                      /**< height (the pattern can be repeated) */
+      int tile_pattern_id;             /**< id of the tile pattern */
+    };
+
+    /**
+     * \brief A ground modifier stored in a square of ground_modifiers_grid.
+     */
+    struct GroundModifierEntry {
+      MapEntity* entity;               /**< the ground modifier */
+      int rank;                        /**< order of the modifier in ground_modifiers:
+                                        * the highest rank wins */
+    };
+
+    /**
+     * \brief Where a ground modifier is stored in ground_modifiers_grid.
+     */
+    struct GroundModifierInfo {
+      Rectangle box;                   /**< bounding box of the modifier when it
+                                        * was last put in the grid */
+      int rank;                        /**< order of the modifier in ground_modifiers */
+    };
+
+    bool is_found_by_prefix(MapEntity* entity);
     void set_tile_ground(Layer layer, int x8, int y8, Ground ground);
+    void add_to_ground_modifiers_grid(MapEntity& ground_modifier, Layer layer);
+    void remove_from_ground_modifiers_grid(MapEntity& ground_modifier, Layer layer);
+    void add_to_ground_cells(Layer layer, const GroundModifierEntry& entry,
+        const Rectangle& cells, const Rectangle& excluded_cells);
+    void remove_from_ground_cells(Layer layer, MapEntity* ground_modifier,
+        const Rectangle& cells, const Rectangle& excluded_cells);
+    Rectangle get_ground_cells(const Rectangle& box) const;
     void build_non_animated_tiles();
-    void redraw_non_animated_tiles();
-    bool overlaps_animated_tile(Tile& tile);
+    void start_rebuilding_non_animated_tiles(const std::set<int>& changed_tile_patterns);
+    void continue_rebuilding_non_animated_tiles();
+    void finish_rebuilding_non_animated_tiles();
+    Rectangle get_rebuild_blocks(const TileInfo& tile) const;
+    void draw_tile(const TileInfo& tile, Surface& dst_surface);
+    bool overlaps_animated_tile(Layer layer, const TileInfo& tile);
     void remove_marked_entities();
+    void sort_entities_drawn_y_order(Layer layer);
+    static void add_to_drawing_list(std::vector<MapEntity*>& drawing_list, MapEntity* entity);
+    static bool compare_drawing_order(MapEntity* first, MapEntity* second);
     void update_crystal_blocks();
 
     // map
@@ -107,7 +169,8 @@ class MapEntities {
     int map_height8;                                /**< number of 8x8 squares on a column of the map grid */
 
     // tiles
-    std::vector<Tile*> tiles[LAYER_NB];             /**< all tiles of the map (a vector for each layer) */
+    std::vector<TileInfo> tiles[LAYER_NB];          /**< all tiles of the map (a vector for each layer),
+                                                     * consecutive ones with the same pattern merged */
     int tiles_grid_size;                            /**< number of 8x8 squares in the map
                                                      * (tiles_grid_size = map_width8 * map_height8) */
     Ground* tiles_ground[LAYER_NB];                 /**< array of size tiles_grid_size representing the ground property
@@ -116,48 +179,101 @@ class MapEntities {
                                                      * have animated tiles */
     Surface* non_animated_tiles_surfaces[LAYER_NB]; /**< all non-animated tiles are rendered once for all on these surfaces
                                                      * for performance */
+    static const int
+        rebuild_block_size = 128;                   /**< size of the blocks of non-animated tiles surfaces
+                                                     * that are redrawn when the tileset changes */
+    static const uint32_t
+        rebuild_time_budget = 2000;                 /**< maximum time spent redrawing blocks at each cycle
+                                                     * (in microseconds) */
+    int rebuild_blocks_width;                       /**< number of rebuild blocks on a row of the map */
+    std::vector<Surface*> rebuild_blocks[LAYER_NB]; /**< for each block of each layer: the new image being
+                                                     * drawn, or NULL if the block does not change */
+    bool rebuilding_non_animated_tiles;             /**< whether rebuild blocks are being drawn */
+    int rebuild_layer;                              /**< layer of the next tile to draw in rebuild blocks */
+    unsigned int rebuild_tile_index;                /**< index of the next tile to draw in rebuild blocks */
     std::vector<Tile*>
-        tiles_in_animated_regions[LAYER_NB];        /**< animated tiles and tiles overlapping them */
+        tiles_in_animated_regions[LAYER_NB];        /**< animated tiles and tiles overlapping them,
+                                                     * the only ones created as Tile entities */
+    EntityGrid animated_tiles_grid;                 /**< spatial index of the tiles in animated regions
+                                                     * that are drawn at their position */
+    std::vector<MapEntity*>
+        tiles_drawn_anywhere;                       /**< tiles in animated regions that may be drawn
+                                                     * anywhere (like parallax scrolling tiles) */
 
     // dynamic entities
+    // The registries below are vectors: they are iterated very often.
+    // Removed entities are erased from all of them at once by
+    // remove_marked_entities(), in one linear pass per registry: removing
+    // many entities costs the same as removing one, but removing an entity
+    // is not constant time.
     Hero& hero;                                     /**< the hero (also stored in Game because it is kept when changing maps) */
 
     std::map<std::string, MapEntity*>
-      named_entities;                               /**< entities identified by a name */
-    std::list<MapEntity*> all_entities;             /**< all map entities except the tiles and the hero;
+      named_entities;                               /**< entities identified by a name, sorted by name
+                                                     * so that prefix queries only visit matching names */
+    std::vector<MapEntity*> all_entities;           /**< all map entities except the tiles and the hero;
                                                      * this vector is used to delete the entities
                                                      * when the map is unloaded */
-    std::list<MapEntity*> entities_to_remove;       /**< list of entities that need to be removed right now */
+    std::vector<MapEntity*> entities_to_remove;     /**< entities that need to be removed right now */
+    EntityGrid entity_grid;                         /**< spatial index of all entities except the tiles,
+                                                     * including the hero */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       entities_drawn_first[LAYER_NB];               /**< all map entities that are drawn in the normal order */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       entities_drawn_y_order[LAYER_NB];             /**< all map entities that are drawn in the order
-                                                     * defined by their y position, including the hero */
+                                                     * defined by their y position, including the hero
+                                                     * (kept sorted by compare_y()) */
 
-    std::list<Detector*> detectors;                 /**< all entities able to detect other entities
+    // In both drawing lists above, the drawing rank of each entity
+    // increases with its position in the list. This allows draw() to
+    // only get the visible entities from entity_grid and to sort them back
+    // in the drawing order.
+    int max_sprite_size;                            /**< width or height of the biggest sprite frame
+                                                     * of entities of this map */
+    int max_sprite_displacement;                    /**< biggest x or y offset of sprites of entities
+                                                     * of this map relative to their entity */
+    static const int
+        drawing_margin = 64;                        /**< how far outside the camera entities are
+                                                     * considered, in addition to max_sprite_size
+                                                     * (also covers the hero sprites) */
+    std::vector<MapEntity*> tiles_to_draw;          /**< animated tiles found visible by draw() */
+    std::vector<MapEntity*> entities_to_draw;       /**< entities found visible by draw() */
+
+    std::vector<Detector*> detectors;               /**< all entities able to detect other entities
                                                      * on this map.
                                                      * TODO store them by layer like obstacle_entities */
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       ground_observers[LAYER_NB];                   /**< all dynamic entities sensible to the ground
                                                      * below them */
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       ground_modifiers[LAYER_NB];                   /**< all dynamic entities that may change the ground of
                                                      * the map where they are placed */
+    std::vector<GroundModifierEntry>*
+      ground_modifiers_grid[LAYER_NB];              /**< array of size tiles_grid_size giving for each 8x8 square
+                                                     * the ground modifiers overlapping it, by increasing rank */
+    std::map<MapEntity*, GroundModifierInfo>
+      ground_modifier_infos;                        /**< position in ground_modifiers_grid of each ground modifier */
+    int next_ground_modifier_rank;                  /**< rank of the next ground modifier put in the grid */
     Destination* default_destination;               /**< the default destination of this map */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       obstacle_entities[LAYER_NB];                  /**< all entities that might be obstacle for other
                                                      * entities on this map, including the hero */
 
-    std::list<Stairs*> stairs[LAYER_NB];            /**< all stairs of the map */
-    std::list<CrystalBlock*>
+    std::vector<Stairs*> stairs[LAYER_NB];          /**< all stairs of the map */
+    std::vector<CrystalBlock*>
       crystal_blocks[LAYER_NB];                     /**< all crystal blocks of the map */
-    std::list<Separator*> separators;               /**< all separators of the map */
+    std::vector<Separator*> separators;             /**< all separators of the map */
 
     Boomerang* boomerang;                           /**< the boomerang if present on the map, NULL otherwise */
     std::string music_before_miniboss;              /**< the music that was played before starting a miniboss fight */
+
+    uint32_t nb_updates;                            /**< number of calls to update() so far */
+    static const uint32_t
+        sleeping_check_interval = 8;                /**< number of cycles between two checks of each
+                                                     * sleeping entity */
 };
 
 /**
@@ -67,6 +67,8 @@ class MapEntity: public ExportableToLua {
     virtual bool is_drawn_in_y_order();
     virtual bool is_drawn_at_its_position() const;
     bool is_drawn() const;
+    int get_drawing_rank() const;
+    void set_drawing_rank(int drawing_rank);
 
     // adding to a map
     bool is_on_map() const;
@@ -121,6 +123,11 @@ class MapEntity: public ExportableToLua {
 
     int get_optimization_distance() const;
     void set_optimization_distance(int distance);
+    bool is_sleep_allowed() const;
+    void set_sleep_allowed(bool sleep_allowed);
+    bool is_sleeping() const;
+    bool is_far_from_camera() const;
+    void update_sleeping();
 
     bool is_enabled() const;
     void set_enabled(bool enable);
@@ -140,6 +147,7 @@ class MapEntity: public ExportableToLua {
         bool enable_pixel_collisions = false);
     void remove_sprite(Sprite& sprite);
     void clear_sprites();
+    void detach_sprites_from_map();
     virtual void notify_sprite_frame_changed(Sprite& sprite, const std::string& animation, int frame);
     virtual void notify_sprite_animation_finished(Sprite& sprite, const std::string& animation);
     bool is_visible() const;
@@ -240,6 +248,7 @@ class MapEntity: public ExportableToLua {
     virtual const std::string& get_lua_type_name() const;
 
     static const Rectangle directions_to_xy_moves[8];  /**< converts a direction (0 to 7) into a one-pixel xy move */
+    static const std::string entity_type_names[];      /**< Lua name of each entity type */
 
   protected:
 
@@ -271,6 +280,8 @@ class MapEntity: public ExportableToLua {
 
   private:
 
+    void notify_bounding_box_changed();
+
     MainLoop* main_loop;                        /**< The Solarus main loop. */
     Map* map;                                   /**< The map where this entity is, or NULL
                                                  * (automatically set by class MapEntities after adding the entity to the map) */
@@ -322,6 +333,12 @@ class MapEntity: public ExportableToLua {
                                                  * the entity is suspended (0 means infinite) */
     static const int
         default_optimization_distance = 400;    /**< default value */
+    bool sleep_allowed;                         /**< whether the entity stops being updated when it is
+                                                 * beyond its optimization distance */
+    bool sleeping;                              /**< indicates that the entity is far, suspended and
+                                                 * not updated until it comes back near the camera */
+    int drawing_rank;                           /**< position of the entity in its drawing list,
+                                                 * used to draw visible entities in the right order */
 
 };
 
@@ -22,11 +22,12 @@
 #include "entities/Detector.h"
 #include "movements/FallingHeight.h"
 #include "lowlevel/Rectangle.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief An treasure placed on the ground and that the hero can take.
  */
-class Pickable: public Detector {
+class Pickable: public Detector, public PoolAllocated<Pickable> {
 
   public:
 
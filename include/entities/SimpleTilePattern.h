@@ -42,6 +42,7 @@ class SimpleTilePattern: public TilePattern {
         Tileset& tileset, const Rectangle& viewport);
 
     virtual bool is_animated();
+    virtual bool is_image_changed(Tileset& tileset, Tileset& new_tileset);
 };
 
 #endif
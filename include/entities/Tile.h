@@ -32,6 +32,9 @@
  * position, their size and their obstacle property are fixed.
  * Tiles are added when the map is loaded and they are removed when the map
  * is destroyed.
+ * The map only keeps a compact description of most tiles: Tile entities
+ * only exist for tiles that have to be drawn at each frame, that is, tiles
+ * in animated regions.
  *
  * If you need to dynamically enable or disable a tile, see DynamicTile.
  */
@@ -51,6 +54,7 @@ class Tile: public MapEntity {
     void set_map(Map& map);
     void draw_on_map();
     void draw(Surface& dst_surface, const Rectangle& viewport);
+    int get_tile_pattern_id() const;
     TilePattern& get_tile_pattern();
     bool is_animated();
     virtual bool is_drawn_at_its_position() const;
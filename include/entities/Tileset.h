@@ -20,6 +20,7 @@
 #include "Common.h"
 #include "lowlevel/Color.h"
 #include <map>
+#include <set>
 #include <string>
 
 struct lua_State;
@@ -61,6 +62,7 @@ class Tileset {
     Surface& get_tiles_image();
     Surface& get_entities_image();
     TilePattern& get_tile_pattern(int id);
+    void get_changed_tile_patterns(Tileset& other, std::set<int>& tile_pattern_ids);
     void set_images(Tileset& other);
 
     static const std::string ground_names[];  /**< Lua name of each ground type. */
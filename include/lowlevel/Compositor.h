@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_COMPOSITOR_H
+#define SOLARUS_COMPOSITOR_H
+
+#include "Common.h"
+#include "lowlevel/Surface.h"
+#include <SDL.h>
+
+/**
+ * \brief Draws surfaces with an opacity or a blend mode.
+ *
+ * SDL 1.2 only blits with a per-surface alpha, ignores it for images that
+ * have an alpha channel and has no additive or multiplicative blending.
+ * This class does the compositing in software instead, directly on the
+ * pixels of the surfaces.
+ *
+ * Pixels of 16-bit (RGB 565) and 32-bit surfaces of the same format are
+ * blended several color channels at a time in a single integer.
+ * Other combinations of formats use a slower generic path.
+ */
+class Compositor {
+
+  public:
+
+    static void draw_region(Surface& src_surface, const Rectangle& region,
+        Surface& dst_surface, const Rectangle& dst_position,
+        int opacity, Surface::BlendMode blend_mode);
+
+  private:
+
+    Compositor();
+
+    static void draw_rows_565(SDL_Surface* src, int src_x, int src_y,
+        SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+        int opacity, Surface::BlendMode blend_mode);
+    static void draw_rows_8888(SDL_Surface* src, int src_x, int src_y,
+        SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+        int opacity, Surface::BlendMode blend_mode);
+    static void draw_rows_generic(SDL_Surface* src, int src_x, int src_y,
+        SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+        int opacity, Surface::BlendMode blend_mode);
+};
+
+#endif
+
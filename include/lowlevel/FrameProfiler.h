@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_FRAME_PROFILER_H
+#define SOLARUS_FRAME_PROFILER_H
+
+#include "Common.h"
+#include <vector>
+#include <fstream>
+
+/**
+ * \brief Measures where the time of each frame goes.
+ *
+ * The frame profiler is disabled by default and costs nothing in this case.
+ * It is enabled with the command-line option
+ * -frame-profiler[=overlay|csv|all].
+ * Then, the main sections of the main loop (updates of the game, of the
+ * entities and of Lua, drawings of the map, of the entities and of Lua,
+ * the final blit to the screen and the sound update) are measured with
+ * System::get_precise_ticks().
+ * A frame is everything that happens between two drawings of the screen.
+ * Sections can be nested: the time of a section includes its nested
+ * sections. A section is usually measured by declaring a ScopedSection
+ * object in the block to measure.
+ *
+ * The overlay shows for each section its average time and its worst time
+ * during the last frames.
+ * The CSV trace is written to frame_profile.csv, with one line per frame
+ * and one column per section (microseconds).
+ */
+class FrameProfiler {
+
+  public:
+
+    /**
+     * \brief The parts of a frame that are measured.
+     */
+    enum Section {
+      SECTION_MAIN_LOOP_UPDATE,   /**< MainLoop::update() */
+      SECTION_GAME_UPDATE,        /**< Game::update() */
+      SECTION_ENTITIES_UPDATE,    /**< MapEntities::update() */
+      SECTION_LUA_UPDATE,         /**< LuaContext::update() */
+      SECTION_MAP_DRAW,           /**< Map::draw() */
+      SECTION_ENTITIES_DRAW,      /**< MapEntities::draw() */
+      SECTION_LUA_DRAW,           /**< on_draw() callbacks of Lua */
+      SECTION_VIDEO_DRAW,         /**< VideoManager::draw() */
+      SECTION_SOUND_UPDATE,       /**< Sound::update() */
+      SECTION_NB
+    };
+
+    /**
+     * \brief Measures a section of the frame during the lifetime of this
+     * object, if the profiler is enabled.
+     */
+    class ScopedSection {
+
+      public:
+
+        ScopedSection(Section section);
+        ~ScopedSection();
+
+      private:
+
+        ScopedSection(const ScopedSection& other);
+        ScopedSection& operator=(const ScopedSection& other);
+
+        const Section section;                  /**< the section measured */
+        const bool started;                     /**< whether the section was started (profiler enabled) */
+    };
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+    static bool is_enabled();
+
+    static void begin_section(Section section);
+    static void end_section(Section section);
+    static void end_frame();
+    static void draw(Surface& dst_surface);
+
+  private:
+
+    static const int history_size = 60;        /**< number of frames of the rolling statistics */
+
+    FrameProfiler();
+
+    static void get_statistics(Section section,
+        uint32_t& average, uint32_t& worst);
+    static void write_csv_header();
+    static void write_csv_frame(uint64_t frame_time);
+    static void update_overlay();
+
+    static bool enabled;                        /**< whether the profiler was enabled from the command line */
+    static bool overlay_enabled;                /**< whether the statistics are shown on the screen */
+    static std::ofstream csv_file;              /**< the CSV trace if enabled */
+
+    static uint64_t frame_start_date;           /**< end date of the previous frame (microseconds) */
+    static int nb_frames;                       /**< number of frames measured so far */
+    static int nb_updates;                      /**< number of updates in the current frame */
+    static uint64_t section_start_dates[SECTION_NB];  /**< when each running section started (microseconds) */
+    static int section_depths[SECTION_NB];      /**< nesting level of each section (0: not running) */
+    static uint32_t section_times[SECTION_NB];  /**< time of each section in the current frame (microseconds) */
+    static std::vector<uint32_t> history[SECTION_NB];  /**< time of each section in the last frames (circular) */
+
+    static bool overlay_texts_created;          /**< whether the texts of the overlay were created */
+    static std::vector<TextSurface*> overlay_texts;  /**< one line of the overlay per section (empty if the quest has no font) */
+};
+
+/**
+ * \brief Returns whether the profiler was enabled from the command line.
+ * \return true if the sections of the frames are measured.
+ */
+inline bool FrameProfiler::is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Starts measuring a section if the profiler is enabled.
+ * \param section The section that starts.
+ */
+inline FrameProfiler::ScopedSection::ScopedSection(Section section):
+  section(section),
+  started(FrameProfiler::is_enabled()) {
+
+  if (started) {
+    FrameProfiler::begin_section(section);
+  }
+}
+
+/**
+ * \brief Stops measuring the section if it was started.
+ */
+inline FrameProfiler::ScopedSection::~ScopedSection() {
+
+  if (started) {
+    FrameProfiler::end_section(section);
+  }
+}
+
+#endif
+
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_IMAGE_CACHE_H
+#define SOLARUS_IMAGE_CACHE_H
+
+#include "Common.h"
+#include <string>
+#include <map>
+#include <list>
+#include <SDL.h>
+
+/**
+ * \brief Keeps recently loaded image files in memory.
+ *
+ * Images are identified by their file name, their data directory and the
+ * current language if they are language-specific.
+ * Loading an image already in the cache does not read and decode the file
+ * again. The cache and all surfaces loaded from the same file share the
+ * same pixels: SDL surfaces are reference-counted and SDL_FreeSurface()
+ * only frees them when their last user releases them.
+ * A surface that modifies its pixels first gets its own copy of them
+ * (see Surface::make_writable()).
+ *
+ * Decoded images are converted once to the formats of the engine: the
+ * 32-bit format of surfaces with an alpha channel if they have one, the
+ * format of the other surfaces otherwise, keeping their transparency
+ * color. This way, drawing images never needs to convert pixels between
+ * formats.
+ *
+ * The cache has a memory budget, 16 MB by default, that can be changed with
+ * the command-line option -image-cache-budget=<megabytes> (0 disables the
+ * cache). When the budget is exceeded, the least recently used images are
+ * removed from the cache. Their pixels are only freed when no surface uses
+ * them anymore.
+ */
+class ImageCache {
+
+  public:
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+
+    static SDL_Surface* load_image(const std::string& file_name, bool language_specific);
+
+  private:
+
+    /**
+     * \brief An image in the cache.
+     */
+    struct Entry {
+      SDL_Surface* surface;              /**< the decoded pixels */
+      size_t size;                       /**< memory used by the pixels in bytes */
+      std::list<std::string>::iterator
+          lru_position;                  /**< position of this image in lru_images */
+    };
+
+    ImageCache();
+
+    static SDL_Surface* decode_image(const std::string& file_name, bool language_specific);
+    static SDL_Surface* convert_image(SDL_Surface* surface);
+    static void remove_least_recently_used();
+
+    static size_t memory_budget;         /**< maximum memory used by the images of the cache in bytes */
+    static size_t memory_used;           /**< memory currently used by the images of the cache in bytes */
+    static std::map<std::string, Entry>
+        images;                          /**< images in the cache, indexed by key */
+    static std::list<std::string>
+        lru_images;                      /**< keys of the images, most recently used first */
+};
+
+#endif
+
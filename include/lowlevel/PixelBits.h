@@ -18,6 +18,7 @@
 #define SOLARUS_PIXEL_BITS_H
 
 #include "Common.h"
+#include <vector>
 
 /**
  * \brief Provides pixel-perfect collision checks for a surface.
@@ -25,7 +26,11 @@
  * This class stores efficiently the location of the non-transparent pixels of a surface.
  * For each pixel of the image, a bit indicates whether this pixel is transparent.
  * This class perform fast pixel-perfect collision checks.
- * Note that only 8-bit images are supported.
+ *
+ * The bits of all rows are stored in a single buffer of 64-bit words.
+ * Each row also knows its first and last opaque columns, so that empty rows
+ * and rows whose opaque pixels do not overlap are rejected without reading
+ * their bits, and only the overlapping span of other rows is compared.
  */
 class PixelBits {
 
@@ -33,18 +38,21 @@ class PixelBits {
 
     int width;               /**< width of the image in pixels */
     int height;              /**< height of the image in pixels */
-    int nb_integers_per_row; /**< number of uint32_t necessary to store
-                              * the bits of a row of the image */
+    int nb_words_per_row;    /**< number of 64-bit words storing a row, including
+                              * a last zero word that simplifies reading bits */
 
-    uint32_t** bits;         /**< a two-dimensional array representing the
-                              * transparency bit of each pixel in the image */
+    std::vector<uint64_t> bits; /**< the transparency bit of each pixel, row by row,
+                              * the leftmost pixel of a word being its most significant bit */
+    std::vector<int> row_min_x; /**< x of the first opaque pixel of each row (width if none) */
+    std::vector<int> row_max_x; /**< x of the last opaque pixel of each row (-1 if none) */
 
+    uint64_t get_bits(int row, int x) const;
     void print() const;
-    void print_mask(uint32_t mask) const;
 
   public:
 
-    PixelBits(Surface& surface, const Rectangle& image_position);
+    PixelBits(Surface& surface, const Rectangle& image_position,
+        const Rectangle& bounds);
     ~PixelBits();
 
     bool test_collision(const PixelBits& other, const Rectangle& location1, const Rectangle& location2) const;
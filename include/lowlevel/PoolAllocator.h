@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_POOL_ALLOCATOR_H
+#define SOLARUS_POOL_ALLOCATOR_H
+
+#include "Common.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * \brief A free-list allocator for objects of a fixed size.
+ *
+ * Memory is requested to the system by chunks of several blocks.
+ * Freed blocks are not returned to the system: they are kept in a free list
+ * and reused by the next allocations.
+ * This is useful for small objects that are created and destroyed very often,
+ * typically from a class-specific operator new and operator delete.
+ *
+ * Requests for another size than the block size (like objects of a derived
+ * class) are forwarded to the global operator new.
+ */
+class PoolAllocator {
+
+  public:
+
+    PoolAllocator(size_t block_size, int blocks_per_chunk = 64);
+    ~PoolAllocator();
+
+    void* allocate(size_t size);
+    void deallocate(void* block, size_t size);
+
+    int get_num_blocks_used() const;
+
+  private:
+
+    /**
+     * \brief A free block, reinterpreted as a node of the free list.
+     */
+    struct FreeBlock {
+      FreeBlock* next;             /**< Next free block or NULL. */
+    };
+
+    void add_chunk();
+
+    PoolAllocator(const PoolAllocator& other);             // Not copyable.
+    PoolAllocator& operator=(const PoolAllocator& other);
+
+    const size_t object_size;      /**< Size of the objects allocated. */
+    const size_t block_size;       /**< Size of a block (object size with
+                                    * alignment and free list constraints). */
+    const int blocks_per_chunk;    /**< Number of blocks allocated at once. */
+    FreeBlock* free_blocks;        /**< Head of the free list. */
+    std::vector<char*> chunks;     /**< All memory chunks obtained so far. */
+    int num_blocks_used;           /**< Number of blocks currently allocated. */
+};
+
+/**
+ * \brief Base class that makes a class allocate its objects from a pool.
+ *
+ * A class T uses it by deriving from PoolAllocated<T>:
+ * T then has an operator new and an operator delete that take their memory
+ * from a PoolAllocator shared by all objects of T.
+ * Objects of classes derived from T have another size and are allocated
+ * normally.
+ *
+ * If T derives from another pool-allocated class, it must choose its own
+ * operators with using-declarations.
+ */
+template<typename T, int blocks_per_chunk = 64>
+class PoolAllocated {
+
+  public:
+
+    /**
+     * \brief Allocates the memory of an object from the pool of its class.
+     * \param size Size of the object.
+     * \return The allocated memory.
+     */
+    static void* operator new(size_t size) {
+      return get_pool().allocate(size);
+    }
+
+    /**
+     * \brief Gives back the memory of an object to the pool of its class.
+     * \param block The memory to release.
+     * \param size Size of the object.
+     */
+    static void operator delete(void* block, size_t size) {
+      get_pool().deallocate(block, size);
+    }
+
+  private:
+
+    /**
+     * \brief Returns the pool of the class.
+     *
+     * The pool is created the first time an object is allocated.
+     *
+     * \return The pool.
+     */
+    static PoolAllocator& get_pool() {
+      static PoolAllocator pool(sizeof(T), blocks_per_chunk);
+      return pool;
+    }
+};
+
+#endif
+
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_REPLAY_H
+#define SOLARUS_REPLAY_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <fstream>
+
+/**
+ * \brief Records input events and replays them in a deterministic headless
+ * benchmark.
+ *
+ * In both cases, the clock returned by System::now() no longer depends on
+ * the real time: it advances by a fixed step at each cycle of the main loop
+ * (10 ms by default, -record-step=<milliseconds> to change it), and the
+ * random number generator is initialized with a fixed seed.
+ *
+ * With the command-line option -record-inputs=<file>, the input events
+ * of a normal session are written to a file with the index of the cycle
+ * of the main loop where they occur. Each cycle waits until the real time
+ * reaches the simulated clock, so that the game runs at its normal speed.
+ *
+ * With the option -replay=<file>, the program runs without window
+ * (dummy SDL video driver) and without audio, and the recorded events are
+ * used instead of the real ones, at the same cycles and with the same time
+ * step as when they were recorded. The main loop never sleeps.
+ * A replay then runs exactly the same cycles as the recorded session,
+ * which makes the real time of replays comparable.
+ * The program exits when the end of the recording is reached.
+ *
+ * The real time of each drawn frame is written to replay_stats.csv
+ * and a summary is printed when exiting.
+ */
+class Replay {
+
+  public:
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+    static bool is_recording();
+    static bool is_replaying();
+    static bool is_finished();
+    static bool is_clock_simulated();
+
+    static void update();
+    static uint32_t get_date();
+    static void end_frame();
+
+    static void record_event(const SDL_Event& event);
+    static bool get_event(SDL_Event& event);
+
+    static bool is_key_down(int key);
+    static bool is_joypad_button_down(int button);
+    static int get_joypad_axis(int axis);
+    static int get_joypad_hat(int hat);
+
+  private:
+
+    /**
+     * \brief An input event of the recording.
+     */
+    struct RecordedEvent {
+      int cycle;                            /**< cycle of the main loop when the event occurs */
+      SDL_Event event;                      /**< the event */
+    };
+
+    Replay();
+
+    static void load_events(const std::string& file_name);
+    static void update_input_state(const SDL_Event& event);
+    static void print_statistics();
+
+    static bool recording;                  /**< whether input events are recorded */
+    static std::ofstream record_file;       /**< where input events are recorded */
+    static uint64_t record_start_date;      /**< real date of the first cycle of the recording (microseconds) */
+
+    static bool replaying;                  /**< whether recorded input events are replayed */
+    static uint32_t time_step;              /**< simulated time of a cycle (milliseconds) */
+    static uint32_t date;                   /**< current simulated date (milliseconds) */
+    static int end_cycle;                   /**< cycle of the end of the recording */
+    static std::vector<RecordedEvent> events;  /**< the recorded events, sorted by cycle */
+    static unsigned int next_event;         /**< index of the next event to replay */
+
+    static std::set<int> keys_down;         /**< keyboard keys currently pressed in the replay */
+    static std::set<int> joypad_buttons_down;  /**< joypad buttons currently pressed in the replay */
+    static std::map<int, int> joypad_axes;  /**< current value of the joypad axes in the replay */
+    static std::map<int, int> joypad_hats;  /**< current value of the joypad hats in the replay */
+
+    static std::ofstream stats_file;        /**< the per-frame statistics */
+    static uint64_t frame_start_date;       /**< real date when the current frame started (microseconds) */
+    static int nb_cycles;                   /**< number of cycles in the current frame */
+    static int total_cycles;                /**< number of cycles since the beginning of the
+                                             * recording or of the replay */
+    static std::vector<uint32_t> frame_times;  /**< real time of each drawn frame (microseconds) */
+};
+
+#endif
+
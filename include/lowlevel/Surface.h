@@ -35,6 +35,8 @@ class Surface: public Drawable {
   friend class TextSurface;
   friend class VideoManager;
   friend class PixelBits;
+  friend class Compositor;
+  friend class ImageCache;
 
   public:
 
@@ -47,6 +49,16 @@ class Surface: public Drawable {
       DIR_LANGUAGE     /**< the language-specific image directory of the data package, for the current language */
     };
 
+    /**
+     * \brief How the colors of a surface are combined with the destination
+     * when it is drawn.
+     */
+    enum BlendMode {
+      BLEND_NORMAL,    /**< the surface is drawn over the destination (default) */
+      BLEND_ADD,       /**< colors are added to the destination, which makes it brighter */
+      BLEND_MULTIPLY   /**< colors are multiplied with the destination, which makes it darker */
+    };
+
   public:
 
     Surface(int width, int height);
@@ -58,17 +70,30 @@ class Surface: public Drawable {
 
     static Surface* create_from_file(const std::string& file_name,
         ImageDirectory base_directory = DIR_SPRITES);
+    static Surface* create_with_alpha(int width, int height);
 
     int get_width() const;
     int get_height() const;
     const Rectangle get_size() const;
 
+    bool has_transparency_color() const;
     Color get_transparency_color();
     void set_transparency_color(const Color& color);
+    int get_opacity() const;
     void set_opacity(int opacity);
+    BlendMode get_blend_mode() const;
+    void set_blend_mode(BlendMode blend_mode);
     void set_clipping_rectangle(const Rectangle& clipping_rectangle = Rectangle());
     void fill_with_color(Color& color);
     void fill_with_color(Color& color, const Rectangle& where);
+    void clear();
+    void lock();
+    void unlock();
+    bool has_same_pixels(const Rectangle& region, Surface& other);
+    bool has_alpha_channel() const;
+    void copy_pixels(Surface& dst_surface, const Rectangle& dst_position);
+    void shift_pixels(int dx, int dy);
+    void blend_region(const Rectangle& region, Surface& dst_surface, const Rectangle& dst_position);
 
     void draw_region(const Rectangle& src_position, Surface& dst_surface);
     void draw_region(const Rectangle& src_position, Surface& dst_surface, const Rectangle& dst_position);
@@ -87,7 +112,13 @@ class Surface: public Drawable {
 
     SDL_Surface* internal_surface;               /**< the SDL_Surface encapsulated */
     bool internal_surface_created;               /**< indicates that internal_surface was allocated from this class */
+    int opacity;                                 /**< opacity applied when drawing this surface (0 to 255) */
+    BlendMode blend_mode;                        /**< how this surface is combined with the destination */
 
+    void make_writable();
+    void blit(const Rectangle& region, Surface& dst_surface, const Rectangle& dst_position);
+    static uint32_t read_pixel(SDL_Surface* surface, int x, int y);
+    static void write_pixel(SDL_Surface* surface, int x, int y, uint32_t value);
     uint32_t get_pixel32(int idx_pixel);
     uint32_t get_mapped_pixel(int idx_pixel, SDL_PixelFormat* dst_format);
     SDL_Surface* get_internal_surface();
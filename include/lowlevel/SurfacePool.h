@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SURFACE_POOL_H
+#define SOLARUS_SURFACE_POOL_H
+
+#include "Common.h"
+#include <map>
+#include <vector>
+#include <SDL.h>
+
+/**
+ * \brief Recycles the pixel buffers of off-screen surfaces.
+ *
+ * Surfaces created with a size (by the engine or by sol.surface.create())
+ * come from this pool. When such a surface is destroyed, its SDL surface is
+ * kept in the pool instead of being freed, and the next surface created
+ * with the same size and format reuses it.
+ * This avoids allocating and freeing large buffers all the time, for example
+ * when menus create temporary surfaces at each frame.
+ *
+ * A recycled surface looks like a new one: its pixels are cleared, and it
+ * has no transparency color and no clipping rectangle.
+ * The pool keeps at most 8 MB of unused surfaces.
+ */
+class SurfacePool {
+
+  public:
+
+    static void quit();
+
+    static SDL_Surface* create_surface(uint32_t flags, int width, int height,
+        int depth, uint32_t r_mask, uint32_t g_mask, uint32_t b_mask, uint32_t a_mask);
+    static void free_surface(SDL_Surface* surface);
+
+  private:
+
+    /**
+     * \brief Size and format of a surface of the pool.
+     */
+    struct Format {
+      uint32_t flags;                    /**< SDL flags of the surface when it was created */
+      int width;                         /**< width in pixels */
+      int height;                        /**< height in pixels */
+      int depth;                         /**< bits per pixel */
+      uint32_t r_mask;                   /**< red mask */
+      uint32_t g_mask;                   /**< green mask */
+      uint32_t b_mask;                   /**< blue mask */
+      uint32_t a_mask;                   /**< alpha mask */
+
+      bool operator<(const Format& other) const;
+    };
+
+    SurfacePool();
+
+    static void reset_surface(SDL_Surface* surface, const Format& format);
+
+    static const size_t max_unused_memory = 8 * 1024 * 1024;  /**< memory that unused surfaces can keep in bytes */
+
+    static std::map<SDL_Surface*, Format>
+        pool_surfaces;                   /**< all surfaces created by the pool, used or not */
+    static std::map<Format, std::vector<SDL_Surface*> >
+        unused_surfaces;                 /**< surfaces available for reuse, by format */
+    static size_t unused_memory;         /**< memory used by the pixels of unused surfaces in bytes */
+};
+
+#endif
+
@@ -37,6 +37,7 @@ class System {
     static void update();
 
     static uint32_t now();
+    static uint64_t get_precise_ticks();
     static void sleep(uint32_t duration);
 };
 
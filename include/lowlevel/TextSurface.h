@@ -23,6 +23,7 @@
 #include "lowlevel/Rectangle.h"
 #include <SDL_ttf.h>
 #include <map>
+#include <vector>
 
 struct lua_State;
 
@@ -36,6 +37,14 @@ struct lua_State;
  * Two types of fonts are supported:
  * - usual fonts (TTF and other formats are supported),
  * - an image containing characters drawn.
+ *
+ * Characters of usual fonts are rendered in white once for each rendering
+ * mode and kept with their metrics in a glyph cache. They get the color of
+ * the text when they are drawn, so the cache does not grow with the number
+ * of colors used.
+ * Changing the text then only draws cached glyphs on a surface that is kept
+ * as long as it is big enough. When characters are added at the end of the
+ * text, only these new characters are drawn.
  */
 class TextSurface: public Drawable {
 
@@ -115,6 +124,26 @@ class TextSurface: public Drawable {
 
   private:
 
+    /**
+     * Identifies a character rendered with a rendering mode.
+     */
+    struct GlyphKey {
+      RenderingMode rendering_mode;                   /**< rendering mode of the glyph */
+      uint16_t code_point;                            /**< the character */
+
+      bool operator<(const GlyphKey& other) const;
+    };
+
+    /**
+     * A character rendered with a usual font.
+     */
+    struct Glyph {
+      Surface* image;                                 /**< pixels of the character (NULL if it has none) */
+      int x_offset;                                   /**< x of the image relative to the pen position */
+      int y_offset;                                   /**< y of the image relative to the top of the line */
+      int advance;                                    /**< how far the pen moves after this character */
+    };
+
     /**
      * This structures stores the data of a font.
      */
@@ -125,6 +154,7 @@ class TextSurface: public Drawable {
       SDL_RWops* rw;                                  /**< read/write object used to open the font file from memory */
       TTF_Font* internal_font;                        /**< the library-dependent font object */
       Surface* bitmap;                                /**< only used if it's a PNG font */
+      std::map<GlyphKey, Glyph> glyphs;               /**< characters already rendered (only for usual fonts) */
     };
 
     static void load_fonts();
@@ -133,6 +163,16 @@ class TextSurface: public Drawable {
     void rebuild();
     void rebuild_bitmap();
     void rebuild_ttf();
+    void prepare_surface(int width, int height, bool alpha);
+    bool append_text(const std::string& text);
+    int get_bitmap_text_width(const std::string& characters);
+    bool append_bitmap(const std::string& characters);
+    int get_ttf_text_width(const std::vector<uint16_t>& code_points);
+    bool append_ttf(const std::string& characters);
+    void draw_ttf_glyphs(const std::vector<uint16_t>& code_points, int width);
+    void set_ttf_pixels_color(int x, int width);
+    void update_position();
+    const Glyph& get_glyph(FontData& font, uint16_t code_point);
 
     static bool fonts_loaded;                         /**< Whether fonts.dat was read. */
     static std::map<std::string, FontData> fonts;     /**< the data of each font, loaded from the file text/fonts.dat
@@ -147,8 +187,11 @@ class TextSurface: public Drawable {
 
     int x;                                            /**< x coordinate of where the text is aligned */
     int y;                                            /**< y coordinate of where the text is aligned */
-    Surface* surface;                                 /**< the surface to draw */
-    Rectangle text_position;                          /**< position of the top-left corner of the surface on the screen */
+    Surface* surface;                                 /**< the surface to draw, kept when the text changes
+                                                       * and possibly bigger than the text */
+    Rectangle text_position;                          /**< position of the top-left corner of the text on the screen
+                                                       * and size of the text (empty if there is nothing to draw) */
+    int next_x;                                       /**< x on the surface where the next character would be drawn */
 
     std::string text;                                 /**< the string to draw (only one line) */
 
@@ -21,6 +21,7 @@
 #include "lowlevel/Rectangle.h"
 #include <list>
 #include <map>
+#include <SDL.h>
 
 /**
  * \brief Draws the window and handles the video mode.
@@ -96,6 +97,7 @@ class VideoManager {
     void draw_unscaled(Surface& quest_surface);
     void draw_stretched(Surface& quest_surface);
     void draw_scale2x(Surface& quest_surface);
+    static bool has_same_format(SDL_Surface* src_surface, SDL_Surface* dst_surface);
     uint32_t get_surface_flag(const VideoMode mode) const;
 
     static VideoManager* instance;          /**< The only instance. */
@@ -20,13 +20,16 @@
 #include "Common.h"
 #include "GameCommands.h"
 #include "entities/Layer.h"
+#include "entities/EntityType.h"
 #include "entities/EnemyAttack.h"
 #include "lowlevel/InputEvent.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "Timer.h"
 #include <map>
 #include <set>
 #include <list>
+#include <vector>
 #include <lua.hpp>
 
 /**
@@ -94,6 +97,8 @@ class LuaContext {
     void initialize();
     void exit();
     void update();
+    void collect_garbage(uint32_t max_duration);
+    void notify_frame_drawn();
     bool notify_input(InputEvent& event);
     void notify_map_suspended(Map& map, bool suspended);
     void notify_camera_reached_target(Map& map);
@@ -173,6 +178,11 @@ class LuaContext {
     static void print_stack(lua_State* l);
     static bool is_valid_lua_identifier(const std::string& name);
 
+    // Garbage collection.
+    uint32_t get_gc_time_budget();
+    void set_gc_time_budget(uint32_t gc_time_budget);
+    uint32_t get_gc_time();
+
     // Lua refs.
     int create_ref();
     void destroy_ref(int ref);
@@ -184,6 +194,7 @@ class LuaContext {
     void add_timer(Timer* timer, int context_index, int callback_index);
     void remove_timer(Timer* timer);
     void remove_timers(int context_index);
+    void schedule_timer(Timer* timer);
     void destroy_timers();
     void update_timers();
     void notify_timers_map_suspended(bool suspended);
@@ -356,6 +367,10 @@ class LuaContext {
       main_api_save_settings,
       main_api_get_distance,  // TODO remove?
       main_api_get_angle,     // TODO remove?
+      main_api_get_lua_memory,
+      main_api_get_gc_time,
+      main_api_get_gc_time_budget,
+      main_api_set_gc_time_budget,
 
       // Audio API.
       audio_api_get_sound_volume,
@@ -441,6 +456,8 @@ class LuaContext {
       surface_api_get_transparency_color,
       surface_api_set_transparency_color,
       surface_api_set_opacity,
+      surface_api_get_blend_mode,
+      surface_api_set_blend_mode,
 
       // Text surface API.
       text_surface_api_create,
@@ -661,6 +678,9 @@ class LuaContext {
       map_api_get_entity,
       map_api_has_entity,
       map_api_get_entities,
+      map_api_get_entities_by_type,
+      map_api_get_entities_in_rectangle,
+      map_api_get_entities_in_radius,
       map_api_get_entities_count,
       map_api_has_entities,
       map_api_set_entities_enabled,
@@ -719,6 +739,9 @@ class LuaContext {
       entity_api_test_obstacles,
       entity_api_get_optimization_distance,
       entity_api_set_optimization_distance,
+      entity_api_is_sleep_allowed,
+      entity_api_set_sleep_allowed,
+      entity_api_is_sleeping,
       entity_api_is_in_same_region,
       hero_api_teleport,
       hero_api_get_direction,
@@ -813,8 +836,41 @@ class LuaContext {
     struct LuaTimerData {
       int callback_ref;     /**< Lua ref of the function to call after the timer. */
       const void* context;  /**< Lua table or userdata the timer is attached to. */
+      uint32_t schedule_id; /**< Id of the valid entry of this timer in a
+                             * timer queue (0 means none). */
     };
 
+    /**
+     * \brief An entry of a timer queue.
+     *
+     * Entries are never removed from the middle of a queue: when a timer is
+     * rescheduled or removed, its previous entry becomes obsolete and is
+     * skipped when it reaches the top of the queue.
+     */
+    struct TimerQueueEntry {
+      uint32_t date;        /**< Date when the timer needs to be updated,
+                             * in the time of the clock of the queue. */
+      uint32_t schedule_id; /**< Id of this entry. */
+      Timer* timer;         /**< The timer to update. */
+
+      /**
+       * \brief Compares two entries for std heap functions.
+       *
+       * The comparison is reversed so that the top of the heap is the
+       * earliest date.
+       *
+       * \param other Another entry.
+       * \return true if this entry is due after the other one.
+       */
+      bool operator<(const TimerQueueEntry& other) const {
+        return date > other.date;
+      }
+    };
+
+    // Garbage collection.
+    bool step_garbage_collector(int step_size = 0);
+    void finish_garbage_collection();
+
     // Executing Lua code.
     bool find_global_function(const std::string& function_name);
     bool find_local_function(int index, const std::string& function_name);
@@ -825,11 +881,16 @@ class LuaContext {
         const std::string& function_name);
     static bool call_function(lua_State* l, int nb_arguments, int nb_results,
         const std::string& function_name);
+    static std::string get_profiled_type_name(lua_State* l, int index);
     static void load_file(lua_State* l, const std::string& script_name);
     static bool load_file_if_exists(lua_State* l, const std::string& script_name);
     static void do_file(lua_State* l, const std::string& script_name);
     static bool do_file_if_exists(lua_State* l, const std::string& script_name);
 
+    // Timers.
+    void update_timer_queue(std::vector<TimerQueueEntry>& queue, uint32_t now);
+    void compact_timer_queue(std::vector<TimerQueueEntry>& queue);
+
     // Initialization of modules.
     void register_functions(const std::string& module_name, const luaL_Reg* functions);
     void register_type(const std::string& module_name, const luaL_Reg* methods,
@@ -867,6 +928,12 @@ class LuaContext {
     static void push_game(lua_State* l, Savegame& game);
     static void push_map(lua_State* l, Map& map);
     static void push_entity(lua_State* l, MapEntity& entity);
+    static void push_entity_array(lua_State* l,
+        const std::vector<MapEntity*>& entities);
+    static Layer opt_layer_filter(lua_State* l, int index);
+    static bool opt_entity_type_filter(lua_State* l, int index, EntityType& type);
+    static void filter_entities_by_type(EntityType type,
+        std::vector<MapEntity*>& entities);
     static void push_hero(lua_State* l, Hero& hero);
     static void push_npc(lua_State* l, NPC& npc);
     static void push_chest(lua_State* l, Chest& chest);
@@ -1039,6 +1106,32 @@ class LuaContext {
                                      * their context and callback. */
     std::list<Timer*>
         timers_to_remove;           /**< Timers to be removed at the next cycle. */
+    std::vector<TimerQueueEntry>
+        timers_queue;               /**< Heap of timers using the system clock,
+                                     * ordered by date of next update. */
+    std::vector<TimerQueueEntry>
+        map_timers_queue;           /**< Heap of timers using the map clock,
+                                     * ordered by date of next update. */
+    Timer::Clock map_clock;         /**< Clock of timers suspended with the map:
+                                     * paused while the map is suspended. */
+    std::set<Timer*>
+        timers_off_map_clock;       /**< Timers that should be suspended with
+                                     * the map but are temporarily not attached
+                                     * to the map clock. */
+    std::set<Timer*>
+        timers_resumed_with_map;    /**< Suspended timers, to be resumed
+                                     * when the map is resumed. */
+    uint32_t next_timer_schedule_id;/**< Id of the next timer queue entry. */
+
+    uint32_t gc_time_budget;        /**< Maximum time in microseconds given to
+                                     * the garbage collector at each frame
+                                     * (0 means automatic collection by Lua). */
+    uint32_t gc_time;               /**< Time in microseconds spent collecting
+                                     * garbage since the last drawing. */
+    uint32_t last_gc_time;          /**< Time in microseconds spent collecting
+                                     * garbage during the last frame. */
+    int gc_memory_after_cycle;      /**< Memory used by Lua in KB when the last
+                                     * collection cycle finished. */
 
     std::set<Drawable*> drawables;  /**< All drawable objects created by
                                      * this script. */
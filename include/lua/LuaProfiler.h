@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_LUA_PROFILER_H
+#define SOLARUS_LUA_PROFILER_H
+
+#include "Common.h"
+#include <string>
+#include <map>
+#include <vector>
+#include <iosfwd>
+#include <lua.hpp>
+
+/**
+ * \brief Measures the cost of the Lua callbacks called by the engine.
+ *
+ * The profiler is disabled by default and costs nothing in this case.
+ * It is enabled with the command-line option
+ * -lua-profiler[=flat|folded].
+ * Then, every call from C++ to Lua is measured: its wall time, its
+ * number of calls and the number of bytes allocated by Lua during the call.
+ * Results are grouped by the type of the object the callback is called on,
+ * the name of the callback and the script where the function is defined.
+ *
+ * With the option -lua-profiler-sampling[=<instructions>], a Lua hook is
+ * also installed to know which Lua functions are running inside these
+ * callbacks: every given number of Lua instructions, the time elapsed since
+ * the previous sample is attributed to the current Lua call stack.
+ *
+ * When the program exits, the report is written to lua_profile.txt
+ * (flat report) or lua_profile.folded (folded stacks, one line per stack,
+ * compatible with flame graph tools).
+ */
+class LuaProfiler {
+
+  public:
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+    static bool is_enabled();
+
+    static void attach(lua_State* l);
+    static void begin_call(lua_State* l, int nb_arguments,
+        const std::string& object_type, const std::string& function_name);
+    static void end_call();
+
+  private:
+
+    /**
+     * \brief Output format of the report.
+     */
+    enum Format {
+      FORMAT_FLAT,              /**< one line per callback with its stats */
+      FORMAT_FOLDED             /**< folded stacks for flame graph tools */
+    };
+
+    /**
+     * \brief Identifies a kind of callback.
+     */
+    struct CallbackId {
+      std::string object_type;  /**< type of the object the callback is called on */
+      std::string name;         /**< name of the callback */
+      std::string script;       /**< script file and line where the function is defined */
+
+      bool operator<(const CallbackId& other) const;
+    };
+
+    /**
+     * \brief Accumulated measures of a kind of callback.
+     */
+    struct CallbackStats {
+      uint32_t nb_calls;        /**< number of calls */
+      uint64_t total_time;      /**< time spent in the callback, including nested callbacks (microseconds) */
+      uint64_t self_time;       /**< time spent in the callback, excluding nested callbacks (microseconds) */
+      uint64_t allocated;       /**< bytes allocated by Lua during the callback */
+    };
+
+    /**
+     * \brief A callback currently running.
+     */
+    struct Frame {
+      CallbackId id;            /**< the callback */
+      std::string stack;        /**< folded stack of callbacks leading to this one */
+      uint64_t start_date;      /**< when the callback was called (microseconds) */
+      uint64_t start_allocated; /**< value of allocated_bytes when the callback was called */
+      uint64_t children_time;   /**< time spent in nested callbacks (microseconds) */
+    };
+
+    LuaProfiler();
+
+    static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+    static void sample(lua_State* l, lua_Debug* ar);
+    static void write_flat_report(std::ostream& out);
+    static void write_folded_report(std::ostream& out);
+
+    static bool enabled;                  /**< whether the profiler was enabled from the command line */
+    static Format format;                 /**< output format of the report */
+    static int sampling_interval;         /**< number of Lua instructions between two samples (0: no sampling) */
+
+    static lua_Alloc original_allocator;  /**< the allocator that Lua used before attach() */
+    static void* original_allocator_data; /**< opaque data of the original allocator */
+    static uint64_t allocated_bytes;      /**< total number of bytes allocated by Lua so far */
+
+    static std::vector<Frame> frames;     /**< callbacks currently running, innermost last */
+    static std::map<CallbackId, CallbackStats> stats;   /**< measures of each callback */
+    static std::map<std::string, uint64_t> callback_stacks;  /**< self time of each stack of callbacks */
+    static std::map<std::string, uint64_t> sampled_stacks;   /**< sampled time of each Lua call stack */
+    static uint64_t last_sample_date;     /**< date of the previous sample (microseconds) */
+};
+
+#endif
+
@@ -19,6 +19,7 @@
 
 #include "Common.h"
 #include "movements/PixelMovement.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief Movement of an entity that follows a predetermined path.
@@ -33,7 +34,7 @@
  * A "trajectory" is a move of 8 pixels in the sense of the PixelMovement class.
  * A path is composed of several trajectories. The notion of trajectory is hidden from the public interface of PathMovement.
  */
-class PathMovement: public PixelMovement {
+class PathMovement: public PixelMovement, public PoolAllocated<PathMovement> {
 
   public:
 
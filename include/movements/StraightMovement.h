@@ -19,12 +19,13 @@
 
 #include "Common.h"
 #include "movements/Movement.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief A straight movement represented as a speed vector
  * whose properties (speed and angle) can be changed.
  */
-class StraightMovement: public Movement {
+class StraightMovement: public Movement, public PoolAllocated<StraightMovement> {
 
   private:
 
@@ -19,13 +19,14 @@
 
 #include "Common.h"
 #include "movements/StraightMovement.h"
+#include "lowlevel/PoolAllocator.h"
 
 /**
  * \brief Movement of an object that goes to a target point.
  *
  * The target point may be a fixed point or a moving entity.
  */
-class TargetMovement: public StraightMovement {
+class TargetMovement: public StraightMovement, public PoolAllocated<TargetMovement> {
 
   public:
 
@@ -37,6 +38,10 @@ class TargetMovement: public StraightMovement {
         bool ignore_obstacles);
     ~TargetMovement();
 
+    // StraightMovement has its own pool: use the one of TargetMovement.
+    using PoolAllocated<TargetMovement>::operator new;
+    using PoolAllocated<TargetMovement>::operator delete;
+
     void set_target(MapEntity* target_entity, int x, int y);
 
     int get_moving_speed();
@@ -106,9 +106,9 @@ void Camera::update_fixed_on_hero() {
     int adjusted_x = x;  // Updated coordinates after applying separators.
     int adjusted_y = y;
     std::list<Separator*> applied_separators;
-    const std::list<Separator*>& separators =
+    const std::vector<Separator*>& separators =
         map.get_entities().get_separators();
-    std::list<Separator*>::const_iterator it;
+    std::vector<Separator*>::const_iterator it;
     for (it = separators.begin(); it != separators.end(); ++it) {
       Separator& separator = *(*it);
 
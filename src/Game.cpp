@@ -31,6 +31,7 @@
 #include "lowlevel/StringConcat.h"
 #include "lowlevel/Music.h"
 #include "lowlevel/VideoManager.h"
+#include "lowlevel/FrameProfiler.h"
 #include <sstream>
 #include <vector>
 
@@ -526,6 +527,7 @@ void Game::draw(Surface& dst_surface) {
     }
   }
 
+  FrameProfiler::ScopedSection section(FrameProfiler::SECTION_LUA_DRAW);
   get_lua_context().game_on_draw(*this, dst_surface);
 }
 
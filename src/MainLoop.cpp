@@ -23,6 +23,9 @@
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lua/LuaContext.h"
+#include "lua/LuaProfiler.h"
+#include "lowlevel/FrameProfiler.h"
+#include "lowlevel/Replay.h"
 #include "QuestProperties.h"
 #include "Game.h"
 #include "Savegame.h"
@@ -53,6 +56,8 @@ MainLoop::MainLoop(int argc, char** argv):
 
   root_surface = new Surface(VideoManager::get_instance()->get_quest_size());
   root_surface->increment_refcount();
+  LuaProfiler::initialize(argc, argv);
+  FrameProfiler::initialize(argc, argv);
   lua_context = new LuaContext(*this);
   lua_context->initialize();
 }
@@ -63,6 +68,8 @@ MainLoop::MainLoop(int argc, char** argv):
 MainLoop::~MainLoop() {
 
   delete lua_context;
+  LuaProfiler::quit();
+  FrameProfiler::quit();
   root_surface->decrement_refcount();
   delete root_surface;
   QuestResourceList::quit();
@@ -166,6 +173,10 @@ void MainLoop::run() {
     // update the current screen
     update();
 
+    if (Replay::is_finished()) {
+      set_exiting();
+    }
+
     // go to another game?
     if (next_game != game) {
       if (game != NULL) {
@@ -200,8 +211,20 @@ void MainLoop::run() {
         next_frame_date = now + frame_interval;
         just_redrawn = true;
         draw();
+        lua_context->notify_frame_drawn();
+        if (FrameProfiler::is_enabled()) {
+          FrameProfiler::end_frame();
+        }
+        if (Replay::is_replaying()) {
+          Replay::end_frame();
+        }
       }
       else {
+        if (just_redrawn) {
+          // This is the first spare time since the last drawing:
+          // let Lua collect garbage during some of it
+          lua_context->collect_garbage(delay);
+        }
         just_redrawn = false;
 
         // if we have time, let's sleep to avoid using all the processor
@@ -260,10 +283,18 @@ void MainLoop::notify_input(InputEvent& event) {
  */
 void MainLoop::update() {
 
+  FrameProfiler::ScopedSection section(FrameProfiler::SECTION_MAIN_LOOP_UPDATE);
+
   if (game != NULL) {
+    FrameProfiler::ScopedSection game_section(FrameProfiler::SECTION_GAME_UPDATE);
     game->update();
   }
-  lua_context->update();
+
+  {
+    FrameProfiler::ScopedSection lua_section(FrameProfiler::SECTION_LUA_UPDATE);
+    lua_context->update();
+  }
+
   System::update();
 }
 
@@ -278,7 +309,14 @@ void MainLoop::draw() {
   if (game != NULL) {
     game->draw(*root_surface);
   }
-  lua_context->main_on_draw(*root_surface);
+
+  {
+    FrameProfiler::ScopedSection section(FrameProfiler::SECTION_LUA_DRAW);
+    lua_context->main_on_draw(*root_surface);
+  }
+  FrameProfiler::draw(*root_surface);
+
+  FrameProfiler::ScopedSection video_section(FrameProfiler::SECTION_VIDEO_DRAW);
   VideoManager::get_instance()->draw(*root_surface);
 }
 
@@ -26,6 +26,7 @@
 #include "lowlevel/VideoManager.h"
 #include "lowlevel/Music.h"
 #include "lowlevel/Debug.h"
+#include "lowlevel/FrameProfiler.h"
 #include "entities/Ground.h"
 #include "entities/Tileset.h"
 #include "entities/TilePattern.h"
@@ -108,8 +109,10 @@ void Map::set_tileset(const std::string& tileset_id) {
 
   Tileset new_tileset(tileset_id);
   new_tileset.load();
+  std::set<int> changed_tile_patterns;
+  tileset->get_changed_tile_patterns(new_tileset, changed_tile_patterns);
   tileset->set_images(new_tileset);
-  get_entities().notify_tileset_changed();
+  get_entities().notify_tileset_changed(changed_tile_patterns);
   this->tileset_id = tileset_id;
 }
 
@@ -242,6 +245,9 @@ void Map::unload() {
       dark_surfaces[i] = NULL;
     }
     loaded = false;
+
+    // The next map is already loaded: sprites only used by this one can go.
+    Sprite::unload_unused_animation_sets();
   }
 }
 
@@ -512,7 +518,10 @@ void Map::update() {
 
   // update the elements
   TilePattern::update();
-  entities->update();
+  {
+    FrameProfiler::ScopedSection section(FrameProfiler::SECTION_ENTITIES_UPDATE);
+    entities->update();
+  }
   get_lua_context().map_on_update(*this);
   camera->update();  // update the camera after the entities since this might
                      // be the last update() call for this map */
@@ -548,16 +557,22 @@ void Map::check_suspended() {
 void Map::draw() {
 
   if (is_loaded()) {
+    FrameProfiler::ScopedSection section(FrameProfiler::SECTION_MAP_DRAW);
+
     // background
     draw_background();
 
     // draw all entities (including the hero)
-    entities->draw();
+    {
+      FrameProfiler::ScopedSection entities_section(FrameProfiler::SECTION_ENTITIES_DRAW);
+      entities->draw();
+    }
 
     // foreground
     draw_foreground();
 
     // Lua
+    FrameProfiler::ScopedSection lua_section(FrameProfiler::SECTION_LUA_DRAW);
     get_lua_context().map_on_draw(*this, *visible_surface);
   }
 }
@@ -651,9 +666,22 @@ void Map::draw_sprite(Sprite &sprite, const Rectangle &xy) {
  */
 void Map::draw_sprite(Sprite& sprite, int x, int y) {
 
+  // don't draw the sprite if even its biggest frame is outside the camera
+  const Rectangle& camera_position = get_camera_position();
+  const Rectangle& origin = sprite.get_origin();
+  const Rectangle& max_size = sprite.get_max_size();
+  const Rectangle& sprite_xy = sprite.get_xy();
+  const Rectangle max_bounding_box(
+      x + sprite_xy.get_x() - origin.get_x(),
+      y + sprite_xy.get_y() - origin.get_y(),
+      max_size.get_width(),
+      max_size.get_height());
+  if (!max_bounding_box.overlaps(camera_position)) {
+    return;
+  }
+
   // the position is given in the map coordinate system:
   // convert it to the visible surface coordinate system
-  const Rectangle& camera_position = get_camera_position();
   sprite.draw(*visible_surface,
       x - camera_position.get_x(),
       y - camera_position.get_y()
@@ -841,16 +869,13 @@ bool Map::test_collision_with_ground(Layer layer, int x, int y,
 bool Map::test_collision_with_entities(Layer layer,
     const Rectangle& collision_box, MapEntity& entity_to_check) {
 
-  const std::list<MapEntity*>& obstacle_entities = entities->get_obstacle_entities(layer);
+  const std::vector<MapEntity*>& obstacle_entities = entities->get_obstacle_entities(layer);
 
   bool collision = false;
 
-  std::list<MapEntity*>::const_iterator i;
-  for (i = obstacle_entities.begin();
-       i != obstacle_entities.end() && !collision;
-       ++i) {
+  for (unsigned int i = 0; i < obstacle_entities.size() && !collision; i++) {
 
-    MapEntity *entity = *i;
+    MapEntity *entity = obstacle_entities[i];
     collision =
 	entity != &entity_to_check
 	&& entity->is_enabled()
@@ -988,17 +1013,15 @@ void Map::check_collision_with_detectors(MapEntity &entity) {
     return;
   }
 
-  const std::list<Detector*>& detectors = entities->get_detectors();
+  const std::vector<Detector*>& detectors = entities->get_detectors();
 
   // check each detector
-  std::list<Detector*>::const_iterator i;
+  // (detectors may be created during the loop: don't use iterators)
+  for (unsigned int i = 0; i < detectors.size(); i++) {
 
-  for (i = detectors.begin();
-       i != detectors.end();
-       i++) {
-
-    if (!(*i)->is_being_removed() && (*i)->is_enabled()) {
-      (*i)->check_collision(entity);
+    Detector* detector = detectors[i];
+    if (!detector->is_being_removed() && detector->is_enabled()) {
+      detector->check_collision(entity);
     }
   }
 }
@@ -1020,16 +1043,15 @@ void Map::check_collision_with_detectors(MapEntity &entity, Sprite &sprite) {
     return;
   }
 
-  const std::list<Detector*>& detectors = entities->get_detectors();
+  const std::vector<Detector*>& detectors = entities->get_detectors();
   // check each detector
-  std::list<Detector*>::const_iterator i;
-  for (i = detectors.begin();
-       i != detectors.end();
-       i++) {
-
-    if (!(*i)->is_being_removed()
-        && (*i)->is_enabled()) {
-      (*i)->check_collision(entity, sprite);
+  // (detectors may be created during the loop: don't use iterators)
+  for (unsigned int i = 0; i < detectors.size(); i++) {
+
+    Detector* detector = detectors[i];
+    if (!detector->is_being_removed()
+        && detector->is_enabled()) {
+      detector->check_collision(entity, sprite);
     }
   }
 }
@@ -129,10 +129,13 @@ int MapLoader::l_properties(lua_State* l) {
   entities.map_width8 = map->width8;
   entities.map_height8 = map->height8;
   entities.tiles_grid_size = map->width8 * map->height8;
+  entities.entity_grid.set_size(width, height);
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
     entities.animated_tiles[layer] = new bool[entities.tiles_grid_size];
     entities.tiles_ground[layer] = new Ground[entities.tiles_grid_size];
+    entities.ground_modifiers_grid[layer] =
+        new std::vector<MapEntities::GroundModifierEntry>[entities.tiles_grid_size];
     Ground initial_ground = (layer == LAYER_LOW) ? GROUND_TRAVERSABLE : GROUND_EMPTY;
     for (int i = 0; i < entities.tiles_grid_size; i++) {
       entities.animated_tiles[layer][i] = false;
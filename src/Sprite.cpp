@@ -18,8 +18,10 @@
 #include "SpriteAnimationSet.h"
 #include "SpriteAnimation.h"
 #include "SpriteAnimationDirection.h"
+#include "SpriteAtlas.h"
 #include "Game.h"
 #include "Map.h"
+#include "entities/MapEntities.h"
 #include "movements/Movement.h"
 #include "lua/LuaContext.h"
 #include "lowlevel/PixelBits.h"
@@ -30,6 +32,7 @@
 #include "lowlevel/StringConcat.h"
 
 std::map<std::string, SpriteAnimationSet*> Sprite::all_animation_sets;
+std::map<std::string, int> Sprite::animation_set_refcounts;
 
 /**
  * \brief Initializes the sprites system.
@@ -48,6 +51,34 @@ void Sprite::quit() {
     delete it->second;
   }
   all_animation_sets.clear();
+  animation_set_refcounts.clear();
+
+  SpriteAtlas::quit();
+}
+
+/**
+ * \brief Deletes the animation sets that no sprite uses anymore.
+ *
+ * Animation sets are kept in memory when their last sprite is destroyed,
+ * because sprites are often recreated soon.
+ * This function should be called at moments where many sprites were
+ * destroyed, like when a map is unloaded.
+ * The images of animation sets deleted can be released from the sprite
+ * atlas and stay for a while in the image cache.
+ */
+void Sprite::unload_unused_animation_sets() {
+
+  std::map<std::string, int>::iterator it = animation_set_refcounts.begin();
+  while (it != animation_set_refcounts.end()) {
+    if (it->second == 0) {
+      delete all_animation_sets[it->first];
+      all_animation_sets.erase(it->first);
+      animation_set_refcounts.erase(it++);
+    }
+    else {
+      ++it;
+    }
+  }
 }
 
 /**
@@ -55,6 +86,7 @@ void Sprite::quit() {
  *
  * The animation set may be created if it is new, or just retrieved from
  * memory if it way already used before.
+ * Each call must be followed later by a call to release_animation_set().
  *
  * \param id id of the animation set
  * \return the corresponding animation set
@@ -64,10 +96,28 @@ SpriteAnimationSet& Sprite::get_animation_set(const std::string &id) {
   if (all_animation_sets.find(id) == all_animation_sets.end()) {
     all_animation_sets[id] = new SpriteAnimationSet(id);
   }
+  ++animation_set_refcounts[id];
 
   return *all_animation_sets[id];
 }
 
+/**
+ * \brief Indicates that a sprite does not use an animation set anymore.
+ *
+ * The animation set is kept in memory until unload_unused_animation_sets()
+ * is called.
+ *
+ * \param id id of the animation set
+ */
+void Sprite::release_animation_set(const std::string& id) {
+
+  std::map<std::string, int>::iterator it = animation_set_refcounts.find(id);
+  if (it != animation_set_refcounts.end() && it->second > 0) {
+    // The animation sets may have already been deleted by quit().
+    --it->second;
+  }
+}
+
 /**
  * \brief Creates a sprite with the specified animation set.
  * \param id name of an animation set
@@ -75,6 +125,7 @@ SpriteAnimationSet& Sprite::get_animation_set(const std::string &id) {
 Sprite::Sprite(const std::string& id):
   Drawable(),
   lua_context(NULL),
+  map_entities(NULL),
   animation_set_id(id),
   animation_set(get_animation_set(id)),
   current_animation(NULL),
@@ -97,6 +148,7 @@ Sprite::Sprite(const std::string& id):
 Sprite::~Sprite() {
 
   delete intermediate_surface;
+  release_animation_set(animation_set_id);
 }
 
 /**
@@ -733,6 +785,32 @@ void Sprite::set_lua_context(LuaContext* lua_context) {
   this->lua_context = lua_context;
 }
 
+/**
+ * \brief Sets the coordinates of this sprite relative to its origin.
+ *
+ * The entities of the map are notified so that they keep drawing the
+ * sprite even if it is displaced far from its entity.
+ *
+ * \param xy The new coordinates of this sprite.
+ */
+void Sprite::set_xy(const Rectangle& xy) {
+
+  Drawable::set_xy(xy);
+
+  if (map_entities != NULL) {
+    map_entities->notify_sprite_displaced(*this);
+  }
+}
+
+/**
+ * \brief Sets the map entities to notify when this sprite is displaced.
+ * \param map_entities The entities of the map where this sprite is drawn,
+ * or NULL.
+ */
+void Sprite::set_map_entities(MapEntities* map_entities) {
+  this->map_entities = map_entities;
+}
+
 /**
  * \brief Returns the name identifying this type in Lua.
  * \return the name identifying this type in Lua
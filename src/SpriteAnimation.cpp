@@ -16,6 +16,7 @@
  */
 #include "SpriteAnimation.h"
 #include "SpriteAnimationDirection.h"
+#include "SpriteAtlas.h"
 #include "entities/Tileset.h"
 #include "lowlevel/Surface.h"
 #include "lowlevel/Debug.h"
@@ -35,6 +36,7 @@ SpriteAnimation::SpriteAnimation(
     uint32_t frame_delay,
     int loop_on_frame):
 
+  image_file_name(image_file_name),
   src_image(NULL),
   src_image_loaded(false),
   directions(directions),
@@ -43,7 +45,7 @@ SpriteAnimation::SpriteAnimation(
   should_enable_pixel_collisions(false) {
 
   if (image_file_name != "tileset") {
-    src_image = new Surface(image_file_name);
+    src_image = &SpriteAtlas::get_image(image_file_name, src_image_position);
     src_image_loaded = true;
   }
 }
@@ -59,7 +61,7 @@ SpriteAnimation::~SpriteAnimation() {
   }
 
   if (src_image_loaded) {
-    delete src_image;
+    SpriteAtlas::release_image(image_file_name);
   }
 }
 
@@ -74,6 +76,7 @@ void SpriteAnimation::set_tileset(Tileset& tileset) {
 
   if (!src_image_loaded) {
     this->src_image = &tileset.get_entities_image();
+    this->src_image_position = src_image->get_size();
     if (should_enable_pixel_collisions) {
       disable_pixel_collisions(); // to force creating the images again
       do_enable_pixel_collisions();
@@ -160,7 +163,7 @@ void SpriteAnimation::draw(Surface& dst_surface,
           << " directions");
     }
     directions[current_direction]->draw(dst_surface, dst_position,
-        current_frame, *src_image);
+        current_frame, *src_image, src_image_position);
   }
 }
 
@@ -185,7 +188,9 @@ void SpriteAnimation::do_enable_pixel_collisions() {
 
   std::vector<SpriteAnimationDirection*>::iterator it;
   for (it = directions.begin(); it != directions.end(); ++it) {
-    (*it)->enable_pixel_collisions(src_image);
+    // Frames of the sprite atlas can be shared: its pages stay alive
+    // as long as this animation.
+    (*it)->enable_pixel_collisions(src_image, src_image_position, src_image_loaded);
   }
 }
 
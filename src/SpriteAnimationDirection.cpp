@@ -19,6 +19,10 @@
 #include "lowlevel/Surface.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include <algorithm>
+
+std::map<SpriteAnimationDirection::PixelBitsKey, SpriteAnimationDirection::SharedPixelBits>
+    SpriteAnimationDirection::all_shared_pixel_bits;
 
 /**
  * \brief Constructor.
@@ -29,7 +33,9 @@ SpriteAnimationDirection::SpriteAnimationDirection(
     const std::vector<Rectangle>& frames,
     const Rectangle& origin):
   frames(frames),
-  origin(origin) {
+  origin(origin),
+  pixel_bits_image(NULL),
+  pixel_bits_shared(false) {
 
   Debug::check_assertion(!frames.empty(), "Empty sprite direction");
 }
@@ -39,10 +45,7 @@ SpriteAnimationDirection::SpriteAnimationDirection(
  */
 SpriteAnimationDirection::~SpriteAnimationDirection() {
 
-  std::vector<PixelBits*>::iterator it;
-  for (it = pixel_bits.begin(); it != pixel_bits.end(); ++it) {
-    delete *it;
-  }
+  disable_pixel_collisions();
 }
 
 /**
@@ -91,37 +94,65 @@ const Rectangle& SpriteAnimationDirection::get_frame(int frame) const {
  * \param dst_position coordinates on the destination surface
  * (the origin point will be drawn at this position)
  * \param current_frame the frame to show
- * \param src_image the image from which the frame is extracted
+ * \param src_image the surface from which the frame is extracted
+ * \param src_image_position position and size of the animation image on
+ * src_image: parts of the frame outside it are not drawn
  */
 void SpriteAnimationDirection::draw(Surface& dst_surface,
-    const Rectangle& dst_position, int current_frame, Surface& src_image) {
+    const Rectangle& dst_position, int current_frame, Surface& src_image,
+    const Rectangle& src_image_position) {
 
-  const Rectangle& current_frame_rect = get_frame(current_frame);
+  const Rectangle& frame = get_frame(current_frame);
+  const int frame_x = src_image_position.get_x() + frame.get_x();
+  const int frame_y = src_image_position.get_y() + frame.get_y();
+
+  // Clip the frame to the image: around it are other images of the sprite
+  // atlas.
+  const int x1 = std::max(frame_x, src_image_position.get_x());
+  const int y1 = std::max(frame_y, src_image_position.get_y());
+  const int x2 = std::min(frame_x + frame.get_width(),
+      src_image_position.get_x() + src_image_position.get_width());
+  const int y2 = std::min(frame_y + frame.get_height(),
+      src_image_position.get_y() + src_image_position.get_height());
+  if (x2 <= x1 || y2 <= y1) {
+    return;
+  }
+  Rectangle current_frame_rect(x1, y1, x2 - x1, y2 - y1);
 
   // Position of the sprite's upper left corner.
   Rectangle position_top_left(dst_position);
-  position_top_left.add_xy(-origin.get_x(), -origin.get_y());
+  position_top_left.add_xy(-origin.get_x() + x1 - frame_x,
+      -origin.get_y() + y1 - frame_y);
   position_top_left.set_size(current_frame_rect);
 
   src_image.draw_region(current_frame_rect, dst_surface, position_top_left);
 }
 
 /**
- * \brief Calculates the bit fields representing the non-transparent pixels
- * of the images in this direction.
+ * \brief Enables the pixel-perfect collisions for the frames of this
+ * direction.
  *
  * This method has to be called if you want a sprite having this animations
  * to be able to detect pixel-perfect collisions.
+ * The bit fields representing the non-transparent pixels of a frame are
+ * only calculated the first time this frame is tested,
+ * which avoids a pause when a big sprite appears.
  * If the pixel-perfect collisions are already enabled, this function does nothing.
  *
  * \param src_image the surface containing the animations
+ * \param src_image_position position of the animation image on src_image
+ * \param shared true to share the bit fields with other directions that
+ * have frames at the same place of src_image; src_image must then exist
+ * until pixel collisions are disabled
  */
-void SpriteAnimationDirection::enable_pixel_collisions(Surface* src_image) {
+void SpriteAnimationDirection::enable_pixel_collisions(Surface* src_image,
+    const Rectangle& src_image_position, bool shared) {
 
   if (!are_pixel_collisions_enabled()) {
-    for (int i = 0; i < get_nb_frames(); i++) {
-      pixel_bits.push_back(new PixelBits(*src_image, frames[i]));
-    }
+    pixel_bits_image = src_image;
+    pixel_bits_image_position = src_image_position;
+    pixel_bits_shared = shared;
+    pixel_bits.assign(get_nb_frames(), NULL);
   }
 }
 
@@ -130,11 +161,11 @@ void SpriteAnimationDirection::enable_pixel_collisions(Surface* src_image) {
  */
 void SpriteAnimationDirection::disable_pixel_collisions() {
 
-  std::vector<PixelBits*>::iterator it;
-  for (it = pixel_bits.begin(); it != pixel_bits.end(); ++it) {
-    delete *it;
+  for (int i = 0; i < int(pixel_bits.size()); i++) {
+    release_pixel_bits(i);
   }
   pixel_bits.clear();
+  pixel_bits_image = NULL;
 }
 
 /**
@@ -160,6 +191,100 @@ PixelBits& SpriteAnimationDirection::get_pixel_bits(int frame) const {
       "Pixel-precise collisions are not enabled for this sprite");
   SOLARUS_ASSERT(frame >= 0 && frame < get_nb_frames(), "Invalid frame number");
 
-  return *pixel_bits[frame];
+  PixelBits*& frame_pixel_bits = pixel_bits[frame];
+  if (frame_pixel_bits == NULL) {
+    // First collision test of this frame: analyze its pixels now.
+    PixelBitsKey key;
+    key.surface = pixel_bits_image;
+    key.position = get_frame_in_image(frame);
+
+    if (!pixel_bits_shared) {
+      frame_pixel_bits = new PixelBits(*pixel_bits_image, key.position,
+          pixel_bits_image_position);
+    }
+    else {
+      std::map<PixelBitsKey, SharedPixelBits>::iterator it = all_shared_pixel_bits.find(key);
+      if (it == all_shared_pixel_bits.end()) {
+        SharedPixelBits shared_pixel_bits;
+        shared_pixel_bits.pixel_bits = new PixelBits(*pixel_bits_image, key.position,
+            pixel_bits_image_position);
+        shared_pixel_bits.refcount = 0;
+        it = all_shared_pixel_bits.insert(std::make_pair(key, shared_pixel_bits)).first;
+      }
+      ++it->second.refcount;
+      frame_pixel_bits = it->second.pixel_bits;
+    }
+  }
+
+  return *frame_pixel_bits;
+}
+
+/**
+ * \brief Returns the position of a frame on the surface where pixel
+ * collisions are computed.
+ * \param frame A frame of the animation.
+ * \return The position of this frame on pixel_bits_image.
+ */
+Rectangle SpriteAnimationDirection::get_frame_in_image(int frame) const {
+
+  Rectangle frame_in_image = frames[frame];
+  frame_in_image.add_xy(pixel_bits_image_position.get_x(), pixel_bits_image_position.get_y());
+  return frame_in_image;
+}
+
+/**
+ * \brief Releases the bit fields of a frame if they were calculated.
+ *
+ * Shared bit fields are only deleted when no frame uses them anymore.
+ *
+ * \param frame A frame of the animation.
+ */
+void SpriteAnimationDirection::release_pixel_bits(int frame) {
+
+  PixelBits* frame_pixel_bits = pixel_bits[frame];
+  if (frame_pixel_bits == NULL) {
+    return;
+  }
+  pixel_bits[frame] = NULL;
+
+  if (!pixel_bits_shared) {
+    delete frame_pixel_bits;
+    return;
+  }
+
+  PixelBitsKey key;
+  key.surface = pixel_bits_image;
+  key.position = get_frame_in_image(frame);
+  std::map<PixelBitsKey, SharedPixelBits>::iterator it = all_shared_pixel_bits.find(key);
+  Debug::check_assertion(it != all_shared_pixel_bits.end(),
+      "Unknown shared pixel bits");
+
+  --it->second.refcount;
+  if (it->second.refcount == 0) {
+    delete it->second.pixel_bits;
+    all_shared_pixel_bits.erase(it);
+  }
+}
+
+/**
+ * \brief Compares two frame positions.
+ * \param other Another frame position.
+ * \return true if this one should be ordered before the other one.
+ */
+bool SpriteAnimationDirection::PixelBitsKey::operator<(const PixelBitsKey& other) const {
+
+  if (surface != other.surface) {
+    return surface < other.surface;
+  }
+  if (position.get_x() != other.position.get_x()) {
+    return position.get_x() < other.position.get_x();
+  }
+  if (position.get_y() != other.position.get_y()) {
+    return position.get_y() < other.position.get_y();
+  }
+  if (position.get_width() != other.position.get_width()) {
+    return position.get_width() < other.position.get_width();
+  }
+  return position.get_height() < other.position.get_height();
 }
 
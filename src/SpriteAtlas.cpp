@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SpriteAtlas.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Color.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <algorithm>
+
+std::vector<SpriteAtlas::Page> SpriteAtlas::pages;
+std::map<std::string, SpriteAtlas::Image> SpriteAtlas::images;
+
+/**
+ * \brief Frees all pages.
+ *
+ * This function is called when the sprites system is uninitialized.
+ */
+void SpriteAtlas::quit() {
+
+  std::vector<Page>::iterator it;
+  for (it = pages.begin(); it != pages.end(); ++it) {
+    delete it->surface;
+  }
+  pages.clear();
+  images.clear();
+}
+
+/**
+ * \brief Returns the surface containing a sprite image.
+ *
+ * The image file is loaded and packed if it is not used yet.
+ * Each call must be followed later by a call to release_image().
+ *
+ * \param file_name Name of the image file, relative to the sprites directory.
+ * \param position Where to write the position of the image on the surface
+ * returned.
+ * \return The page containing the image.
+ */
+Surface& SpriteAtlas::get_image(const std::string& file_name, Rectangle& position) {
+
+  std::map<std::string, Image>::iterator it = images.find(file_name);
+  if (it == images.end()) {
+    Surface image(file_name, Surface::DIR_SPRITES);
+    Image& new_image = images[file_name];
+    new_image.page = add_image(image, new_image.position);
+    new_image.refcount = 0;
+    it = images.find(file_name);
+  }
+
+  Image& image = it->second;
+  ++image.refcount;
+  position = image.position;
+  return *pages[image.page].surface;
+}
+
+/**
+ * \brief Indicates that a sprite image is not used anymore by a caller of
+ * get_image().
+ * \param file_name Name of the image file, relative to the sprites directory.
+ */
+void SpriteAtlas::release_image(const std::string& file_name) {
+
+  std::map<std::string, Image>::iterator it = images.find(file_name);
+  Debug::check_assertion(it != images.end() && it->second.refcount > 0,
+      StringConcat() << "Sprite image '" << file_name << "' is not used");
+
+  Image& image = it->second;
+  --image.refcount;
+  if (image.refcount > 0) {
+    return;
+  }
+
+  Page& page = pages[image.page];
+  const Rectangle position = image.position;
+  images.erase(it);
+  --page.nb_images;
+  if (page.nb_images == 0) {
+    // The page is empty: free it and make it available again.
+    delete page.surface;
+    page.surface = NULL;
+    page.free_rectangles.clear();
+  }
+  else {
+    // Let the next images use this room.
+    add_free_rectangle(page, position);
+  }
+}
+
+/**
+ * \brief Copies an image to a page that has enough room.
+ *
+ * A new page is created if necessary.
+ *
+ * \param image The image to pack.
+ * \param position Where to write the position of the image in its page.
+ * \return Index of the page.
+ */
+int SpriteAtlas::add_image(Surface& image, Rectangle& position) {
+
+  const bool alpha = image.has_alpha_channel();
+  const bool colorkey = !alpha && image.has_transparency_color();
+  const Rectangle& size = image.get_size();
+
+  // Try the existing pages of the same kind first.
+  int page_index = -1;
+  for (unsigned int i = 0; i < pages.size() && page_index == -1; i++) {
+    Page& page = pages[i];
+    if (page.surface != NULL && can_hold(page, image)
+        && place_image(page, size, position)) {
+      page_index = i;
+    }
+  }
+
+  if (page_index == -1) {
+    // Create a new page, reusing a freed slot if any.
+    page_index = 0;
+    while (page_index < int(pages.size()) && pages[page_index].surface != NULL) {
+      ++page_index;
+    }
+    if (page_index == int(pages.size())) {
+      pages.push_back(Page());
+    }
+
+    Page& page = pages[page_index];
+    const int width = std::max(int(page_size), size.get_width());
+    const int height = std::max(int(page_size), size.get_height());
+    if (alpha) {
+      page.surface = Surface::create_with_alpha(width, height);
+    }
+    else {
+      page.surface = new Surface(width, height);
+      if (colorkey) {
+        page.transparency_color = image.get_transparency_color();
+        page.surface->set_transparency_color(page.transparency_color);
+        page.surface->fill_with_color(page.transparency_color);
+      }
+    }
+    page.alpha = alpha;
+    page.colorkey = colorkey;
+    page.shelf_x = 0;
+    page.shelf_y = 0;
+    page.shelf_height = 0;
+    page.nb_images = 0;
+    page.free_rectangles.clear();
+
+    place_image(page, size, position);
+  }
+
+  image.copy_pixels(*pages[page_index].surface, position);
+  ++pages[page_index].nb_images;
+  return page_index;
+}
+
+/**
+ * \brief Returns whether a page can hold an image without changing the
+ * meaning of its pixels.
+ * \param page The page.
+ * \param image The image to pack.
+ * \return true if the page has the same kind of transparency as the image.
+ */
+bool SpriteAtlas::can_hold(const Page& page, Surface& image) {
+
+  const bool alpha = image.has_alpha_channel();
+  const bool colorkey = !alpha && image.has_transparency_color();
+  if (page.alpha != alpha || page.colorkey != colorkey) {
+    return false;
+  }
+
+  if (colorkey) {
+    int r, g, b, page_r, page_g, page_b;
+    image.get_transparency_color().get_components(r, g, b);
+    page.transparency_color.get_components(page_r, page_g, page_b);
+    return r == page_r && g == page_g && b == page_b;
+  }
+  return true;
+}
+
+/**
+ * \brief Finds room for an image in a page.
+ *
+ * The image is put in the room of a released image if possible.
+ * Otherwise, it is put at the end of the current shelf, or on a new shelf
+ * below it if it does not fit.
+ *
+ * \param page The page.
+ * \param size Size of the image.
+ * \param position Where to write the position of the image if it fits.
+ * \return true if the image fits in this page.
+ */
+bool SpriteAtlas::place_image(Page& page, const Rectangle& size, Rectangle& position) {
+
+  if (place_image_in_free_room(page, size, position)) {
+    return true;
+  }
+
+  const int page_width = page.surface->get_width();
+  const int page_height = page.surface->get_height();
+
+  if (page.shelf_x + size.get_width() > page_width
+      || page.shelf_y + size.get_height() > page_height) {
+    // Start a new shelf.
+    const int shelf_y = page.shelf_y + page.shelf_height;
+    if (size.get_width() > page_width
+        || shelf_y + size.get_height() > page_height) {
+      return false;
+    }
+    page.shelf_x = 0;
+    page.shelf_y = shelf_y;
+    page.shelf_height = 0;
+  }
+
+  position.set_xy(page.shelf_x, page.shelf_y);
+  position.set_size(size);
+  page.shelf_x += size.get_width();
+  page.shelf_height = std::max(page.shelf_height, size.get_height());
+  return true;
+}
+
+/**
+ * \brief Finds room for an image among the free rectangles of a page.
+ *
+ * The smallest free rectangle where the image fits is chosen.
+ * The image goes to its top-left corner and the rest of the rectangle is
+ * split into two free rectangles: one on the right of the image and one
+ * below it.
+ *
+ * \param page The page.
+ * \param size Size of the image.
+ * \param position Where to write the position of the image if it fits.
+ * \return true if the image fits in a free rectangle.
+ */
+bool SpriteAtlas::place_image_in_free_room(Page& page, const Rectangle& size,
+    Rectangle& position) {
+
+  std::vector<Rectangle>& free_rectangles = page.free_rectangles;
+  int best_index = -1;
+  int best_area = 0;
+  for (unsigned int i = 0; i < free_rectangles.size(); i++) {
+    const Rectangle& rectangle = free_rectangles[i];
+    const int area = rectangle.get_width() * rectangle.get_height();
+    if (rectangle.get_width() >= size.get_width()
+        && rectangle.get_height() >= size.get_height()
+        && (best_index == -1 || area < best_area)) {
+      best_index = i;
+      best_area = area;
+    }
+  }
+
+  if (best_index == -1) {
+    return false;
+  }
+
+  const Rectangle free_rectangle = free_rectangles[best_index];
+  free_rectangles[best_index] = free_rectangles.back();
+  free_rectangles.pop_back();
+
+  position.set_xy(free_rectangle.get_x(), free_rectangle.get_y());
+  position.set_size(size);
+
+  const int right_width = free_rectangle.get_width() - size.get_width();
+  const int bottom_height = free_rectangle.get_height() - size.get_height();
+  if (right_width > 0) {
+    free_rectangles.push_back(Rectangle(
+        free_rectangle.get_x() + size.get_width(), free_rectangle.get_y(),
+        right_width, size.get_height()));
+  }
+  if (bottom_height > 0) {
+    free_rectangles.push_back(Rectangle(
+        free_rectangle.get_x(), free_rectangle.get_y() + size.get_height(),
+        free_rectangle.get_width(), bottom_height));
+  }
+  return true;
+}
+
+/**
+ * \brief Makes some room of a page available again.
+ *
+ * The rectangle is merged with the free rectangles that share a whole side
+ * with it, so that released neighbors can hold bigger images.
+ *
+ * \param page The page.
+ * \param rectangle The room to make available.
+ */
+void SpriteAtlas::add_free_rectangle(Page& page, const Rectangle& rectangle) {
+
+  std::vector<Rectangle>& free_rectangles = page.free_rectangles;
+  Rectangle merged = rectangle;
+  bool merging = true;
+  while (merging) {
+    merging = false;
+    for (unsigned int i = 0; i < free_rectangles.size() && !merging; i++) {
+      const Rectangle& other = free_rectangles[i];
+      if (other.get_y() == merged.get_y() && other.get_height() == merged.get_height()
+          && (other.get_x() + other.get_width() == merged.get_x()
+              || merged.get_x() + merged.get_width() == other.get_x())) {
+        // Same row: merge horizontally.
+        merged = Rectangle(std::min(other.get_x(), merged.get_x()), merged.get_y(),
+            other.get_width() + merged.get_width(), merged.get_height());
+        merging = true;
+      }
+      else if (other.get_x() == merged.get_x() && other.get_width() == merged.get_width()
+          && (other.get_y() + other.get_height() == merged.get_y()
+              || merged.get_y() + merged.get_height() == other.get_y())) {
+        // Same column: merge vertically.
+        merged = Rectangle(merged.get_x(), std::min(other.get_y(), merged.get_y()),
+            merged.get_width(), other.get_height() + merged.get_height());
+        merging = true;
+      }
+
+      if (merging) {
+        free_rectangles[i] = free_rectangles.back();
+        free_rectangles.pop_back();
+      }
+    }
+  }
+  free_rectangles.push_back(merged);
+}
+
@@ -20,11 +20,60 @@
 #include "lowlevel/Sound.h"
 #include "lowlevel/System.h"
 
+/**
+ * \brief Creates a running clock.
+ */
+Timer::Clock::Clock():
+  paused(false),
+  when_paused(0),
+  paused_duration(0) {
+
+}
+
+/**
+ * \brief Returns the current date of this clock.
+ * \return The system date minus the time spent paused.
+ */
+uint32_t Timer::Clock::now() const {
+
+  if (paused) {
+    return when_paused - paused_duration;
+  }
+  return System::now() - paused_duration;
+}
+
+/**
+ * \brief Returns whether this clock is paused.
+ * \return true if the time of this clock is currently stopped.
+ */
+bool Timer::Clock::is_paused() const {
+  return paused;
+}
+
+/**
+ * \brief Pauses or resumes this clock.
+ * \param paused true to stop the time of this clock, false to resume it.
+ */
+void Timer::Clock::set_paused(bool paused) {
+
+  if (paused != this->paused) {
+    this->paused = paused;
+
+    if (paused) {
+      when_paused = System::now();
+    }
+    else {
+      paused_duration += System::now() - when_paused;
+    }
+  }
+}
+
 /**
  * \brief Creates and starts a timer.
  * \param delay duration of the timer in milliseconds
  */
 Timer::Timer(uint32_t delay):
+  clock(NULL),
   expiration_date(System::now() + delay),
   finished(false),
   suspended_with_map(false),
@@ -41,6 +90,18 @@ Timer::~Timer() {
 
 }
 
+/**
+ * \brief Returns the current date of the clock of this timer.
+ * \return The current date.
+ */
+uint32_t Timer::now() {
+
+  if (clock != NULL) {
+    return clock->now();
+  }
+  return System::now();
+}
+
 /**
  * \brief Returns whether a clock sound is played during this timer.
  * \return true if a clock sound is played.
@@ -54,7 +115,7 @@ bool Timer::is_with_sound() {
  * \param with_sound true to play a clock sound during this timer.
  */
 void Timer::set_with_sound(bool with_sound) {
-  next_sound_date = with_sound ? System::now() : 0;
+  next_sound_date = with_sound ? now() : 0;
 }
 
 /**
@@ -62,7 +123,7 @@ void Timer::set_with_sound(bool with_sound) {
  * \return true if this timer is suspended.
  */
 bool Timer::is_suspended() {
-  return suspended;
+  return suspended || (clock != NULL && clock->is_paused());
 }
 
 /**
@@ -70,15 +131,21 @@ bool Timer::is_suspended() {
  *
  * It is okay to call this function when is_suspended_with_map() is true:
  * this means that you temporarily override the automatic suspending behavior.
+ * In particular, resuming a timer whose clock is paused detaches it from
+ * that clock.
  *
  * \param suspended true to suspend the timer, false to resume it.
  */
 void Timer::set_suspended(bool suspended) {
 
+  if (!suspended && clock != NULL && clock->is_paused()) {
+    set_clock(NULL);
+  }
+
   if (suspended != this->suspended) {
     this->suspended = suspended;
 
-    uint32_t now = System::now();
+    uint32_t now = this->now();
 
     if (suspended) {
       // the timer is being suspended
@@ -127,17 +194,66 @@ bool Timer::is_finished() {
   return finished;
 }
 
+/**
+ * \brief Returns the clock this timer depends on.
+ * \return The clock of this timer, or NULL if it uses the system clock.
+ */
+const Timer::Clock* Timer::get_clock() {
+  return clock;
+}
+
+/**
+ * \brief Attaches this timer to a clock.
+ *
+ * The remaining time of the timer is preserved: its dates are converted to
+ * the time of the new clock.
+ *
+ * \param clock The new clock, or NULL to use the system clock.
+ */
+void Timer::set_clock(const Clock* clock) {
+
+  if (clock != this->clock) {
+    uint32_t old_now = now();
+    this->clock = clock;
+    uint32_t shift = now() - old_now;
+
+    expiration_date += shift;
+    if (is_with_sound()) {
+      next_sound_date += shift;
+    }
+    if (suspended && when_suspended != 0) {
+      when_suspended += shift;
+    }
+  }
+}
+
+/**
+ * \brief Returns the next date when this timer needs to be updated.
+ *
+ * Before that date, calling update() has no effect.
+ * The date is expressed in the time of the clock of this timer.
+ *
+ * \return The expiration date or the date of the next clock sound.
+ */
+uint32_t Timer::get_next_update_date() {
+
+  if (is_with_sound() && next_sound_date < expiration_date) {
+    return next_sound_date;
+  }
+  return expiration_date;
+}
+
 /**
  * \brief Updates the timer.
  */
 void Timer::update() {
 
-  if (suspended || is_finished()) {
+  if (is_suspended() || is_finished()) {
     return;
   }
 
   // check the time
-  uint32_t now = System::now();
+  uint32_t now = this->now();
   finished = (now >= expiration_date);
 
   // play the sound
@@ -162,6 +278,11 @@ void Timer::update() {
 
 /**
  * \brief Notifies this timer that the current map is being suspended or resumed.
+ *
+ * Timers attached to the map clock are already suspended with it. This
+ * function is useful to apply the new state of the map to a single timer,
+ * and to resume timers suspended by a script when the map is resumed.
+ *
  * \param suspended true if the map is suspended, false if it is resumed.
  */
 void Timer::notify_map_suspended(bool suspended) {
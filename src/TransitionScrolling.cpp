@@ -17,7 +17,6 @@
 #include "TransitionScrolling.h"
 #include "Game.h"
 #include "Map.h"
-#include "lowlevel/Color.h"
 #include "lowlevel/System.h"
 #include "lowlevel/Surface.h"
 #include "lowlevel/VideoManager.h"
@@ -38,15 +37,11 @@ TransitionScrolling::TransitionScrolling(Transition::Direction direction):
  * \brief Destructor.
  */
 TransitionScrolling::~TransitionScrolling() {
-
-  if (get_direction() == IN) {
-    delete both_maps_surface;
-  }
 }
 
 /**
- * \brief Returns where the previous map should be blitted on
- * both_maps_surface, for the specified scrolling direction.
+ * \brief Returns where the previous map is placed in the area containing
+ * both maps, for the specified scrolling direction.
  * \param scrolling_direction The scrolling direction (0 to 3).
  */
 Rectangle TransitionScrolling::get_previous_map_dst_position(
@@ -79,23 +74,15 @@ void TransitionScrolling::start() {
   scrolling_direction = (get_game()->get_current_map().get_destination_side() + 2) % 4;
 
   const int scrolling_step = 5;
-  const Rectangle& quest_size = VideoManager::get_instance()->get_quest_size();
-  int width = quest_size.get_width();
-  int height = quest_size.get_height();
   if (scrolling_direction % 2 == 0) {
     // right or left
-    width *= 2;
     dx = (scrolling_direction == 0) ? scrolling_step : -scrolling_step;
   }
   else {
-    height *= 2;
     dy = (scrolling_direction == 3) ? scrolling_step : -scrolling_step;
   }
 
-  // create a surface with the two maps
-  both_maps_surface = new Surface(width, height);
-
-  // set the blitting rectangles
+  // set the positions of both maps
 
   previous_map_dst_position = get_previous_map_dst_position(scrolling_direction);
   current_map_dst_position = get_previous_map_dst_position((scrolling_direction + 2) % 4);
@@ -186,14 +173,18 @@ void TransitionScrolling::draw(Surface& dst_surface) {
   Debug::check_assertion(previous_surface != NULL,
       "No previous surface defined for scrolling");
 
-  // draw the old map
-  previous_surface->draw(*both_maps_surface, previous_map_dst_position);
-
-  // draw the new map
-  dst_surface.draw(*both_maps_surface, current_map_dst_position);
-
-  // blit both surfaces
-  dst_surface.fill_with_color(Color::get_black());
-  both_maps_surface->draw_region(current_scrolling_position, dst_surface);
+  // Both maps together cover the visible area: no intermediate surface
+  // is needed. First move the new map already drawn on the destination
+  // to its place.
+  Rectangle current_map_position(current_map_dst_position);
+  current_map_position.add_xy(-current_scrolling_position.get_x(),
+      -current_scrolling_position.get_y());
+  dst_surface.shift_pixels(current_map_position.get_x(), current_map_position.get_y());
+
+  // Then draw the visible part of the old map in the area left.
+  Rectangle previous_map_position(previous_map_dst_position);
+  previous_map_position.add_xy(-current_scrolling_position.get_x(),
+      -current_scrolling_position.get_y());
+  previous_surface->draw(dst_surface, previous_map_position);
 }
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "entities/EntityGrid.h"
+#include "entities/MapEntity.h"
+#include <algorithm>
+
+/**
+ * \brief Creates an empty grid.
+ *
+ * The grid has a single cell until set_size() is called.
+ */
+EntityGrid::EntityGrid():
+  num_columns(1),
+  num_rows(1),
+  cells(1) {
+
+}
+
+/**
+ * \brief Sets the size of the region covered by the grid.
+ *
+ * Entities already in the grid are indexed again.
+ *
+ * \param width Width of the map in pixels.
+ * \param height Height of the map in pixels.
+ */
+void EntityGrid::set_size(int width, int height) {
+
+  num_columns = std::max(1, (width + cell_size - 1) / cell_size);
+  num_rows = std::max(1, (height + cell_size - 1) / cell_size);
+
+  cells.clear();
+  cells.resize(num_columns * num_rows);
+
+  std::map<MapEntity*, Rectangle>::iterator it;
+  for (it = cell_ranges.begin(); it != cell_ranges.end(); ++it) {
+    MapEntity* entity = it->first;
+    it->second = get_cell_range(get_indexed_box(*entity));
+    add_to_cells(entity, it->second);
+  }
+}
+
+/**
+ * \brief Removes all entities from the grid.
+ */
+void EntityGrid::clear() {
+
+  cells.assign(cells.size(), std::vector<CellEntry>());
+  cell_ranges.clear();
+}
+
+/**
+ * \brief Adds an entity to the grid.
+ *
+ * Nothing happens if the entity is already in the grid.
+ *
+ * \param entity The entity to add.
+ */
+void EntityGrid::add(MapEntity& entity) {
+
+  if (cell_ranges.find(&entity) != cell_ranges.end()) {
+    return;
+  }
+
+  const Rectangle& cell_range = get_cell_range(get_indexed_box(entity));
+  cell_ranges.insert(std::make_pair(&entity, cell_range));
+  add_to_cells(&entity, cell_range);
+}
+
+/**
+ * \brief Removes an entity from the grid.
+ *
+ * Nothing happens if the entity is not in the grid.
+ *
+ * \param entity The entity to remove.
+ */
+void EntityGrid::remove(MapEntity& entity) {
+
+  std::map<MapEntity*, Rectangle>::iterator it = cell_ranges.find(&entity);
+  if (it == cell_ranges.end()) {
+    return;
+  }
+
+  remove_from_cells(&entity, it->second);
+  cell_ranges.erase(it);
+}
+
+/**
+ * \brief Updates the cells of an entity after its bounding box or its
+ * origin has changed.
+ *
+ * Nothing happens if the entity is not in the grid.
+ *
+ * \param entity The entity that has changed.
+ */
+void EntityGrid::notify_bounding_box_changed(MapEntity& entity) {
+
+  std::map<MapEntity*, Rectangle>::iterator it = cell_ranges.find(&entity);
+  if (it == cell_ranges.end()) {
+    return;
+  }
+
+  const Rectangle& cell_range = get_cell_range(get_indexed_box(entity));
+  if (cell_range.equals(it->second)) {
+    // Still in the same cells: this is the usual case.
+    return;
+  }
+
+  remove_from_cells(&entity, it->second);
+  it->second = cell_range;
+  add_to_cells(&entity, cell_range);
+}
+
+/**
+ * \brief Returns the entities whose indexed box overlaps a rectangle.
+ *
+ * Only the cells covered by the rectangle are visited.
+ *
+ * An entity overlapping several cells of the rectangle is only returned
+ * from the first of these cells, so no duplicate needs to be removed.
+ *
+ * \param rectangle The region to search.
+ * \param entities The vector where to append the entities found, in the
+ * order of the cells and without duplicates.
+ */
+void EntityGrid::get_entities_in_rectangle(const Rectangle& rectangle,
+    std::vector<MapEntity*>& entities) const {
+
+  const Rectangle& cell_range = get_cell_range(rectangle);
+  const int first_column = cell_range.get_x();
+  const int first_row = cell_range.get_y();
+  for (int j = first_row; j < first_row + cell_range.get_height(); ++j) {
+    for (int i = first_column; i < first_column + cell_range.get_width(); ++i) {
+
+      const std::vector<CellEntry>& cell = cells[j * num_columns + i];
+      std::vector<CellEntry>::const_iterator it;
+      for (it = cell.begin(); it != cell.end(); ++it) {
+        if (i != std::max(it->first_column, first_column)
+            || j != std::max(it->first_row, first_row)) {
+          // Already visited in a previous cell.
+          continue;
+        }
+        MapEntity* entity = it->entity;
+        if (get_indexed_box(*entity).overlaps(rectangle)) {
+          entities.push_back(entity);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * \brief Returns the box indexed for an entity: its bounding box, extended
+ * to contain its origin point.
+ * \param entity An entity.
+ * \return The box to index.
+ */
+Rectangle EntityGrid::get_indexed_box(const MapEntity& entity) {
+
+  const Rectangle& bounding_box = entity.get_bounding_box();
+  int x1 = std::min(bounding_box.get_x(), entity.get_x());
+  int y1 = std::min(bounding_box.get_y(), entity.get_y());
+  int x2 = std::max(bounding_box.get_x() + bounding_box.get_width(), entity.get_x() + 1);
+  int y2 = std::max(bounding_box.get_y() + bounding_box.get_height(), entity.get_y() + 1);
+  return Rectangle(x1, y1, x2 - x1, y2 - y1);
+}
+
+/**
+ * \brief Returns the cells covered by a box.
+ *
+ * Parts of the box outside the grid are mapped to the border cells.
+ *
+ * \param box A rectangle in map coordinates.
+ * \return The range of cells (in cell coordinates) covered by this box.
+ * The range always contains at least one cell.
+ */
+Rectangle EntityGrid::get_cell_range(const Rectangle& box) const {
+
+  int x1 = box.get_x();
+  int y1 = box.get_y();
+  int x2 = x1 + std::max(1, box.get_width()) - 1;
+  int y2 = y1 + std::max(1, box.get_height()) - 1;
+
+  // Divide rounding down, even for negative coordinates.
+  int i1 = (x1 >= 0) ? x1 / cell_size : -1;
+  int j1 = (y1 >= 0) ? y1 / cell_size : -1;
+  int i2 = (x2 >= 0) ? x2 / cell_size : -1;
+  int j2 = (y2 >= 0) ? y2 / cell_size : -1;
+
+  i1 = std::min(std::max(i1, 0), num_columns - 1);
+  j1 = std::min(std::max(j1, 0), num_rows - 1);
+  i2 = std::min(std::max(i2, 0), num_columns - 1);
+  j2 = std::min(std::max(j2, 0), num_rows - 1);
+
+  return Rectangle(i1, j1, i2 - i1 + 1, j2 - j1 + 1);
+}
+
+/**
+ * \brief Adds an entity to some cells.
+ * \param entity The entity.
+ * \param cell_range The cells where to add it.
+ */
+void EntityGrid::add_to_cells(MapEntity* entity, const Rectangle& cell_range) {
+
+  CellEntry entry;
+  entry.entity = entity;
+  entry.first_column = cell_range.get_x();
+  entry.first_row = cell_range.get_y();
+  for (int j = cell_range.get_y(); j < cell_range.get_y() + cell_range.get_height(); ++j) {
+    for (int i = cell_range.get_x(); i < cell_range.get_x() + cell_range.get_width(); ++i) {
+      cells[j * num_columns + i].push_back(entry);
+    }
+  }
+}
+
+/**
+ * \brief Removes an entity from some cells.
+ * \param entity The entity.
+ * \param cell_range The cells where to remove it from.
+ */
+void EntityGrid::remove_from_cells(MapEntity* entity, const Rectangle& cell_range) {
+
+  for (int j = cell_range.get_y(); j < cell_range.get_y() + cell_range.get_height(); ++j) {
+    for (int i = cell_range.get_x(); i < cell_range.get_x() + cell_range.get_width(); ++i) {
+
+      // Replace the entity by the last one: the order in a cell then still
+      // only depends on the sequence of additions and removals.
+      std::vector<CellEntry>& cell = cells[j * num_columns + i];
+      std::vector<CellEntry>::iterator it;
+      for (it = cell.begin(); it != cell.end(); ++it) {
+        if (it->entity == entity) {
+          *it = cell.back();
+          cell.pop_back();
+          break;
+        }
+      }
+    }
+  }
+}
+
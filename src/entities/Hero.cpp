@@ -843,11 +843,10 @@ bool Hero::is_on_raised_blocks() {
  */
 Stairs* Hero::get_stairs_overlapping() {
 
-  std::list<Stairs*> all_stairs = get_entities().get_stairs(get_layer());
-  std::list<Stairs*>::iterator it;
-  for (it = all_stairs.begin(); it != all_stairs.end(); it++) {
+  const std::vector<Stairs*>& all_stairs = get_entities().get_stairs(get_layer());
+  for (unsigned int i = 0; i < all_stairs.size(); i++) {
 
-    Stairs *stairs = *it;
+    Stairs *stairs = all_stairs[i];
 
     if (overlaps(*stairs)) {
       return stairs;
@@ -18,6 +18,7 @@
 #include "entities/Hero.h"
 #include "entities/Tile.h"
 #include "entities/TilePattern.h"
+#include "entities/Tileset.h"
 #include "entities/Layer.h"
 #include "entities/CrystalBlock.h"
 #include "entities/Boomerang.h"
@@ -31,8 +32,56 @@
 #include "lowlevel/Music.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/System.h"
+#include "Sprite.h"
+#include <algorithm>
+#include <cstdlib>
 using std::list;
 
+namespace {
+
+  /**
+   * \brief Removes an entity from a registry, keeping the order of the
+   * other ones.
+   *
+   * This takes a time linear in the size of the registry.
+   *
+   * \param registry The registry to update.
+   * \param entity The entity to remove. Nothing happens if it is not in the
+   * registry.
+   */
+  template<typename T>
+  void remove_from_registry(std::vector<T*>& registry, MapEntity* entity) {
+
+    typename std::vector<T*>::iterator it =
+        std::find(registry.begin(), registry.end(), entity);
+    if (it != registry.end()) {
+      registry.erase(it);
+    }
+  }
+
+  /**
+   * \brief Removes from a registry all entities that are being removed,
+   * keeping the order of the other ones.
+   *
+   * This is a single linear pass whatever the number of entities removed.
+   *
+   * \param registry The registry to compact.
+   */
+  template<typename T>
+  void remove_entities_being_removed(std::vector<T*>& registry) {
+
+    size_t nb_kept = 0;
+    for (size_t i = 0; i < registry.size(); ++i) {
+      if (!registry[i]->is_being_removed()) {
+        registry[nb_kept] = registry[i];
+        ++nb_kept;
+      }
+    }
+    registry.resize(nb_kept);
+  }
+}
+
 /**
  * \brief Constructor.
  * \param game the game
@@ -41,19 +90,29 @@ using std::list;
 MapEntities::MapEntities(Game& game, Map& map):
   game(game),
   map(map),
+  rebuild_blocks_width(0),
+  rebuilding_non_animated_tiles(false),
+  rebuild_layer(0),
+  rebuild_tile_index(0),
   hero(game.get_hero()),
+  max_sprite_size(0),
+  max_sprite_displacement(0),
+  next_ground_modifier_rank(0),
   default_destination(NULL),
   boomerang(NULL),
-  music_before_miniboss(Music::none) {
+  music_before_miniboss(Music::none),
+  nb_updates(0) {
 
   Layer layer = hero.get_layer();
   this->obstacle_entities[layer].push_back(&hero);
-  this->entities_drawn_y_order[layer].push_back(&hero);
+  add_to_drawing_list(this->entities_drawn_y_order[layer], &hero);
   this->named_entities[hero.get_name()] = &hero;
+  this->entity_grid.add(hero);
 
   // surfaces to pre-render static tiles
   for (int layer = 0; layer < LAYER_NB; layer++) {
     non_animated_tiles_surfaces[layer] = NULL;
+    ground_modifiers_grid[layer] = NULL;
   }
 }
 
@@ -75,14 +134,21 @@ void MapEntities::destroy_all_entities() {
   // delete tiles and clear lists sorted by layer
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
-    for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      destroy_entity(tiles[layer][i]);
+    for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
+      destroy_entity(tiles_in_animated_regions[layer][i]);
     }
+    tiles_in_animated_regions[layer].clear();
 
     tiles[layer].clear();
     delete[] tiles_ground[layer];
+    delete[] ground_modifiers_grid[layer];
+    ground_modifiers_grid[layer] = NULL;
     delete[] animated_tiles[layer];
     delete non_animated_tiles_surfaces[layer];
+    for (unsigned int i = 0; i < rebuild_blocks[layer].size(); i++) {
+      delete rebuild_blocks[layer][i];
+    }
+    rebuild_blocks[layer].clear();
 
     entities_drawn_first[layer].clear();
     entities_drawn_y_order[layer].clear();
@@ -94,15 +160,19 @@ void MapEntities::destroy_all_entities() {
 
   // delete the other entities
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    destroy_entity(*i);
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    destroy_entity(all_entities[i]);
   }
   all_entities.clear();
   named_entities.clear();
+  ground_modifier_infos.clear();
+  entity_grid.clear();
+  animated_tiles_grid.clear();
+  tiles_drawn_anywhere.clear();
 
   detectors.clear();
   entities_to_remove.clear();
+  rebuilding_non_animated_tiles = false;
 }
 
 /**
@@ -117,6 +187,7 @@ void MapEntities::destroy_entity(MapEntity* entity) {
   if (!entity->is_being_removed()) {
     entity->notify_being_removed();
   }
+  entity->detach_sprites_from_map();
 
   entity->decrement_refcount();
   if (entity->get_refcount() == 0) {
@@ -149,15 +220,18 @@ Ground MapEntities::get_ground(Layer layer, int x, int y) {
   // First get the ground defined by static tiles (this is very fast).
   Ground ground = get_tile_ground(layer, x, y);
 
-  // Then, look for entities that may change the ground.
-  std::list<MapEntity*>::const_iterator it;
-  for (it = ground_modifiers[layer].begin(); it != ground_modifiers[layer].end(); it++) {
-    const MapEntity& ground_modifier = *(*it);
+  // Then, see if entities change the ground of this 8x8 square.
+  // Usually, there are none. The last one of the square wins.
+  const std::vector<GroundModifierEntry>& square_modifiers =
+      ground_modifiers_grid[layer][(y >> 3) * map_width8 + (x >> 3)];
+  std::vector<GroundModifierEntry>::const_reverse_iterator it;
+  for (it = square_modifiers.rbegin(); it != square_modifiers.rend(); ++it) {
+    const MapEntity& ground_modifier = *it->entity;
     if (ground_modifier.is_enabled()
         && !ground_modifier.is_being_removed()
         && ground_modifier.overlaps(x, y)
         && ground_modifier.get_modified_ground() != GROUND_EMPTY) {
-      ground = ground_modifier.get_modified_ground();
+      return ground_modifier.get_modified_ground();
     }
   }
 
@@ -183,7 +257,7 @@ Ground MapEntities::get_ground(Layer layer, const Rectangle& xy) {
  * \param layer The layer.
  * \return The obstacle entities on that layer.
  */
-const list<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
   return obstacle_entities[layer];
 }
 
@@ -192,7 +266,7 @@ const list<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
  * \param layer The layer.
  * \return The ground observers on that layer.
  */
-const list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
   return ground_observers[layer];
 }
 
@@ -200,7 +274,7 @@ const list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
  * \brief Returns all detectors on the map.
  * \return the detectors
  */
-const list<Detector*>& MapEntities::get_detectors() {
+const std::vector<Detector*>& MapEntities::get_detectors() {
   return detectors;
 }
 
@@ -218,7 +292,7 @@ Destination* MapEntities::get_default_destination() {
  * \param layer the layer
  * \return the stairs on this layer
  */
-const list<Stairs*>& MapEntities::get_stairs(Layer layer) {
+const std::vector<Stairs*>& MapEntities::get_stairs(Layer layer) {
   return stairs[layer];
 }
 
@@ -227,7 +301,7 @@ const list<Stairs*>& MapEntities::get_stairs(Layer layer) {
  * \param layer the layer
  * \return the crystal blocks on this layer
  */
-const list<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
+const std::vector<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
   return crystal_blocks[layer];
 }
 
@@ -235,7 +309,7 @@ const list<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
  * \brief Returns all separators of the map..
  * \return The separators.
  */
-const list<Separator*>& MapEntities::get_separators() {
+const std::vector<Separator*>& MapEntities::get_separators() {
   return separators;
 }
 
@@ -258,6 +332,138 @@ void MapEntities::set_tile_ground(Layer layer, int x8, int y8, Ground ground) {
   }
 }
 
+/**
+ * \brief Returns the 8x8 squares of the map overlapped by a rectangle.
+ * \param box A rectangle in map coordinates.
+ * \return The squares overlapped (in 8x8 square coordinates), limited to
+ * the map. The width or the height is zero if there is none.
+ */
+Rectangle MapEntities::get_ground_cells(const Rectangle& box) const {
+
+  if (box.get_width() <= 0 || box.get_height() <= 0) {
+    return Rectangle(0, 0, 0, 0);
+  }
+
+  int x8_1 = std::max(box.get_x() >> 3, 0);
+  int y8_1 = std::max(box.get_y() >> 3, 0);
+  int x8_2 = std::min((box.get_x() + box.get_width() - 1) >> 3, map_width8 - 1);
+  int y8_2 = std::min((box.get_y() + box.get_height() - 1) >> 3, map_height8 - 1);
+
+  return Rectangle(x8_1, y8_1,
+      std::max(x8_2 - x8_1 + 1, 0), std::max(y8_2 - y8_1 + 1, 0));
+}
+
+/**
+ * \brief Puts a ground modifier in ground_modifiers_grid.
+ *
+ * It gets the highest rank, like the last ground modifier of its layer.
+ *
+ * \param ground_modifier The ground modifier to add.
+ * \param layer Layer where to put it.
+ */
+void MapEntities::add_to_ground_modifiers_grid(MapEntity& ground_modifier,
+    Layer layer) {
+
+  GroundModifierInfo& info = ground_modifier_infos[&ground_modifier];
+  info.box = ground_modifier.get_bounding_box();
+  info.rank = next_ground_modifier_rank++;
+
+  GroundModifierEntry entry;
+  entry.entity = &ground_modifier;
+  entry.rank = info.rank;
+  add_to_ground_cells(layer, entry, get_ground_cells(info.box),
+      Rectangle(0, 0, 0, 0));
+}
+
+/**
+ * \brief Removes a ground modifier from ground_modifiers_grid.
+ *
+ * Nothing happens if it is not in the grid.
+ *
+ * \param ground_modifier The ground modifier to remove.
+ * \param layer Layer where it was put.
+ */
+void MapEntities::remove_from_ground_modifiers_grid(MapEntity& ground_modifier,
+    Layer layer) {
+
+  std::map<MapEntity*, GroundModifierInfo>::iterator it =
+      ground_modifier_infos.find(&ground_modifier);
+  if (it == ground_modifier_infos.end()) {
+    return;
+  }
+
+  remove_from_ground_cells(layer, &ground_modifier,
+      get_ground_cells(it->second.box), Rectangle(0, 0, 0, 0));
+  ground_modifier_infos.erase(it);
+}
+
+/**
+ * \brief Inserts a ground modifier in some squares of ground_modifiers_grid.
+ *
+ * The modifiers of each square stay sorted by rank. Usually, the new one
+ * is the last one.
+ *
+ * \param layer The layer of the grid.
+ * \param entry The ground modifier to insert.
+ * \param cells The squares where to insert it (in 8x8 square coordinates).
+ * \param excluded_cells Squares of cells where it is already present.
+ */
+void MapEntities::add_to_ground_cells(Layer layer,
+    const GroundModifierEntry& entry,
+    const Rectangle& cells, const Rectangle& excluded_cells) {
+
+  std::vector<GroundModifierEntry>* grid = ground_modifiers_grid[layer];
+  for (int y8 = cells.get_y(); y8 < cells.get_y() + cells.get_height(); y8++) {
+    for (int x8 = cells.get_x(); x8 < cells.get_x() + cells.get_width(); x8++) {
+
+      if (excluded_cells.contains(x8, y8)) {
+        continue;
+      }
+
+      std::vector<GroundModifierEntry>& square_modifiers =
+          grid[y8 * map_width8 + x8];
+      std::vector<GroundModifierEntry>::iterator it = square_modifiers.end();
+      while (it != square_modifiers.begin() && (it - 1)->rank > entry.rank) {
+        --it;
+      }
+      square_modifiers.insert(it, entry);
+    }
+  }
+}
+
+/**
+ * \brief Removes a ground modifier from some squares of
+ * ground_modifiers_grid.
+ * \param layer The layer of the grid.
+ * \param ground_modifier The ground modifier to remove.
+ * \param cells The squares where to remove it (in 8x8 square coordinates).
+ * \param excluded_cells Squares of cells where it should stay.
+ */
+void MapEntities::remove_from_ground_cells(Layer layer,
+    MapEntity* ground_modifier,
+    const Rectangle& cells, const Rectangle& excluded_cells) {
+
+  std::vector<GroundModifierEntry>* grid = ground_modifiers_grid[layer];
+  for (int y8 = cells.get_y(); y8 < cells.get_y() + cells.get_height(); y8++) {
+    for (int x8 = cells.get_x(); x8 < cells.get_x() + cells.get_width(); x8++) {
+
+      if (excluded_cells.contains(x8, y8)) {
+        continue;
+      }
+
+      std::vector<GroundModifierEntry>& square_modifiers =
+          grid[y8 * map_width8 + x8];
+      std::vector<GroundModifierEntry>::iterator it;
+      for (it = square_modifiers.begin(); it != square_modifiers.end(); ++it) {
+        if (it->entity == ground_modifier) {
+          square_modifiers.erase(it);
+          break;
+        }
+      }
+    }
+  }
+}
+
 /**
  * \brief Returns the entity with the specified name.
  *
@@ -299,24 +505,67 @@ MapEntity* MapEntities::find_entity(const std::string& name) {
 }
 
 /**
- * \brief Returns the entities of the map having the specified name prefix.
- * \param prefix Prefix of the name.
- * \return The entities of this type and having this prefix in their name.
+ * \brief Returns whether an entity can be found by name prefix queries.
+ *
+ * The hero and static tiles are not returned by such queries,
+ * as well as entities being removed.
+ *
+ * \param entity An entity of the map.
+ * \return true if this entity can be returned by prefix queries.
  */
-list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix) {
+bool MapEntities::is_found_by_prefix(MapEntity* entity) {
 
-  list<MapEntity*> entities;
+  EntityType type = entity->get_type();
+  return type != HERO && type != TILE && !entity->is_being_removed();
+}
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
+/**
+ * \brief Returns the entities of the map having the specified name prefix.
+ *
+ * Entities without name only match the empty prefix.
+ * Non-empty prefixes are searched in the sorted map of named entities:
+ * only entities with this prefix are visited.
+ *
+ * \param prefix Prefix of the name.
+ * \param entities The vector where to append the entities found.
+ */
+void MapEntities::get_entities_with_prefix(const std::string& prefix,
+    std::vector<MapEntity*>& entities) {
+
+  if (prefix.empty()) {
+    // All entities match, including the ones without name.
+    entities.reserve(entities.size() + all_entities.size());
+    std::vector<MapEntity*>::iterator it;
+    for (it = all_entities.begin(); it != all_entities.end(); ++it) {
+      MapEntity* entity = *it;
+      if (!entity->is_being_removed()) {
+        entities.push_back(entity);
+      }
+    }
+    return;
+  }
 
-    MapEntity* entity = *i;
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
+  std::map<std::string, MapEntity*>::iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    MapEntity* entity = it->second;
+    if (is_found_by_prefix(entity)) {
       entities.push_back(entity);
     }
   }
+}
+
+/**
+ * \brief Returns the entities of the map having the specified name prefix.
+ * \param prefix Prefix of the name.
+ * \return The entities having this prefix in their name.
+ */
+list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix) {
 
-  return entities;
+  std::vector<MapEntity*> found;
+  get_entities_with_prefix(prefix, found);
+  return list<MapEntity*>(found.begin(), found.end());
 }
 
 /**
@@ -329,18 +578,79 @@ list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix
 list<MapEntity*> MapEntities::get_entities_with_prefix(
     EntityType type, const std::string& prefix) {
 
-  list<MapEntity*> entities;
+  std::vector<MapEntity*> found;
+  get_entities_by_type(type, found, prefix);
+  return list<MapEntity*>(found.begin(), found.end());
+}
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
+/**
+ * \brief Returns the entities of the map with the specified type,
+ * optionally filtered by name prefix and by layer.
+ *
+ * If the prefix is not empty, only entities having this prefix are visited.
+ *
+ * \param type Type of entity.
+ * \param entities The vector where to append the entities found.
+ * \param prefix Prefix of the name (an empty string matches all entities).
+ * \param layer Layer of the entities, or LAYER_NB to accept all layers.
+ */
+void MapEntities::get_entities_by_type(EntityType type,
+    std::vector<MapEntity*>& entities, const std::string& prefix, Layer layer) {
+
+  if (prefix.empty()) {
+    std::vector<MapEntity*>::iterator it;
+    for (it = all_entities.begin(); it != all_entities.end(); ++it) {
+      MapEntity* entity = *it;
+      if (entity->get_type() == type
+          && (layer == LAYER_NB || entity->get_layer() == layer)
+          && !entity->is_being_removed()) {
+        entities.push_back(entity);
+      }
+    }
+    return;
+  }
 
-    MapEntity* entity = *i;
-    if (entity->get_type() == type && entity->has_prefix(prefix) && !entity->is_being_removed()) {
+  std::map<std::string, MapEntity*>::iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    MapEntity* entity = it->second;
+    if (entity->get_type() == type
+        && (layer == LAYER_NB || entity->get_layer() == layer)
+        && is_found_by_prefix(entity)) {
       entities.push_back(entity);
     }
   }
+}
+
+/**
+ * \brief Returns the number of entities with the specified name prefix on
+ * the map.
+ * \param prefix Prefix of the name.
+ * \return The number of entities having this prefix in their name.
+ */
+int MapEntities::get_entities_count_with_prefix(const std::string& prefix) {
+
+  int count = 0;
+  if (prefix.empty()) {
+    std::vector<MapEntity*>::iterator it;
+    for (it = all_entities.begin(); it != all_entities.end(); ++it) {
+      if (!(*it)->is_being_removed()) {
+        ++count;
+      }
+    }
+    return count;
+  }
 
-  return entities;
+  std::map<std::string, MapEntity*>::iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    if (is_found_by_prefix(it->second)) {
+      ++count;
+    }
+  }
+  return count;
 }
 
 /**
@@ -351,18 +661,95 @@ list<MapEntity*> MapEntities::get_entities_with_prefix(
  */
 bool MapEntities::has_entity_with_prefix(const std::string& prefix) {
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
+  if (prefix.empty()) {
+    std::vector<MapEntity*>::iterator it;
+    for (it = all_entities.begin(); it != all_entities.end(); ++it) {
+      if (!(*it)->is_being_removed()) {
+        return true;
+      }
+    }
+    return false;
+  }
 
-    MapEntity* entity = *i;
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
+  std::map<std::string, MapEntity*>::iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    if (is_found_by_prefix(it->second)) {
       return true;
     }
   }
-
   return false;
 }
 
+/**
+ * \brief Returns the entities of the map that overlap a rectangle.
+ *
+ * Only the region of the rectangle is searched, thanks to a spatial index.
+ * Static tiles are not returned. The hero is returned if it overlaps the
+ * rectangle.
+ *
+ * \param rectangle The region to search.
+ * \param entities The vector where to append the entities found.
+ * \param layer Layer of the entities, or LAYER_NB to accept all layers.
+ */
+void MapEntities::get_entities_in_rectangle(const Rectangle& rectangle,
+    std::vector<MapEntity*>& entities, Layer layer) {
+
+  const size_t first_found = entities.size();
+  entity_grid.get_entities_in_rectangle(rectangle, entities);
+
+  // Remove the entities that don't pass the filters, keeping the order of
+  // the others.
+  std::vector<MapEntity*>::iterator end = entities.begin() + first_found;
+  std::vector<MapEntity*>::iterator it;
+  for (it = end; it != entities.end(); ++it) {
+    MapEntity* entity = *it;
+    if (!entity->is_being_removed()
+        && (layer == LAYER_NB || entity->get_layer() == layer)) {
+      *end = entity;
+      ++end;
+    }
+  }
+  entities.erase(end, entities.end());
+}
+
+/**
+ * \brief Returns the entities of the map whose origin point is in a circle.
+ *
+ * Only the region of the circle is searched, thanks to a spatial index.
+ * Static tiles are not returned. The hero is returned if it is in the
+ * circle.
+ *
+ * \param x X coordinate of the center of the circle.
+ * \param y Y coordinate of the center of the circle.
+ * \param radius Radius of the circle.
+ * \param entities The vector where to append the entities found.
+ * \param layer Layer of the entities, or LAYER_NB to accept all layers.
+ */
+void MapEntities::get_entities_in_radius(int x, int y, int radius,
+    std::vector<MapEntity*>& entities, Layer layer) {
+
+  const size_t first_found = entities.size();
+  const Rectangle square(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
+  get_entities_in_rectangle(square, entities, layer);
+
+  // Squared distances don't fit in an int for big radii.
+  const int64_t squared_radius = int64_t(radius) * radius;
+  std::vector<MapEntity*>::iterator end = entities.begin() + first_found;
+  std::vector<MapEntity*>::iterator it;
+  for (it = end; it != entities.end(); ++it) {
+    MapEntity* entity = *it;
+    int64_t dx = int64_t(entity->get_x()) - x;
+    int64_t dy = int64_t(entity->get_y()) - y;
+    if (dx * dx + dy * dy <= squared_radius) {
+      *end = entity;
+      ++end;
+    }
+  }
+  entities.erase(end, entities.end());
+}
+
 /**
  * \brief Brings to front an entity that is displayed as a sprite in the normal order.
  * \param entity the entity to bring to front
@@ -376,8 +763,8 @@ void MapEntities::bring_to_front(MapEntity* entity) {
     StringConcat() << "Cannot bring to front entity '" << entity->get_name() << "' since it is drawn in the y order");
 
   Layer layer = entity->get_layer();
-  entities_drawn_first[layer].remove(entity);
-  entities_drawn_first[layer].push_back(entity);
+  remove_from_registry(entities_drawn_first[layer], entity);
+  add_to_drawing_list(entities_drawn_first[layer], entity);
 }
 
 /**
@@ -385,9 +772,9 @@ void MapEntities::bring_to_front(MapEntity* entity) {
  */
 void MapEntities::notify_map_started() {
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity *entity = *i;
+  // Entities may be created during the loop: don't use iterators.
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_map_started();
     entity->notify_tileset_changed();
   }
@@ -404,9 +791,8 @@ void MapEntities::notify_map_started() {
  */
 void MapEntities::notify_map_opening_transition_finished() {
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity* entity = *i;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_map_opening_transition_finished();
   }
   hero.notify_map_opening_transition_finished();
@@ -415,15 +801,16 @@ void MapEntities::notify_map_opening_transition_finished() {
 /**
  * \brief Notifies this entity manager that the tileset of the map has
  * changed.
+ * \param changed_tile_patterns Ids of the tile patterns that look different
+ * with the new tileset.
  */
-void MapEntities::notify_tileset_changed() {
+void MapEntities::notify_tileset_changed(const std::set<int>& changed_tile_patterns) {
 
-  // Redraw optimized tiles (i.e. non animated ones).
-  redraw_non_animated_tiles();
+  // Redraw optimized tiles (i.e. non animated ones) that have changed.
+  start_rebuilding_non_animated_tiles(changed_tile_patterns);
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity* entity = *i;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_tileset_changed();
   }
   hero.notify_map_opening_transition_finished();
@@ -435,23 +822,65 @@ void MapEntities::notify_tileset_changed() {
  * This function is called for each tile when loading the map.
  * The tiles cannot change during the game.
  *
- * \param tile the tile to add
+ * The tile is not created as an entity: it is only stored as a compact
+ * description, merged with the previous tile of its layer if they have
+ * the same static pattern and form a rectangle.
+ * Tile entities are only created by build_non_animated_tiles() for tiles
+ * that need to be drawn at each frame.
+ *
+ * \param layer Layer of the tile.
+ * \param x X coordinate of the top-left corner of the tile.
+ * \param y Y coordinate of the top-left corner of the tile.
+ * \param width Width of the tile (the pattern can be repeated).
+ * \param height Height of the tile (the pattern can be repeated).
+ * \param tile_pattern_id Id of the tile pattern.
  */
-void MapEntities::add_tile(Tile* tile) {
+void MapEntities::add_tile(Layer layer, int x, int y, int width, int height,
+    int tile_pattern_id) {
 
-  Layer layer = tile->get_layer();
+  TilePattern& tile_pattern = map.get_tileset().get_tile_pattern(tile_pattern_id);
 
   // Add the tile to the map.
-  tiles[layer].push_back(tile);
-  tile->set_map(map);
+  std::vector<TileInfo>& layer_tiles = tiles[layer];
+  bool merged = false;
+  if (!layer_tiles.empty()
+      && !tile_pattern.is_animated()
+      && tile_pattern.is_drawn_at_its_position()) {
+
+    // Try to extend the previous tile instead: it is drawn just before,
+    // so this changes nothing to the drawing order.
+    TileInfo& previous = layer_tiles.back();
+    if (previous.tile_pattern_id == tile_pattern_id) {
+
+      if (previous.y == y
+          && previous.height == height
+          && previous.x + previous.width == x
+          && previous.width % tile_pattern.get_width() == 0) {
+        previous.width += width;
+        merged = true;
+      }
+      else if (previous.x == x
+          && previous.width == width
+          && previous.y + previous.height == y
+          && previous.height % tile_pattern.get_height() == 0) {
+        previous.height += height;
+        merged = true;
+      }
+    }
+  }
+
+  if (!merged) {
+    TileInfo tile = { x, y, width, height, tile_pattern_id };
+    layer_tiles.push_back(tile);
+  }
 
   // Update the ground list.
-  Ground ground = tile->get_tile_pattern().get_ground();
+  Ground ground = tile_pattern.get_ground();
 
-  int tile_x8 = tile->get_x() / 8;
-  int tile_y8 = tile->get_y() / 8;
-  int tile_width8 = tile->get_width() / 8;
-  int tile_height8 = tile->get_height() / 8;
+  int tile_x8 = x / 8;
+  int tile_y8 = y / 8;
+  int tile_width8 = width / 8;
+  int tile_height8 = height / 8;
 
   int i, j;
   Ground non_obstacle_triangle;
@@ -600,8 +1029,15 @@ void MapEntities::add_entity(MapEntity* entity) {
   }
 
   if (entity->get_type() == TILE) {
-    // Tiles are optimized specifically for obstacle checks and rendering.
-    add_tile(static_cast<Tile*>(entity));
+    // Tiles are optimized specifically for obstacle checks and rendering:
+    // only a description of the tile is kept.
+    Tile* tile = static_cast<Tile*>(entity);
+    add_tile(tile->get_layer(), tile->get_top_left_x(), tile->get_top_left_y(),
+        tile->get_width(), tile->get_height(), tile->get_tile_pattern_id());
+    if (tile->get_refcount() == 0) {
+      delete tile;
+    }
+    return;
   }
   else {
     Layer layer = entity->get_layer();
@@ -634,14 +1070,21 @@ void MapEntities::add_entity(MapEntity* entity) {
     // update the ground modifiers list
     if (entity->is_ground_modifier()) {
       ground_modifiers[layer].push_back(entity);
+      add_to_ground_modifiers_grid(*entity, layer);
     }
 
     // update the sprites list
     if (entity->is_drawn_in_y_order()) {
-      entities_drawn_y_order[layer].push_back(entity);
+      add_to_drawing_list(entities_drawn_y_order[layer], entity);
     }
     else if (entity->can_be_drawn()) {
-      entities_drawn_first[layer].push_back(entity);
+      add_to_drawing_list(entities_drawn_first[layer], entity);
+    }
+
+    const std::list<Sprite*>& sprites = entity->get_sprites();
+    std::list<Sprite*>::const_iterator it;
+    for (it = sprites.begin(); it != sprites.end(); ++it) {
+      notify_sprite_created(**it);
     }
 
     // update the specific entities lists
@@ -678,6 +1121,7 @@ void MapEntities::add_entity(MapEntity* entity) {
 
     // update the list of all entities
     all_entities.push_back(entity);
+    entity_grid.add(*entity);
   }
 
   const std::string& name = entity->get_name();
@@ -695,6 +1139,10 @@ void MapEntities::add_entity(MapEntity* entity) {
 
 /**
  * \brief Removes an entity from the map and schedules it to be destroyed.
+ *
+ * The entity is only marked here. remove_marked_entities() erases it from
+ * the registries later, in a time linear in their size.
+ *
  * \param entity the entity to remove
  */
 void MapEntities::remove_entity(MapEntity* entity) {
@@ -727,98 +1175,68 @@ void MapEntities::remove_entity(const std::string& name) {
  */
 void MapEntities::remove_entities_with_prefix(const std::string& prefix) {
 
-  std::list<MapEntity*> entities = get_entities_with_prefix(prefix);
-  std::list<MapEntity*>::iterator it;
-  for (it = entities.begin(); it != entities.end(); it++) {
+  std::vector<MapEntity*> entities;
+  get_entities_with_prefix(prefix, entities);
+  std::vector<MapEntity*>::iterator it;
+  for (it = entities.begin(); it != entities.end(); ++it) {
     remove_entity(*it);
   }
 }
 
 /**
  * \brief Removes and destroys the entities placed in the entities_to_remove list.
+ *
+ * All registries are compacted in a single pass each, whatever the number
+ * of entities removed, and the order of the remaining entities is kept.
  */
 void MapEntities::remove_marked_entities() {
 
-  list<MapEntity*>::iterator it;
-
-  // remove the marked entities
-  for (it = entities_to_remove.begin();
-       it != entities_to_remove.end();
-       it++) {
-
-    MapEntity* entity = *it;
-    Layer layer = entity->get_layer();
-
-    // remove it from the obstacle entities list if present
-    if (entity->can_be_obstacle()) {
-
-      if (entity->has_layer_independent_collisions()) {
-        for (int i = 0; i < LAYER_NB; i++) {
-          obstacle_entities[i].remove(entity);
-        }
-      }
-      else {
-        obstacle_entities[layer].remove(entity);
-      }
-    }
-
-    // remove it from the detectors list if present
-    if (entity->is_detector()) {
-      detectors.remove(static_cast<Detector*>(entity));
-    }
-
-    // remove it from the ground obsevers list if present
-    if (entity->is_ground_observer()) {
-      ground_observers[layer].remove(entity);
-    }
-
-    // remove it from the ground modifiers list if present
-    if (entity->is_ground_modifier()) {
-      ground_modifiers[layer].remove(entity);
-    }
-
-    // remove it from the sprite entities list if present
-    if (entity->is_drawn_in_y_order()) {
-      entities_drawn_y_order[layer].remove(entity);
-    }
-    else if (entity->can_be_drawn()) {
-      entities_drawn_first[layer].remove(entity);
-    }
-
-    // remove it from the whole list
-    all_entities.remove(entity);
-    const std::string& name = entity->get_name();
-    if (!name.empty()) {
-      named_entities.erase(name);
+  // Destroying an entity might mark other ones: repeat until nothing is left.
+  while (!entities_to_remove.empty()) {
+
+    std::vector<MapEntity*> removed_entities;
+    removed_entities.swap(entities_to_remove);
+
+    // Remove the marked entities from the registries. Entities marked for
+    // removal are exactly the ones that return true to is_being_removed().
+    for (int layer = 0; layer < LAYER_NB; layer++) {
+      remove_entities_being_removed(obstacle_entities[layer]);
+      remove_entities_being_removed(ground_observers[layer]);
+      remove_entities_being_removed(ground_modifiers[layer]);
+      remove_entities_being_removed(entities_drawn_first[layer]);
+      remove_entities_being_removed(entities_drawn_y_order[layer]);
+      remove_entities_being_removed(stairs[layer]);
+      remove_entities_being_removed(crystal_blocks[layer]);
     }
+    remove_entities_being_removed(detectors);
+    remove_entities_being_removed(separators);
+    remove_entities_being_removed(all_entities);
 
-    // update the specific entities lists
-    switch (entity->get_type()) {
+    std::vector<MapEntity*>::iterator it;
+    for (it = removed_entities.begin();
+         it != removed_entities.end();
+         ++it) {
 
-      case STAIRS:
-        stairs[layer].remove(static_cast<Stairs*>(entity));
-        break;
+      MapEntity* entity = *it;
+      entity_grid.remove(*entity);
 
-      case CRYSTAL_BLOCK:
-        crystal_blocks[layer].remove(static_cast<CrystalBlock*>(entity));
-        break;
+      if (entity->is_ground_modifier()) {
+        remove_from_ground_modifiers_grid(*entity, entity->get_layer());
+      }
 
-      case SEPARATOR:
-        separators.remove(static_cast<Separator*>(entity));
-        break;
+      const std::string& name = entity->get_name();
+      if (!name.empty()) {
+        named_entities.erase(name);
+      }
 
-      case BOOMERANG:
+      if (entity == this->boomerang) {
         this->boomerang = NULL;
-        break;
+      }
 
-      default:
-      break;
+      // destroy it
+      destroy_entity(entity);
     }
-
-    // destroy it
-    destroy_entity(entity);
   }
-  entities_to_remove.clear();
 }
 
 /**
@@ -836,12 +1254,14 @@ void MapEntities::set_suspended(bool suspended) {
   hero.set_suspended(suspended);
 
   // other entities
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin();
-       i != all_entities.end();
-       i++) {
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
 
-    (*i)->set_suspended(suspended);
+    MapEntity* entity = all_entities[i];
+    if (!suspended && entity->is_sleeping()) {
+      // Sleeping entities stay suspended until they wake up.
+      continue;
+    }
+    entity->set_suspended(suspended);
   }
 
   // note that we don't suspend the tiles
@@ -857,26 +1277,42 @@ void MapEntities::update() {
   // first update the hero
   hero.update();
 
+  // redraw a part of the non-animated tiles if the tileset has changed
+  if (rebuilding_non_animated_tiles) {
+    continue_rebuilding_non_animated_tiles();
+  }
+
   // update the tiles and the dynamic entities
-  list<MapEntity*>::iterator it;
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
-    for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      tiles[layer][i]->update();
+    for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
+      tiles_in_animated_regions[layer][i]->update();
     }
 
     // sort the entities drawn in y order
-    entities_drawn_y_order[layer].sort(compare_y);
+    sort_entities_drawn_y_order(Layer(layer));
   }
 
-  for (it = all_entities.begin();
-       it != all_entities.end();
-       it++) {
+  // Entities may be created during the loop: don't use iterators.
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+
+    MapEntity* entity = all_entities[i];
+    if (entity->is_being_removed()) {
+      continue;
+    }
 
-    if (!(*it)->is_being_removed()) {
-      (*it)->update();
+    if (entity->is_sleeping()) {
+      // Far from the camera: only check once in a while if it should wake
+      // up, spreading these checks over several cycles.
+      if ((i + nb_updates) % sleeping_check_interval == 0) {
+        entity->update_sleeping();
+      }
+      continue;
     }
+
+    entity->update();
   }
+  ++nb_updates;
 
   // remove the entities that have to be removed now
   remove_marked_entities();
@@ -889,27 +1325,32 @@ void MapEntities::update() {
 void MapEntities::build_non_animated_tiles() {
 
   const Rectangle map_size(0, 0, map.get_width(), map.get_height());
+  animated_tiles_grid.set_size(map.get_width(), map.get_height());
+  rebuild_blocks_width = (map_size.get_width() + rebuild_block_size - 1) / rebuild_block_size;
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
     delete non_animated_tiles_surfaces[layer];
     non_animated_tiles_surfaces[layer] = new Surface(map_size.get_width(), map_size.get_height());
+    rebuild_blocks[layer].assign(rebuild_blocks_width *
+        ((map_size.get_height() + rebuild_block_size - 1) / rebuild_block_size), NULL);
     non_animated_tiles_surfaces[layer]->set_transparency_color(Color::get_magenta());
     non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta());
 
     for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      Tile& tile = *tiles[layer][i];
-      if (!tile.is_animated()) {
+      const TileInfo& tile = tiles[layer][i];
+      TilePattern& tile_pattern = map.get_tileset().get_tile_pattern(tile.tile_pattern_id);
+      if (!tile_pattern.is_animated()) {
         // non-animated tile: optimize its displaying
-        tile.draw(*non_animated_tiles_surfaces[layer], map_size);
+        draw_tile(tile, *non_animated_tiles_surfaces[layer]);
       }
       else {
         // animated tile: mark its region as non-optimizable
         // (otherwise, a non-animated tile above an animated one would screw us)
 
-        int tile_x8 = tile.get_x() / 8;
-        int tile_y8 = tile.get_y() / 8;
-        int tile_width8 = tile.get_width() / 8;
-        int tile_height8 = tile.get_height() / 8;
+        int tile_x8 = tile.x / 8;
+        int tile_y8 = tile.y / 8;
+        int tile_width8 = tile.width / 8;
+        int tile_height8 = tile.height / 8;
 
         for (int i = 0; i < tile_height8; i++) {
           for (int j = 0; j < tile_width8; j++) {
@@ -938,67 +1379,229 @@ void MapEntities::build_non_animated_tiles() {
       }
     }
 
-    // build the list of animated tiles and tiles overlapping them
+    // create the animated tiles and tiles overlapping them
     for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      Tile& tile = *tiles[layer][i];
-      if (tile.is_animated() || overlaps_animated_tile(tile)) {
-        tiles_in_animated_regions[layer].push_back(&tile);
+      const TileInfo& tile_info = tiles[layer][i];
+      TilePattern& tile_pattern = map.get_tileset().get_tile_pattern(tile_info.tile_pattern_id);
+      if (!tile_pattern.is_animated() && !overlaps_animated_tile(Layer(layer), tile_info)) {
+        continue;
+      }
+
+      Tile* tile = new Tile(Layer(layer), tile_info.x, tile_info.y,
+          tile_info.width, tile_info.height, tile_info.tile_pattern_id);
+      tile->increment_refcount();
+      tile->set_map(map);
+      tile->set_drawing_rank(tiles_in_animated_regions[layer].size());
+      tiles_in_animated_regions[layer].push_back(tile);
+
+      // index it to only draw it when it is visible
+      if (tile->is_drawn_at_its_position()) {
+        animated_tiles_grid.add(*tile);
+      }
+      else {
+        tiles_drawn_anywhere.push_back(tile);
       }
     }
   }
 }
 
 /**
- * \brief Draws all non-animated rectangles of tiles on intermediate surfaces.
- *
- * This function is similar to build_non_animated_tiles() except that it
- * assumes that animated and non-animated rectangles were already determined.
+ * \brief Starts redrawing the non-animated tiles that have changed.
  *
  * This function is called when the tileset changes.
+ * Only the blocks of the non-animated tiles surfaces that contain a changed
+ * tile pattern are redrawn, on separate surfaces and over several cycles
+ * to avoid a pause.
+ * The non-animated tiles surfaces keep their previous image until all blocks
+ * are ready.
+ *
+ * \param changed_tile_patterns Ids of the tile patterns that look different
+ * with the new tileset.
  */
-void MapEntities::redraw_non_animated_tiles() {
+void MapEntities::start_rebuilding_non_animated_tiles(
+    const std::set<int>& changed_tile_patterns) {
 
-  const Rectangle map_size(0, 0, map.get_width(), map.get_height());
+  Tileset& tileset = map.get_tileset();
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
-    non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta());
+    // Blocks not finished from a previous change are redrawn from scratch.
+    for (unsigned int i = 0; i < rebuild_blocks[layer].size(); i++) {
+      if (rebuild_blocks[layer][i] != NULL) {
+        rebuild_blocks[layer][i]->fill_with_color(Color::get_magenta());
+        rebuilding_non_animated_tiles = true;
+      }
+    }
 
+    // Create a block wherever a non-animated tile has changed.
     for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      Tile& tile = *tiles[layer][i];
-      if (!tile.is_animated()) {
-        // Non-animated tile: optimize its displaying.
-        tile.draw(*non_animated_tiles_surfaces[layer], map_size);
+      const TileInfo& tile = tiles[layer][i];
+      if (tileset.get_tile_pattern(tile.tile_pattern_id).is_animated()
+          || changed_tile_patterns.find(tile.tile_pattern_id) == changed_tile_patterns.end()) {
+        continue;
+      }
+
+      const Rectangle& blocks = get_rebuild_blocks(tile);
+      for (int j = blocks.get_y(); j < blocks.get_y() + blocks.get_height(); j++) {
+        for (int k = blocks.get_x(); k < blocks.get_x() + blocks.get_width(); k++) {
+          Surface*& block = rebuild_blocks[layer][j * rebuild_blocks_width + k];
+          if (block == NULL) {
+            block = new Surface(rebuild_block_size, rebuild_block_size);
+            block->fill_with_color(Color::get_magenta());
+            rebuilding_non_animated_tiles = true;
+          }
+        }
       }
     }
+  }
 
-    // Erase rectangles that contain animated tiles.
-    int index = 0;
-    for (int y = 0; y < map.get_height(); y += 8) {
-      for (int x = 0; x < map.get_width(); x += 8) {
+  rebuild_layer = 0;
+  rebuild_tile_index = 0;
+}
 
-        if (animated_tiles[layer][index]) {
-          Rectangle animated_square(x, y, 8, 8);
-          non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta(), animated_square);
+/**
+ * \brief Draws the next tiles on the blocks being rebuilt.
+ *
+ * This function stops when its time budget is elapsed and is called again
+ * at the next cycle.
+ * When all tiles are drawn, the blocks replace the corresponding parts of
+ * the non-animated tiles surfaces.
+ */
+void MapEntities::continue_rebuilding_non_animated_tiles() {
+
+  const uint64_t start_date = System::get_precise_ticks();
+  Tileset& tileset = map.get_tileset();
+  unsigned int nb_tiles_drawn = 0;
+
+  while (rebuild_layer < LAYER_NB) {
+
+    const std::vector<TileInfo>& layer_tiles = tiles[rebuild_layer];
+    std::vector<Surface*>& layer_blocks = rebuild_blocks[rebuild_layer];
+    while (rebuild_tile_index < layer_tiles.size()) {
+
+      const TileInfo& tile = layer_tiles[rebuild_tile_index];
+      ++rebuild_tile_index;
+      TilePattern& tile_pattern = tileset.get_tile_pattern(tile.tile_pattern_id);
+      if (!tile_pattern.is_animated()) {
+
+        // Draw the tile on each block being rebuilt that it overlaps.
+        const Rectangle& blocks = get_rebuild_blocks(tile);
+        for (int j = blocks.get_y(); j < blocks.get_y() + blocks.get_height(); j++) {
+          for (int k = blocks.get_x(); k < blocks.get_x() + blocks.get_width(); k++) {
+
+            Surface* block = layer_blocks[j * rebuild_blocks_width + k];
+            if (block != NULL) {
+              const Rectangle block_position(k * rebuild_block_size, j * rebuild_block_size,
+                  rebuild_block_size, rebuild_block_size);
+              const Rectangle dst_position(tile.x - block_position.get_x(),
+                  tile.y - block_position.get_y(), tile.width, tile.height);
+              tile_pattern.fill_surface(*block, dst_position, tileset, block_position);
+            }
+          }
+        }
+      }
+
+      // Checking the time has a cost: only do it from time to time.
+      ++nb_tiles_drawn;
+      if (nb_tiles_drawn % 64 == 0
+          && System::get_precise_ticks() - start_date >= rebuild_time_budget) {
+        return;
+      }
+    }
+
+    ++rebuild_layer;
+    rebuild_tile_index = 0;
+  }
+
+  finish_rebuilding_non_animated_tiles();
+}
+
+/**
+ * \brief Copies the blocks that were rebuilt onto the non-animated tiles
+ * surfaces and deletes them.
+ */
+void MapEntities::finish_rebuilding_non_animated_tiles() {
+
+  for (int layer = 0; layer < LAYER_NB; layer++) {
+
+    for (unsigned int i = 0; i < rebuild_blocks[layer].size(); i++) {
+
+      Surface* block = rebuild_blocks[layer][i];
+      if (block == NULL) {
+        continue;
+      }
+
+      const int block_x = (i % rebuild_blocks_width) * rebuild_block_size;
+      const int block_y = (i / rebuild_blocks_width) * rebuild_block_size;
+
+      // Erase the squares that contain animated tiles.
+      const int x_end = std::min(block_x + rebuild_block_size, map.get_width());
+      const int y_end = std::min(block_y + rebuild_block_size, map.get_height());
+      for (int y = block_y; y < y_end; y += 8) {
+        for (int x = block_x; x < x_end; x += 8) {
+          if (animated_tiles[layer][(y / 8) * map_width8 + (x / 8)]) {
+            Rectangle animated_square(x - block_x, y - block_y, 8, 8);
+            block->fill_with_color(Color::get_magenta(), animated_square);
+          }
         }
-        index++;
       }
+
+      // The block has no transparency color: all its pixels are copied.
+      Rectangle dst_position(block_x, block_y);
+      block->draw_region(block->get_size(), *non_animated_tiles_surfaces[layer], dst_position);
+      delete block;
+      rebuild_blocks[layer][i] = NULL;
     }
   }
+
+  rebuilding_non_animated_tiles = false;
+}
+
+/**
+ * \brief Returns the rebuild blocks overlapped by a tile.
+ * \param tile A tile.
+ * \return The range of blocks (in block coordinates) overlapped by this tile,
+ * possibly empty if the tile is outside the map.
+ */
+Rectangle MapEntities::get_rebuild_blocks(const TileInfo& tile) const {
+
+  const int rebuild_blocks_height = (map.get_height() + rebuild_block_size - 1) / rebuild_block_size;
+  const int x1 = std::max(0, tile.x) / rebuild_block_size;
+  const int y1 = std::max(0, tile.y) / rebuild_block_size;
+  const int x2 = std::min(rebuild_blocks_width,
+      (tile.x + tile.width + rebuild_block_size - 1) / rebuild_block_size);
+  const int y2 = std::min(rebuild_blocks_height,
+      (tile.y + tile.height + rebuild_block_size - 1) / rebuild_block_size);
+  return Rectangle(x1, y1, std::max(0, x2 - x1), std::max(0, y2 - y1));
+}
+
+/**
+ * \brief Draws a tile on a surface of the size of the map.
+ * \param tile The tile to draw.
+ * \param dst_surface The destination surface.
+ */
+void MapEntities::draw_tile(const TileInfo& tile, Surface& dst_surface) {
+
+  const Rectangle map_size(0, 0, map.get_width(), map.get_height());
+  const Rectangle dst_position(tile.x, tile.y, tile.width, tile.height);
+  Tileset& tileset = map.get_tileset();
+  tileset.get_tile_pattern(tile.tile_pattern_id).fill_surface(
+      dst_surface, dst_position, tileset, map_size);
 }
 
 /**
  * \brief Returns whether a tile is overlapping an animated other tile.
+ * \param layer Layer of the tile.
  * \param tile the tile to check
  * \return true if this tile is overlapping an animated tile
  */
-bool MapEntities::overlaps_animated_tile(Tile& tile) {
+bool MapEntities::overlaps_animated_tile(Layer layer, const TileInfo& tile) {
 
-  bool* animated_tiles_layer = animated_tiles[tile.get_layer()];
+  bool* animated_tiles_layer = animated_tiles[layer];
 
-  int tile_x8 = tile.get_x() / 8;
-  int tile_y8 = tile.get_y() / 8;
-  int tile_width8 = tile.get_width() / 8;
-  int tile_height8 = tile.get_height() / 8;
+  int tile_x8 = tile.x / 8;
+  int tile_y8 = tile.y / 8;
+  int tile_width8 = tile.width / 8;
+  int tile_height8 = tile.height / 8;
 
   for (int i = 0; i < tile_height8; i++) {
     for (int j = 0; j < tile_width8; j++) {
@@ -1022,45 +1625,141 @@ bool MapEntities::overlaps_animated_tile(Tile& tile) {
  */
 void MapEntities::draw() {
 
+  // Only consider the tiles and entities that may be visible:
+  // those near the camera, with enough margin for their sprites.
+  const Rectangle& camera_position = map.get_camera_position();
+  const int margin = max_sprite_size + drawing_margin;
+  const Rectangle region(
+      camera_position.get_x() - margin,
+      camera_position.get_y() - margin,
+      camera_position.get_width() + 2 * margin,
+      camera_position.get_height() + 2 * margin);
+
+  // Sprites may also be displaced from their entity.
+  // Each entity found then checks is_drawn() in its draw_on_map().
+  const int entities_margin = margin + max_sprite_displacement;
+  const Rectangle entities_region(
+      camera_position.get_x() - entities_margin,
+      camera_position.get_y() - entities_margin,
+      camera_position.get_width() + 2 * entities_margin,
+      camera_position.get_height() + 2 * entities_margin);
+
+  tiles_to_draw.clear();
+  animated_tiles_grid.get_entities_in_rectangle(region, tiles_to_draw);
+  tiles_to_draw.insert(tiles_to_draw.end(),
+      tiles_drawn_anywhere.begin(), tiles_drawn_anywhere.end());
+  std::sort(tiles_to_draw.begin(), tiles_to_draw.end(), compare_drawing_order);
+
+  entities_to_draw.clear();
+  entity_grid.get_entities_in_rectangle(entities_region, entities_to_draw);
+  std::sort(entities_to_draw.begin(), entities_to_draw.end(), compare_drawing_order);
+
+  unsigned int i = 0;
+  unsigned int j = 0;
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
     // draw the animated tiles and the tiles that overlap them:
     // in other words, draw all regions containing animated tiles
     // (and maybe more, but we don't care because non-animated tiles
     // will be drawn later)
-    for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
-      tiles_in_animated_regions[layer][i]->draw_on_map();
+    for (; i < tiles_to_draw.size() && tiles_to_draw[i]->get_layer() == layer; i++) {
+      tiles_to_draw[i]->draw_on_map();
     }
 
     // draw the non-animated tiles (with transparent rectangles on the regions of animated tiles
     // since they are already drawn)
     non_animated_tiles_surfaces[layer]->draw_region(
-        map.get_camera_position(), map.get_visible_surface());
+        camera_position, map.get_visible_surface());
 
-    // draw the first sprites
-    list<MapEntity*>::iterator i;
-    for (i = entities_drawn_first[layer].begin();
-        i != entities_drawn_first[layer].end();
-        i++) {
+    // draw the first sprites, then the sprites at the hero's level,
+    // in the order defined by their y position (including the hero)
+    for (; j < entities_to_draw.size() && entities_to_draw[j]->get_layer() == layer; j++) {
 
-      MapEntity* entity = *i;
-      if (entity->is_enabled()) {
+      MapEntity* entity = entities_to_draw[j];
+      if (entity->can_be_drawn() && entity->is_enabled()) {
         entity->draw_on_map();
       }
     }
+  }
+}
 
-    // draw the sprites at the hero's level, in the order
-    // defined by their y position (including the hero)
-    for (i = entities_drawn_y_order[layer].begin();
-        i != entities_drawn_y_order[layer].end();
-        i++) {
+/**
+ * \brief Adds an entity at the end of a drawing list.
+ *
+ * The entity gets a drawing rank greater than the ones of the list.
+ *
+ * \param drawing_list A list of entities drawn in the normal order or
+ * in the y order.
+ * \param entity The entity to add.
+ */
+void MapEntities::add_to_drawing_list(std::vector<MapEntity*>& drawing_list,
+    MapEntity* entity) {
 
-      MapEntity* entity = *i;
-      if (entity->is_enabled()) {
-        entity->draw_on_map();
-      }
-    }
+  int drawing_rank = 0;
+  if (!drawing_list.empty()) {
+    drawing_rank = drawing_list.back()->get_drawing_rank() + 1;
   }
+  entity->set_drawing_rank(drawing_rank);
+  drawing_list.push_back(entity);
+}
+
+/**
+ * \brief Compares the drawing order of two entities.
+ *
+ * Entities are ordered by layer, then entities drawn in the normal order
+ * come before the ones drawn in the y order, and finally by drawing rank.
+ *
+ * \param first an entity
+ * \param second another entity
+ * \return true if the first entity is drawn before the second one
+ */
+bool MapEntities::compare_drawing_order(MapEntity* first, MapEntity* second) {
+
+  if (first->get_layer() != second->get_layer()) {
+    return first->get_layer() < second->get_layer();
+  }
+
+  bool first_y_order = first->is_drawn_in_y_order();
+  bool second_y_order = second->is_drawn_in_y_order();
+  if (first_y_order != second_y_order) {
+    return second_y_order;
+  }
+
+  return first->get_drawing_rank() < second->get_drawing_rank();
+}
+
+/**
+ * \brief Takes into account the size of a new sprite of an entity of this map.
+ *
+ * This makes sure that draw() considers entities far enough from the
+ * camera for this sprite to be drawn.
+ *
+ * \param sprite A sprite just created.
+ */
+void MapEntities::notify_sprite_created(Sprite& sprite) {
+
+  const Rectangle& max_size = sprite.get_max_size();
+  max_sprite_size = std::max(max_sprite_size,
+      std::max(max_size.get_width(), max_size.get_height()));
+
+  sprite.set_map_entities(this);
+  notify_sprite_displaced(sprite);
+}
+
+/**
+ * \brief Takes into account the offset of a sprite of an entity of this map
+ * relative to its entity.
+ *
+ * This makes sure that draw() considers entities far enough from the
+ * camera for their displaced sprites to be drawn.
+ *
+ * \param sprite A sprite whose coordinates have just changed.
+ */
+void MapEntities::notify_sprite_displaced(Sprite& sprite) {
+
+  const Rectangle& xy = sprite.get_xy();
+  max_sprite_displacement = std::max(max_sprite_displacement,
+      std::max(std::abs(xy.get_x()), std::abs(xy.get_y())));
 }
 
 /**
@@ -1076,6 +1775,41 @@ bool MapEntities::compare_y(MapEntity* first, MapEntity* second) {
   return first->get_top_left_y() + first->get_height() < second->get_top_left_y() + second->get_height();
 }
 
+/**
+ * \brief Sorts the entities drawn in y order of a layer.
+ *
+ * This is an insertion sort: between two frames, few entities change their
+ * position in the order, so the list is nearly sorted and this takes
+ * linear time. Like std::list::sort() used before, it is stable:
+ * entities with the same y keep their previous relative order.
+ * The drawing ranks of the entities are then updated.
+ *
+ * \param layer The layer to sort.
+ */
+void MapEntities::sort_entities_drawn_y_order(Layer layer) {
+
+  std::vector<MapEntity*>& entities = entities_drawn_y_order[layer];
+  for (unsigned int i = 1; i < entities.size(); i++) {
+
+    MapEntity* entity = entities[i];
+    if (!compare_y(entity, entities[i - 1])) {
+      // Already at its place: this is the usual case.
+      continue;
+    }
+
+    unsigned int j = i;
+    do {
+      entities[j] = entities[j - 1];
+      --j;
+    } while (j > 0 && compare_y(entity, entities[j - 1]));
+    entities[j] = entity;
+  }
+
+  for (unsigned int i = 0; i < entities.size(); i++) {
+    entities[i]->set_drawing_rank(i);
+  }
+}
+
 /**
  * \brief Changes the layer of an entity.
  *
@@ -1092,30 +1826,32 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 
     // update the obstacle list
     if (entity.can_be_obstacle() && !entity.has_layer_independent_collisions()) {
-      obstacle_entities[old_layer].remove(&entity);
+      remove_from_registry(obstacle_entities[old_layer], &entity);
       obstacle_entities[layer].push_back(&entity);
     }
 
     // update the ground observers list
     if (entity.is_ground_observer()) {
-      ground_observers[old_layer].remove(&entity);
+      remove_from_registry(ground_observers[old_layer], &entity);
       ground_observers[layer].push_back(&entity);
     }
 
     // update the ground modifiers list
     if (entity.is_ground_modifier()) {
-      ground_modifiers[old_layer].remove(&entity);
+      remove_from_registry(ground_modifiers[old_layer], &entity);
       ground_modifiers[layer].push_back(&entity);
+      remove_from_ground_modifiers_grid(entity, old_layer);
+      add_to_ground_modifiers_grid(entity, layer);
     }
 
     // update the sprites list
     if (entity.is_drawn_in_y_order()) {
-      entities_drawn_y_order[old_layer].remove(&entity);
-      entities_drawn_y_order[layer].push_back(&entity);
+      remove_from_registry(entities_drawn_y_order[old_layer], &entity);
+      add_to_drawing_list(entities_drawn_y_order[layer], &entity);
     }
     else if (entity.can_be_drawn()) {
-      entities_drawn_first[old_layer].remove(&entity);
-      entities_drawn_first[layer].push_back(&entity);
+      remove_from_registry(entities_drawn_first[old_layer], &entity);
+      add_to_drawing_list(entities_drawn_first[layer], &entity);
     }
 
     // update the entity after the lists because this function might be called again
@@ -1123,6 +1859,37 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
   }
 }
 
+/**
+ * \brief Updates the spatial index after the bounding box or the origin of
+ * an entity has changed.
+ *
+ * This function is called by MapEntity: you should not have to call it.
+ *
+ * \param entity The entity that has moved or been resized.
+ */
+void MapEntities::notify_entity_bounding_box_changed(MapEntity& entity) {
+
+  entity_grid.notify_bounding_box_changed(entity);
+
+  if (entity.is_ground_modifier()) {
+    std::map<MapEntity*, GroundModifierInfo>::iterator it =
+        ground_modifier_infos.find(&entity);
+    if (it != ground_modifier_infos.end()) {
+      // Only update the squares that the modifier leaves or enters.
+      GroundModifierInfo& info = it->second;
+      const Rectangle& old_cells = get_ground_cells(info.box);
+      info.box = entity.get_bounding_box();
+      const Rectangle& new_cells = get_ground_cells(info.box);
+
+      GroundModifierEntry entry;
+      entry.entity = &entity;
+      entry.rank = info.rank;
+      remove_from_ground_cells(entity.get_layer(), &entity, old_cells, new_cells);
+      add_to_ground_cells(entity.get_layer(), entry, new_cells, old_cells);
+    }
+  }
+}
+
 /**
  * \brief Returns whether a rectangle overlaps with a raised crystal block.
  * \param layer the layer to check
@@ -1132,11 +1899,9 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 bool MapEntities::overlaps_raised_blocks(Layer layer, const Rectangle& rectangle) {
 
   bool overlaps = false;
-  std::list<CrystalBlock*> blocks = get_crystal_blocks(layer);
-
-  std::list<CrystalBlock*>::iterator it;
-  for (it = blocks.begin(); it != blocks.end() && !overlaps; it++) {
-    overlaps = (*it)->overlaps(rectangle) && (*it)->is_raised();
+  const std::vector<CrystalBlock*>& blocks = crystal_blocks[layer];
+  for (unsigned int i = 0; i < blocks.size() && !overlaps; i++) {
+    overlaps = blocks[i]->overlaps(rectangle) && blocks[i]->is_raised();
   }
 
   return overlaps;
@@ -1167,8 +1932,8 @@ void MapEntities::remove_boomerang() {
 void MapEntities::remove_arrows() {
 
   // TODO this function may be slow if there are a lot of entities: store the arrows?
-  std::list<MapEntity*>::iterator it;
-  for (it = all_entities.begin(); it != all_entities.end(); it++) {
+  std::vector<MapEntity*>::iterator it;
+  for (it = all_entities.begin(); it != all_entities.end(); ++it) {
     MapEntity* entity = *it;
     if (entity->get_type() == ARROW) {
       remove_entity(entity);
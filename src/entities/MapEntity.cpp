@@ -44,6 +44,39 @@ const Rectangle MapEntity::directions_to_xy_moves[] = {
   Rectangle( 1, 1)
 };
 
+const std::string MapEntity::entity_type_names[] = {
+  "tile",
+  "destination",
+  "teletransporter",
+  "pickable",
+  "destructible",
+  "chest",
+  "jumper",
+  "enemy",
+  "npc",
+  "block",
+  "dynamic_tile",
+  "switch",
+  "wall",
+  "sensor",
+  "crystal",
+  "crystal_block",
+  "shop_item",
+  "conveyor_belt",
+  "door",
+  "stairs",
+  "separator",
+  "hero",
+  "carried_object",
+  "boomerang",
+  "explosion",
+  "arrow",
+  "bomb",
+  "fire",
+  "hookshot",
+  ""  // Sentinel.
+};
+
 /**
  * \brief Creates a map entity without specifying its properties now.
  */
@@ -62,7 +95,10 @@ MapEntity::MapEntity():
   being_removed(false),
   enabled(true),
   waiting_enabled(false),
-  optimization_distance(default_optimization_distance) {
+  optimization_distance(default_optimization_distance),
+  sleep_allowed(false),
+  sleeping(false),
+  drawing_rank(0) {
 
   bounding_box.set_xy(0, 0);
   origin.set_xy(0, 0);
@@ -96,7 +132,10 @@ MapEntity::MapEntity(Layer layer, int x, int y, int width, int height):
   being_removed(false),
   enabled(true),
   waiting_enabled(false),
-  optimization_distance(default_optimization_distance) {
+  optimization_distance(default_optimization_distance),
+  sleep_allowed(false),
+  sleeping(false),
+  drawing_rank(0) {
 
   origin.set_xy(0, 0);
   set_size(width, height);
@@ -129,7 +168,10 @@ MapEntity::MapEntity(const std::string& name, int direction, Layer layer,
   being_removed(false),
   enabled(true),
   waiting_enabled(false),
-  optimization_distance(default_optimization_distance) {
+  optimization_distance(default_optimization_distance),
+  sleep_allowed(false),
+  sleeping(false),
+  drawing_rank(0) {
 
   origin.set_xy(0, 0);
   set_size(width, height);
@@ -240,11 +282,10 @@ void MapEntity::update_ground_observers() {
   }
 
   // Update overlapping entities sensible to their ground.
-  std::list<MapEntity*>::const_iterator it;
-  const std::list<MapEntity*>& ground_observers =
+  const std::vector<MapEntity*>& ground_observers =
       get_entities().get_ground_observers(get_layer());
-  for (it = ground_observers.begin(); it != ground_observers.end(); ++it) {
-    MapEntity& ground_observer = *(*it);
+  for (unsigned int i = 0; i < ground_observers.size(); i++) {
+    MapEntity& ground_observer = *ground_observers[i];
     if (overlaps(ground_observer.get_ground_point())) {
       ground_observer.update_ground_below();
     }
@@ -583,6 +624,7 @@ int MapEntity::get_y() const {
  */
 void MapEntity::set_x(int x) {
   bounding_box.set_x(x - origin.get_x());
+  notify_bounding_box_changed();
 }
 
 /**
@@ -594,6 +636,7 @@ void MapEntity::set_x(int x) {
  */
 void MapEntity::set_y(int y) {
   bounding_box.set_y(y - origin.get_y());
+  notify_bounding_box_changed();
 }
 
 /**
@@ -653,6 +696,7 @@ int MapEntity::get_top_left_y() const {
  */
 void MapEntity::set_top_left_x(int x) {
   bounding_box.set_x(x);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -661,6 +705,7 @@ void MapEntity::set_top_left_x(int x) {
  */
 void MapEntity::set_top_left_y(int y) {
   bounding_box.set_y(y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -676,6 +721,17 @@ void MapEntity::set_top_left_xy(int x, int y) {
   set_top_left_y(y);
 }
 
+/**
+ * \brief Updates the spatial index of the map after the bounding box or the
+ * origin of this entity has changed.
+ */
+void MapEntity::notify_bounding_box_changed() {
+
+  if (is_on_map()) {
+    get_entities().notify_entity_bounding_box_changed(*this);
+  }
+}
+
 /**
  * \brief Returns the coordinates where this entity should be drawn.
  *
@@ -726,6 +782,7 @@ const Rectangle& MapEntity::get_size() const {
  */
 void MapEntity::set_size(int width, int height) {
   bounding_box.set_size(width, height);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -734,6 +791,7 @@ void MapEntity::set_size(int width, int height) {
  */
 void MapEntity::set_size(const Rectangle &size) {
   bounding_box.set_size(size);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -758,6 +816,7 @@ const Rectangle& MapEntity::get_bounding_box() const {
  */
 void MapEntity::set_bounding_box(const Rectangle &bounding_box) {
   this->bounding_box = bounding_box;
+  notify_bounding_box_changed();
 }
 
 /**
@@ -947,6 +1006,7 @@ void MapEntity::set_origin(int x, int y) {
 
   bounding_box.add_xy(origin.get_x() - x, origin.get_y() - y);
   origin.set_xy(x, y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -980,6 +1040,71 @@ void MapEntity::set_optimization_distance(int distance) {
   this->optimization_distance = distance;
 }
 
+/**
+ * \brief Returns whether this entity can sleep when it is far from the
+ * camera.
+ * \return true if sleeping is allowed.
+ */
+bool MapEntity::is_sleep_allowed() const {
+  return sleep_allowed;
+}
+
+/**
+ * \brief Sets whether this entity can sleep when it is far from the camera.
+ *
+ * An entity already suspended because it is beyond its optimization distance
+ * is normally still updated at each cycle.
+ * If sleeping is allowed, update() is no longer called at all until the
+ * entity comes back near the camera: the map only checks from time to time
+ * whether it should wake up.
+ * Since the entity stays suspended while sleeping, its timers, sprites and
+ * movement catch up as usual when it is resumed.
+ *
+ * \param sleep_allowed true to allow this entity to sleep.
+ */
+void MapEntity::set_sleep_allowed(bool sleep_allowed) {
+
+  this->sleep_allowed = sleep_allowed;
+  if (!sleep_allowed) {
+    sleeping = false;
+  }
+}
+
+/**
+ * \brief Returns whether this entity is currently sleeping.
+ *
+ * A sleeping entity is suspended and not updated by the map.
+ *
+ * \return true if this entity is sleeping.
+ */
+bool MapEntity::is_sleeping() const {
+  return sleeping;
+}
+
+/**
+ * \brief Returns whether this entity is beyond its optimization distance.
+ * \return true if the entity is far from the camera.
+ */
+bool MapEntity::is_far_from_camera() const {
+
+  return optimization_distance > 0
+      && get_distance_to_camera() > optimization_distance;
+}
+
+/**
+ * \brief Checks whether this sleeping entity should wake up.
+ *
+ * This function is called by the map from time to time instead of update()
+ * while the entity sleeps.
+ * When the entity wakes up, the next call to update() resumes it.
+ */
+void MapEntity::update_sleeping() {
+
+  if (!is_far_from_camera()) {
+    sleeping = false;
+  }
+}
+
 /**
  * \brief Returns whether the entity has at least one sprite.
  * \return true if the entity has at least one sprite.
@@ -1031,6 +1156,10 @@ Sprite& MapEntity::create_sprite(const std::string& animation_set_id,
   }
 
   sprites.push_back(sprite);
+
+  if (is_on_map()) {
+    get_entities().notify_sprite_created(*sprite);
+  }
   return *sprite;
 }
 
@@ -1062,6 +1191,24 @@ void MapEntity::clear_sprites() {
   sprites.clear();
 }
 
+/**
+ * \brief Makes the sprites of this entity forget the map entities.
+ *
+ * This function is called when the map entities drop this entity.
+ * Lua may still use the entity and its sprites after the map is destroyed:
+ * moving a sprite must then no longer notify the map entities.
+ */
+void MapEntity::detach_sprites_from_map() {
+
+  std::list<Sprite*>::iterator it;
+  for (it = sprites.begin(); it != sprites.end(); it++) {
+    (*it)->set_map_entities(NULL);
+  }
+  for (it = old_sprites.begin(); it != old_sprites.end(); it++) {
+    (*it)->set_map_entities(NULL);
+  }
+}
+
 /**
  * \brief Really destroys the sprites that were recently removed.
  */
@@ -1072,6 +1219,7 @@ void MapEntity::clear_old_sprites() {
     Sprite* sprite = *it;
     sprites.remove(sprite);
 
+    sprite->set_map_entities(NULL);
     sprite->decrement_refcount();
     if (sprite->get_refcount() == 0) {
       delete sprite;
@@ -1785,9 +1933,9 @@ int MapEntity::get_distance_to_camera() const {
  */
 bool MapEntity::is_in_same_region(const MapEntity& other) const {
 
-  const std::list<Separator*>& separators =
+  const std::vector<Separator*>& separators =
       get_entities().get_separators();
-  std::list<Separator*>::const_iterator it;
+  std::vector<Separator*>::const_iterator it;
   for (it = separators.begin(); it != separators.end(); ++it) {
 
     const Separator& separator = *(*it);
@@ -2108,14 +2256,16 @@ void MapEntity::update() {
   clear_old_movements();
 
   // suspend the entity if far from the camera
-  bool far = get_distance_to_camera() > optimization_distance
-      && optimization_distance > 0;
+  bool far = is_far_from_camera();
   if (far && !is_suspended()) {
     set_suspended(true);
   }
   else if (!far && is_suspended() && !get_game().is_suspended()) {
     set_suspended(false);
   }
+
+  // stop updating it at all if allowed
+  sleeping = far && sleep_allowed && is_suspended();
 }
 
 /**
@@ -2148,6 +2298,29 @@ bool MapEntity::is_drawn_at_its_position() const {
   return true;
 }
 
+/**
+ * \brief Returns the position of this entity in its drawing list.
+ *
+ * Entities of the same drawing list with a lower rank are drawn before
+ * this one. Ranks are only comparable within a drawing list.
+ *
+ * \return The drawing rank of this entity.
+ */
+int MapEntity::get_drawing_rank() const {
+  return drawing_rank;
+}
+
+/**
+ * \brief Sets the position of this entity in its drawing list.
+ *
+ * This function is called by the map when the drawing order changes.
+ *
+ * \param drawing_rank The new drawing rank.
+ */
+void MapEntity::set_drawing_rank(int drawing_rank) {
+  this->drawing_rank = drawing_rank;
+}
+
 /**
  * \brief Draws the entity on the map.
  *
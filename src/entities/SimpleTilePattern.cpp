@@ -68,3 +68,17 @@ bool SimpleTilePattern::is_animated() {
   return false;
 }
 
+/**
+ * \brief Returns whether this tile pattern looks different with the images
+ * of another tileset.
+ * \param tileset The tileset of this tile pattern.
+ * \param new_tileset A tileset whose images will replace the ones of
+ * \c tileset.
+ * \return true if the pixels of this pattern change.
+ */
+bool SimpleTilePattern::is_image_changed(Tileset& tileset, Tileset& new_tileset) {
+
+  return !tileset.get_tiles_image().has_same_pixels(
+      position_in_tileset, new_tileset.get_tiles_image());
+}
+
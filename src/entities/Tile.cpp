@@ -104,6 +104,14 @@ void Tile::draw(Surface& dst_surface, const Rectangle& viewport) {
       get_map().get_tileset(), viewport);
 }
 
+/**
+ * \brief Returns the id of the pattern of this tile.
+ * \return the tile pattern id
+ */
+int Tile::get_tile_pattern_id() const {
+  return tile_pattern_id;
+}
+
 /**
  * \brief Returns the pattern of this tile.
  * \return the tile pattern
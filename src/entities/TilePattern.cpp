@@ -122,6 +122,22 @@ bool TilePattern::is_drawn_at_its_position() {
   return true;
 }
 
+/**
+ * \brief Returns whether this tile pattern looks different with the images
+ * of another tileset.
+ *
+ * This function returns true by default. Redefine it if the change can be
+ * detected. The tiles images of both tilesets are locked during the call.
+ *
+ * \param tileset The tileset of this tile pattern.
+ * \param new_tileset A tileset whose images will replace the ones of
+ * \c tileset.
+ * \return true if tiles having this pattern have to be drawn again.
+ */
+bool TilePattern::is_image_changed(Tileset& tileset, Tileset& new_tileset) {
+  return true;
+}
+
 /**
  * \brief Fills a rectangle by repeating this tile pattern.
  * \param dst_surface The destination surface.
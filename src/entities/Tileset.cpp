@@ -192,6 +192,32 @@ TilePattern& Tileset::get_tile_pattern(int id) {
   return *tile_pattern;
 }
 
+/**
+ * \brief Returns the tile patterns that would look different with the
+ * images of another tileset.
+ * \param other Another tileset whose images may replace the ones of this
+ * tileset.
+ * \param tile_pattern_ids Set where to add the ids of the tile patterns of
+ * this tileset that change.
+ */
+void Tileset::get_changed_tile_patterns(Tileset& other,
+    std::set<int>& tile_pattern_ids) {
+
+  // Lock both images once for all comparisons of patterns.
+  get_tiles_image().lock();
+  other.get_tiles_image().lock();
+
+  std::map<int, TilePattern*>::iterator it;
+  for (it = tile_patterns.begin(); it != tile_patterns.end(); ++it) {
+    if (it->second->is_image_changed(*this, other)) {
+      tile_pattern_ids.insert(it->first);
+    }
+  }
+
+  other.get_tiles_image().unlock();
+  get_tiles_image().unlock();
+}
+
 /**
  * \brief Changes the tiles images, the entities images and the background color of
  * this tileset.
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/Compositor.h"
+#include "lowlevel/Rectangle.h"
+#include <algorithm>
+
+namespace {
+
+  /**
+   * \brief Multiplies two opacities.
+   * \param a An opacity (0 to 255).
+   * \param b Another opacity (0 to 255).
+   * \return The product, exact when one of them is 0 or 255.
+   */
+  inline int multiply_opacities(int a, int b) {
+    return (a * b + 255) >> 8;
+  }
+
+  /**
+   * \brief Multiplies a color channel of the destination by the one of the
+   * source, weighted by the opacity of the source.
+   * \param src_channel Value of the channel in the source pixel.
+   * \param dst_channel Value of the channel in the destination pixel.
+   * \param opacity Opacity of the source pixel (0 to 255).
+   * \param max Maximum value of the channel.
+   * \return The new value of the channel in the destination pixel.
+   */
+  inline uint32_t multiply_channel(uint32_t src_channel, uint32_t dst_channel,
+      int opacity, uint32_t max) {
+
+    // A transparent source leaves the destination unchanged.
+    const uint32_t factor = src_channel * opacity + max * (255 - opacity);
+    return (dst_channel * factor + max * 255 / 2) / (max * 255);
+  }
+}
+
+/**
+ * \brief Draws a subrectangle of a surface on another surface with an
+ * opacity and a blend mode.
+ *
+ * The transparency color or the alpha channel of the source surface and the
+ * clipping rectangle of the destination surface are respected like with a
+ * usual drawing.
+ *
+ * \param src_surface The surface to draw.
+ * \param region The subrectangle to draw in the source surface.
+ * \param dst_surface The destination surface.
+ * \param dst_position Coordinates on the destination surface.
+ * \param opacity Opacity of the source surface (0 to 255).
+ * \param blend_mode How to combine the source and destination colors.
+ */
+void Compositor::draw_region(Surface& src_surface, const Rectangle& region,
+    Surface& dst_surface, const Rectangle& dst_position,
+    int opacity, Surface::BlendMode blend_mode) {
+
+  if (opacity <= 0) {
+    return;
+  }
+  opacity = std::min(opacity, 255);
+
+  SDL_Surface* src = src_surface.internal_surface;
+  SDL_Surface* dst = dst_surface.internal_surface;
+
+  int src_x = region.get_x();
+  int src_y = region.get_y();
+  int dst_x = dst_position.get_x();
+  int dst_y = dst_position.get_y();
+  int width = region.get_width();
+  int height = region.get_height();
+
+  // Clip to the source surface.
+  if (src_x < 0) {
+    dst_x -= src_x;
+    width += src_x;
+    src_x = 0;
+  }
+  if (src_y < 0) {
+    dst_y -= src_y;
+    height += src_y;
+    src_y = 0;
+  }
+  width = std::min(width, src->w - src_x);
+  height = std::min(height, src->h - src_y);
+
+  // Clip to the clipping rectangle of the destination surface.
+  const SDL_Rect& clip = dst->clip_rect;
+  if (dst_x < clip.x) {
+    src_x += clip.x - dst_x;
+    width -= clip.x - dst_x;
+    dst_x = clip.x;
+  }
+  if (dst_y < clip.y) {
+    src_y += clip.y - dst_y;
+    height -= clip.y - dst_y;
+    dst_y = clip.y;
+  }
+  width = std::min(width, clip.x + clip.w - dst_x);
+  height = std::min(height, clip.y + clip.h - dst_y);
+
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+
+  const SDL_PixelFormat* src_format = src->format;
+  const SDL_PixelFormat* dst_format = dst->format;
+  const bool same_colors = src_format->BytesPerPixel == dst_format->BytesPerPixel
+    && src_format->Rmask == dst_format->Rmask
+    && src_format->Gmask == dst_format->Gmask
+    && src_format->Bmask == dst_format->Bmask;
+
+  SDL_LockSurface(src);
+  SDL_LockSurface(dst);
+
+  if (same_colors
+      && src_format->BytesPerPixel == 2
+      && (src_format->Rmask | src_format->Bmask) == 0xf81f
+      && src_format->Gmask == 0x07e0) {
+    draw_rows_565(src, src_x, src_y, dst, dst_x, dst_y, width, height,
+        opacity, blend_mode);
+  }
+  else if (same_colors
+      && src_format->BytesPerPixel == 4
+      && (src_format->Rmask | src_format->Bmask) == 0x00ff00ff
+      && src_format->Gmask == 0x0000ff00
+      && (src_format->Amask == 0 || src_format->Amask == 0xff000000)
+      && dst_format->Amask == 0) {
+    draw_rows_8888(src, src_x, src_y, dst, dst_x, dst_y, width, height,
+        opacity, blend_mode);
+  }
+  else {
+    draw_rows_generic(src, src_x, src_y, dst, dst_x, dst_y, width, height,
+        opacity, blend_mode);
+  }
+
+  SDL_UnlockSurface(dst);
+  SDL_UnlockSurface(src);
+}
+
+/**
+ * \brief Draws pixels between two RGB 565 surfaces.
+ *
+ * Each pixel is spread in a 32-bit integer (0x07e0f81f) so that the three
+ * channels are blended with a single multiplication.
+ *
+ * \param src The source surface (locked).
+ * \param src_x X coordinate of the first pixel to draw in the source.
+ * \param src_y Y coordinate of the first pixel to draw in the source.
+ * \param dst The destination surface (locked).
+ * \param dst_x X coordinate of the destination.
+ * \param dst_y Y coordinate of the destination.
+ * \param width Width of the rectangle to draw (already clipped).
+ * \param height Height of the rectangle to draw (already clipped).
+ * \param opacity Opacity of the source (1 to 255).
+ * \param blend_mode How to combine the source and destination colors.
+ */
+void Compositor::draw_rows_565(SDL_Surface* src, int src_x, int src_y,
+    SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+    int opacity, Surface::BlendMode blend_mode) {
+
+  static const uint32_t spread_mask = 0x07e0f81f;
+  const bool has_colorkey = (src->flags & SDL_SRCCOLORKEY) != 0;
+  const uint32_t colorkey = src->format->colorkey;
+  const uint32_t alpha = (opacity + 4) >> 3;  // 0 to 32.
+
+  for (int y = 0; y < height; y++) {
+
+    const uint16_t* src_pixel = (const uint16_t*) ((uint8_t*) src->pixels
+        + (src_y + y) * src->pitch) + src_x;
+    uint16_t* dst_pixel = (uint16_t*) ((uint8_t*) dst->pixels
+        + (dst_y + y) * dst->pitch) + dst_x;
+
+    for (int x = 0; x < width; x++, src_pixel++, dst_pixel++) {
+
+      const uint32_t s = *src_pixel;
+      if (has_colorkey && s == colorkey) {
+        continue;
+      }
+      const uint32_t d = *dst_pixel;
+      const uint32_t s_spread = (s | (s << 16)) & spread_mask;
+      const uint32_t d_spread = (d | (d << 16)) & spread_mask;
+      uint32_t result;
+
+      switch (blend_mode) {
+
+        case Surface::BLEND_NORMAL:
+          result = ((s_spread * alpha + d_spread * (32 - alpha)) >> 5) & spread_mask;
+          break;
+
+        case Surface::BLEND_ADD:
+        {
+          result = d_spread + (((s_spread * alpha) >> 5) & spread_mask);
+          // Saturate the channels that overflowed.
+          const uint32_t carry_rb = result & 0x00010020;
+          const uint32_t carry_g = result & 0x08000000;
+          result |= (carry_rb - (carry_rb >> 5)) | (carry_g - (carry_g >> 6));
+          result &= spread_mask;
+          break;
+        }
+
+        case Surface::BLEND_MULTIPLY:
+        default:
+          result = multiply_channel(s_spread & 0x1f, d_spread & 0x1f, opacity, 0x1f)
+            | (multiply_channel((s_spread >> 11) & 0x1f, (d_spread >> 11) & 0x1f, opacity, 0x1f) << 11)
+            | (multiply_channel(s_spread >> 21, d_spread >> 21, opacity, 0x3f) << 21);
+          break;
+      }
+
+      *dst_pixel = uint16_t(result | (result >> 16));
+    }
+  }
+}
+
+/**
+ * \brief Draws pixels between two 32-bit surfaces with 8-bit channels.
+ *
+ * Two channels are blended with a single multiplication.
+ * The source may have an alpha channel but not the destination.
+ *
+ * \param src The source surface (locked).
+ * \param src_x X coordinate of the first pixel to draw in the source.
+ * \param src_y Y coordinate of the first pixel to draw in the source.
+ * \param dst The destination surface (locked).
+ * \param dst_x X coordinate of the destination.
+ * \param dst_y Y coordinate of the destination.
+ * \param width Width of the rectangle to draw (already clipped).
+ * \param height Height of the rectangle to draw (already clipped).
+ * \param opacity Opacity of the source (1 to 255).
+ * \param blend_mode How to combine the source and destination colors.
+ */
+void Compositor::draw_rows_8888(SDL_Surface* src, int src_x, int src_y,
+    SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+    int opacity, Surface::BlendMode blend_mode) {
+
+  const bool has_colorkey = (src->flags & SDL_SRCCOLORKEY) != 0;
+  const uint32_t colorkey = src->format->colorkey;
+  const bool has_alpha = src->format->Amask != 0;
+
+  for (int y = 0; y < height; y++) {
+
+    const uint32_t* src_pixel = (const uint32_t*) ((uint8_t*) src->pixels
+        + (src_y + y) * src->pitch) + src_x;
+    uint32_t* dst_pixel = (uint32_t*) ((uint8_t*) dst->pixels
+        + (dst_y + y) * dst->pitch) + dst_x;
+
+    for (int x = 0; x < width; x++, src_pixel++, dst_pixel++) {
+
+      const uint32_t s = *src_pixel;
+      if (has_colorkey && s == colorkey) {
+        continue;
+      }
+      int alpha = opacity;
+      if (has_alpha) {
+        alpha = multiply_opacities(s >> 24, opacity);
+        if (alpha == 0) {
+          continue;
+        }
+      }
+      const uint32_t alpha_256 = alpha + (alpha >> 7);  // 0 to 256.
+      const uint32_t d = *dst_pixel;
+      uint32_t rb, g;
+
+      switch (blend_mode) {
+
+        case Surface::BLEND_NORMAL:
+          rb = (((s & 0x00ff00ff) * alpha_256
+              + (d & 0x00ff00ff) * (256 - alpha_256)) >> 8) & 0x00ff00ff;
+          g = (((s & 0x0000ff00) * alpha_256
+              + (d & 0x0000ff00) * (256 - alpha_256)) >> 8) & 0x0000ff00;
+          break;
+
+        case Surface::BLEND_ADD:
+        {
+          rb = (d & 0x00ff00ff) + ((((s & 0x00ff00ff) * alpha_256) >> 8) & 0x00ff00ff);
+          g = (d & 0x0000ff00) + ((((s & 0x0000ff00) * alpha_256) >> 8) & 0x0000ff00);
+          // Saturate the channels that overflowed.
+          const uint32_t carry_rb = rb & 0x01000100;
+          const uint32_t carry_g = g & 0x00010000;
+          rb = (rb | (carry_rb - (carry_rb >> 8))) & 0x00ff00ff;
+          g = (g | (carry_g - (carry_g >> 8))) & 0x0000ff00;
+          break;
+        }
+
+        case Surface::BLEND_MULTIPLY:
+        default:
+          rb = multiply_channel(s & 0xff, d & 0xff, alpha, 0xff)
+            | (multiply_channel((s >> 16) & 0xff, (d >> 16) & 0xff, alpha, 0xff) << 16);
+          g = multiply_channel((s >> 8) & 0xff, (d >> 8) & 0xff, alpha, 0xff) << 8;
+          break;
+      }
+
+      *dst_pixel = (d & 0xff000000) | rb | g;
+    }
+  }
+}
+
+/**
+ * \brief Draws pixels between surfaces of any format.
+ *
+ * If the destination has an alpha channel, the normal blend mode combines
+ * the transparency of both surfaces, as if they were drawn one after the
+ * other.
+ *
+ * \param src The source surface (locked).
+ * \param src_x X coordinate of the first pixel to draw in the source.
+ * \param src_y Y coordinate of the first pixel to draw in the source.
+ * \param dst The destination surface (locked).
+ * \param dst_x X coordinate of the destination.
+ * \param dst_y Y coordinate of the destination.
+ * \param width Width of the rectangle to draw (already clipped).
+ * \param height Height of the rectangle to draw (already clipped).
+ * \param opacity Opacity of the source (1 to 255).
+ * \param blend_mode How to combine the source and destination colors.
+ */
+void Compositor::draw_rows_generic(SDL_Surface* src, int src_x, int src_y,
+    SDL_Surface* dst, int dst_x, int dst_y, int width, int height,
+    int opacity, Surface::BlendMode blend_mode) {
+
+  SDL_PixelFormat* src_format = src->format;
+  SDL_PixelFormat* dst_format = dst->format;
+  const bool has_colorkey = (src->flags & SDL_SRCCOLORKEY) != 0;
+  const bool dst_has_alpha = dst_format->Amask != 0;
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+
+      const uint32_t pixel = Surface::read_pixel(src, src_x + x, src_y + y);
+      if (has_colorkey && pixel == src_format->colorkey) {
+        continue;
+      }
+      uint8_t r, g, b, a;
+      SDL_GetRGBA(pixel, src_format, &r, &g, &b, &a);
+      const int alpha = multiply_opacities(a, opacity);
+      if (alpha == 0) {
+        continue;
+      }
+
+      uint8_t dst_r, dst_g, dst_b, dst_a;
+      SDL_GetRGBA(Surface::read_pixel(dst, dst_x + x, dst_y + y), dst_format,
+          &dst_r, &dst_g, &dst_b, &dst_a);
+
+      switch (blend_mode) {
+
+        case Surface::BLEND_NORMAL:
+          if (dst_has_alpha) {
+            // Source over destination, with non-premultiplied colors.
+            const int dst_weight = dst_a * (255 - alpha) / 255;
+            const int result_a = alpha + dst_weight;
+            dst_r = (r * alpha + dst_r * dst_weight) / result_a;
+            dst_g = (g * alpha + dst_g * dst_weight) / result_a;
+            dst_b = (b * alpha + dst_b * dst_weight) / result_a;
+            dst_a = result_a;
+          }
+          else {
+            dst_r = (r * alpha + dst_r * (255 - alpha)) / 255;
+            dst_g = (g * alpha + dst_g * (255 - alpha)) / 255;
+            dst_b = (b * alpha + dst_b * (255 - alpha)) / 255;
+          }
+          break;
+
+        case Surface::BLEND_ADD:
+          dst_r = std::min(255, dst_r + r * alpha / 255);
+          dst_g = std::min(255, dst_g + g * alpha / 255);
+          dst_b = std::min(255, dst_b + b * alpha / 255);
+          break;
+
+        case Surface::BLEND_MULTIPLY:
+        default:
+          dst_r = multiply_channel(r, dst_r, alpha, 0xff);
+          dst_g = multiply_channel(g, dst_g, alpha, 0xff);
+          dst_b = multiply_channel(b, dst_b, alpha, 0xff);
+          break;
+      }
+
+      Surface::write_pixel(dst, dst_x + x, dst_y + y,
+          SDL_MapRGBA(dst_format, dst_r, dst_g, dst_b, dst_a));
+    }
+  }
+}
+
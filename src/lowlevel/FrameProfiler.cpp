@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/FrameProfiler.h"
+#include "lowlevel/System.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/TextSurface.h"
+#include "lowlevel/Color.h"
+#include "lowlevel/Rectangle.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+bool FrameProfiler::enabled = false;
+bool FrameProfiler::overlay_enabled = false;
+std::ofstream FrameProfiler::csv_file;
+uint64_t FrameProfiler::frame_start_date = 0;
+int FrameProfiler::nb_frames = 0;
+int FrameProfiler::nb_updates = 0;
+uint64_t FrameProfiler::section_start_dates[SECTION_NB];
+int FrameProfiler::section_depths[SECTION_NB];
+uint32_t FrameProfiler::section_times[SECTION_NB];
+std::vector<uint32_t> FrameProfiler::history[SECTION_NB];
+bool FrameProfiler::overlay_texts_created = false;
+std::vector<TextSurface*> FrameProfiler::overlay_texts;
+
+namespace {
+
+  /**
+   * \brief Names of the sections in the overlay and in the CSV trace.
+   */
+  const char* section_names[] = {
+    "MainLoop::update",
+    "Game::update",
+    "MapEntities::update",
+    "LuaContext::update",
+    "Map::draw",
+    "MapEntities::draw",
+    "Lua draw callbacks",
+    "VideoManager::draw",
+    "Sound::update"
+  };
+
+  const int overlay_refresh_interval = 10;   /**< number of frames between two refreshes of the overlay texts */
+  const int bar_scale = 100;                 /**< microseconds per pixel in the bars of the overlay */
+}
+
+/**
+ * \brief Initializes the frame profiler.
+ *
+ * The profiler is only enabled if the option
+ * "-frame-profiler[=overlay|csv|all]" is present.
+ * Without value, the statistics are only shown on the screen.
+ *
+ * \param argc command-line arguments number
+ * \param argv command-line arguments
+ */
+void FrameProfiler::initialize(int argc, char** argv) {
+
+  // Check the -frame-profiler option.
+  bool csv_enabled = false;
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+
+    if (arg == "-frame-profiler" || arg == "-frame-profiler=overlay") {
+      enabled = true;
+      overlay_enabled = true;
+    }
+    else if (arg == "-frame-profiler=csv") {
+      enabled = true;
+      csv_enabled = true;
+    }
+    else if (arg == "-frame-profiler=all") {
+      enabled = true;
+      overlay_enabled = true;
+      csv_enabled = true;
+    }
+    else if (arg.find("-frame-profiler=") == 0) {
+      Debug::error(StringConcat() << "Unknown frame profiler mode: '" << arg << "'");
+    }
+  }
+
+  if (!enabled) {
+    return;
+  }
+
+  for (int i = 0; i < SECTION_NB; i++) {
+    section_start_dates[i] = 0;
+    section_depths[i] = 0;
+    section_times[i] = 0;
+    history[i].assign(history_size, 0);
+  }
+
+  if (csv_enabled) {
+    const std::string file_name = "frame_profile.csv";
+    csv_file.open(file_name.c_str());
+    if (!csv_file) {
+      Debug::error(StringConcat() << "Cannot write frame profile '" << file_name << "'");
+    }
+    else {
+      write_csv_header();
+    }
+  }
+
+  frame_start_date = System::get_precise_ticks();
+}
+
+/**
+ * \brief Closes the CSV trace and frees the overlay if the profiler was
+ * enabled.
+ *
+ * This function should be called when exiting the application,
+ * before the low-level systems are closed.
+ */
+void FrameProfiler::quit() {
+
+  if (!enabled) {
+    return;
+  }
+
+  if (csv_file.is_open()) {
+    csv_file.close();
+  }
+
+  std::vector<TextSurface*>::iterator it;
+  for (it = overlay_texts.begin(); it != overlay_texts.end(); ++it) {
+    delete *it;
+  }
+  overlay_texts.clear();
+  overlay_texts_created = false;
+
+  for (int i = 0; i < SECTION_NB; i++) {
+    history[i].clear();
+  }
+  nb_frames = 0;
+  enabled = false;
+  overlay_enabled = false;
+}
+
+/**
+ * \brief Starts measuring a section of the current frame.
+ *
+ * If the section is already running (recursive call), only the outermost
+ * call is measured.
+ *
+ * \param section The section that starts.
+ */
+void FrameProfiler::begin_section(Section section) {
+
+  if (section_depths[section]++ == 0) {
+    section_start_dates[section] = System::get_precise_ticks();
+    if (section == SECTION_MAIN_LOOP_UPDATE) {
+      ++nb_updates;
+    }
+  }
+}
+
+/**
+ * \brief Stops measuring a section of the current frame.
+ * \param section The section that ends.
+ */
+void FrameProfiler::end_section(Section section) {
+
+  Debug::check_assertion(section_depths[section] > 0, StringConcat() <<
+      "Section '" << section_names[section] << "' was not started");
+
+  if (--section_depths[section] == 0) {
+    section_times[section] += uint32_t(
+        System::get_precise_ticks() - section_start_dates[section]);
+  }
+}
+
+/**
+ * \brief Ends the current frame.
+ *
+ * This function should be called after each drawing of the screen.
+ * The measures of the frame are stored in the rolling statistics and
+ * written to the CSV trace.
+ */
+void FrameProfiler::end_frame() {
+
+  uint64_t now = System::get_precise_ticks();
+  uint64_t frame_time = now - frame_start_date;
+  frame_start_date = now;
+
+  const int index = nb_frames % history_size;
+  for (int i = 0; i < SECTION_NB; i++) {
+    history[i][index] = section_times[i];
+  }
+
+  if (csv_file.is_open()) {
+    write_csv_frame(frame_time);
+  }
+
+  for (int i = 0; i < SECTION_NB; i++) {
+    section_times[i] = 0;
+  }
+  nb_updates = 0;
+  ++nb_frames;
+
+  if (overlay_enabled && nb_frames % overlay_refresh_interval == 0) {
+    update_overlay();
+  }
+}
+
+/**
+ * \brief Draws the statistics of the last frames if the overlay is enabled.
+ *
+ * For each section, a green bar shows the average time and a red mark
+ * shows the worst time.
+ * If the quest has a font, the values are also written in milliseconds.
+ *
+ * \param dst_surface The surface where to draw the overlay.
+ */
+void FrameProfiler::draw(Surface& dst_surface) {
+
+  if (!overlay_enabled) {
+    return;
+  }
+
+  if (!overlay_texts_created) {
+    overlay_texts_created = true;
+    for (int i = 0; i < SECTION_NB; i++) {
+      overlay_texts.push_back(new TextSurface(1, 0,
+          TextSurface::ALIGN_LEFT, TextSurface::ALIGN_TOP));
+    }
+    // Creating a text surface loads the fonts if needed: only the next ones
+    // know the default font.
+    const std::string& font_id = overlay_texts.back()->get_font();
+    if (TextSurface::has_font(font_id)) {
+      overlay_texts[0]->set_font(font_id);
+      update_overlay();
+    }
+    else {
+      // No font in this quest: only draw the bars.
+      std::vector<TextSurface*>::iterator it;
+      for (it = overlay_texts.begin(); it != overlay_texts.end(); ++it) {
+        delete *it;
+      }
+      overlay_texts.clear();
+    }
+  }
+
+  Color average_color(0, 192, 0);
+  Color worst_color(255, 0, 0);
+  const int max_width = dst_surface.get_width();
+  int y = 1;
+  for (int i = 0; i < SECTION_NB; i++) {
+
+    uint32_t average, worst;
+    get_statistics(Section(i), average, worst);
+    const int average_width = std::min(max_width, int(average / bar_scale));
+    const int worst_x = std::min(max_width - 1, int(worst / bar_scale));
+
+    int line_height = 4;
+    if (!overlay_texts.empty()) {
+      line_height = std::max(line_height, overlay_texts[i]->get_height() + 1);
+    }
+
+    if (average_width > 0) {
+      dst_surface.fill_with_color(average_color,
+          Rectangle(0, y + line_height - 3, average_width, 2));
+    }
+    dst_surface.fill_with_color(worst_color,
+        Rectangle(worst_x, y + line_height - 4, 1, 4));
+
+    if (!overlay_texts.empty()) {
+      overlay_texts[i]->set_y(y);
+      overlay_texts[i]->draw(dst_surface);
+    }
+    y += line_height;
+  }
+}
+
+/**
+ * \brief Returns the rolling statistics of a section.
+ * \param section A section.
+ * \param average Set to the average time of the section during the last
+ * frames (microseconds).
+ * \param worst Set to the worst time of the section during the last
+ * frames (microseconds).
+ */
+void FrameProfiler::get_statistics(Section section,
+    uint32_t& average, uint32_t& worst) {
+
+  uint64_t sum = 0;
+  worst = 0;
+  for (int i = 0; i < history_size; i++) {
+    sum += history[section][i];
+    worst = std::max(worst, history[section][i]);
+  }
+  const int nb_values = std::max(1, std::min(nb_frames, int(history_size)));
+  average = uint32_t(sum / nb_values);
+}
+
+/**
+ * \brief Writes the first line of the CSV trace.
+ */
+void FrameProfiler::write_csv_header() {
+
+  csv_file << "frame,date,updates";
+  for (int i = 0; i < SECTION_NB; i++) {
+    csv_file << "," << section_names[i];
+  }
+  csv_file << ",frame_time" << std::endl;
+}
+
+/**
+ * \brief Writes the measures of the current frame to the CSV trace.
+ * \param frame_time Wall time of the whole frame (microseconds).
+ */
+void FrameProfiler::write_csv_frame(uint64_t frame_time) {
+
+  csv_file << nb_frames << "," << System::now() << "," << nb_updates;
+  for (int i = 0; i < SECTION_NB; i++) {
+    csv_file << "," << section_times[i];
+  }
+  csv_file << "," << frame_time << "\n";
+}
+
+/**
+ * \brief Updates the texts of the overlay with the rolling statistics.
+ */
+void FrameProfiler::update_overlay() {
+
+  if (overlay_texts.empty()) {
+    return;
+  }
+
+  for (int i = 0; i < SECTION_NB; i++) {
+
+    uint32_t average, worst;
+    get_statistics(Section(i), average, worst);
+
+    std::ostringstream oss;
+    oss << section_names[i] << " " << std::fixed << std::setprecision(2)
+        << (average / 1000.0) << " / " << (worst / 1000.0) << " ms";
+    overlay_texts[i]->set_text(oss.str());
+  }
+}
+
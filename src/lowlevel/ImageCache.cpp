@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/ImageCache.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/FileTools.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <SDL_image.h>
+#include <cstdlib>
+
+size_t ImageCache::memory_budget = 16 * 1024 * 1024;
+size_t ImageCache::memory_used = 0;
+std::map<std::string, ImageCache::Entry> ImageCache::images;
+std::list<std::string> ImageCache::lru_images;
+
+/**
+ * \brief Initializes the image cache.
+ *
+ * The option -image-cache-budget=<megabytes> sets the maximum memory used
+ * by the cache.
+ *
+ * \param argc command-line arguments number
+ * \param argv command-line arguments
+ */
+void ImageCache::initialize(int argc, char** argv) {
+
+  // Check the -image-cache-budget option.
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+
+    if (arg.find("-image-cache-budget=") == 0) {
+      const std::string& budget_string = arg.substr(20);
+      const int budget = std::atoi(budget_string.c_str());
+      if (budget < 0 || (budget == 0 && budget_string != "0")) {
+        Debug::error(StringConcat() << "Invalid image cache budget: '" << arg << "'");
+      }
+      else {
+        memory_budget = size_t(budget) * 1024 * 1024;
+      }
+    }
+  }
+}
+
+/**
+ * \brief Frees all images of the cache.
+ */
+void ImageCache::quit() {
+
+  std::map<std::string, Entry>::iterator it;
+  for (it = images.begin(); it != images.end(); ++it) {
+    SDL_FreeSurface(it->second.surface);  // Surfaces still using it keep it.
+  }
+  images.clear();
+  lru_images.clear();
+  memory_used = 0;
+}
+
+/**
+ * \brief Loads an image file, from the cache if possible.
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param language_specific true if the file is in the directory of the
+ * current language.
+ * \return The SDL surface, or NULL if the file does not exist or is not a
+ * valid image. It may be shared with the cache and with other callers:
+ * the caller must not modify it and must free it with SDL_FreeSurface(),
+ * which only releases its reference.
+ */
+SDL_Surface* ImageCache::load_image(const std::string& file_name,
+    bool language_specific) {
+
+  std::string key = file_name;
+  if (language_specific) {
+    key = FileTools::get_language() + ":" + key;
+  }
+
+  std::map<std::string, Entry>::iterator it = images.find(key);
+  if (it != images.end()) {
+    // The image is in the cache: it is now the most recently used one.
+    Entry& entry = it->second;
+    lru_images.splice(lru_images.begin(), lru_images, entry.lru_position);
+    entry.surface->refcount++;
+    return entry.surface;
+  }
+
+  SDL_Surface* surface = decode_image(file_name, language_specific);
+  if (surface == NULL) {
+    return NULL;
+  }
+
+  const size_t size = size_t(surface->h) * surface->pitch;
+  if (size > memory_budget) {
+    // Too big to be cached.
+    return surface;
+  }
+
+  memory_used += size;
+  while (memory_used > memory_budget) {
+    remove_least_recently_used();
+  }
+
+  lru_images.push_front(key);
+  Entry& entry = images[key];
+  entry.surface = surface;
+  entry.size = size;
+  entry.lru_position = lru_images.begin();
+  surface->refcount++;
+  return surface;
+}
+
+/**
+ * \brief Reads and decodes an image file.
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param language_specific true if the file is in the directory of the
+ * current language.
+ * \return The SDL surface created, converted to the format of the engine,
+ * or NULL if the file does not exist or is not a valid image.
+ */
+SDL_Surface* ImageCache::decode_image(const std::string& file_name,
+    bool language_specific) {
+
+  if (!FileTools::data_file_exists(file_name, language_specific)) {
+    // File not found.
+    return NULL;
+  }
+
+  size_t size;
+  char* buffer;
+  FileTools::data_file_open_buffer(file_name, &buffer, &size, language_specific);
+  SDL_RWops* rw = SDL_RWFromMem(buffer, int(size));
+  SDL_Surface* surface = IMG_Load_RW(rw, 0);
+  FileTools::data_file_close_buffer(buffer);
+  SDL_RWclose(rw);
+
+  if (surface == NULL) {
+    return NULL;
+  }
+  return convert_image(surface);
+}
+
+/**
+ * \brief Converts a decoded image to the pixel format of the engine.
+ *
+ * Images with an alpha channel get the format of Surface::create_with_alpha().
+ * Other images get the format of surfaces created with a size and keep
+ * their transparency color.
+ *
+ * \param surface The decoded image. It is freed by this function.
+ * \return The converted image.
+ */
+SDL_Surface* ImageCache::convert_image(SDL_Surface* surface) {
+
+  Surface* model;
+  if (surface->format->Amask != 0) {
+    model = Surface::create_with_alpha(1, 1);
+  }
+  else {
+    model = new Surface(1, 1);
+  }
+
+  // No RLE acceleration: locking an RLE surface decodes it and unlocking
+  // encodes it again, and images are locked to compare tile patterns,
+  // to compose them with opacity and to copy them into atlas pages.
+  SDL_Surface* converted = SDL_ConvertSurface(surface,
+      model->internal_surface->format,
+      model->internal_surface->flags);
+  delete model;
+
+  if (converted == NULL) {
+    // Keep the original format.
+    return surface;
+  }
+  SDL_FreeSurface(surface);
+  return converted;
+}
+
+/**
+ * \brief Removes the least recently used image from the cache.
+ */
+void ImageCache::remove_least_recently_used() {
+
+  Debug::check_assertion(!lru_images.empty(), "The image cache is empty");
+
+  std::map<std::string, Entry>::iterator it = images.find(lru_images.back());
+  memory_used -= it->second.size;
+  SDL_FreeSurface(it->second.surface);  // Surfaces still using it keep it.
+  images.erase(it);
+  lru_images.pop_back();
+}
+
@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "lowlevel/InputEvent.h"
+#include "lowlevel/Replay.h"
 
 const InputEvent::KeyboardKey InputEvent::directional_keys[] = {
     KEY_RIGHT,
@@ -203,6 +204,15 @@ InputEvent* InputEvent::get_event() {
 
   InputEvent* result = NULL;
   SDL_Event internal_event;
+
+  if (Replay::is_replaying()) {
+    // Only the recorded events are used.
+    if (Replay::get_event(internal_event)) {
+      result = new InputEvent(internal_event);
+    }
+    return result;
+  }
+
   if (SDL_PollEvent(&internal_event)) {
 
     // ignore intermediate positions of joystick axis
@@ -211,6 +221,9 @@ InputEvent* InputEvent::get_event() {
         || internal_event.jaxis.value >= 10000) {
 
       result = new InputEvent(internal_event);
+      if (Replay::is_recording()) {
+        Replay::record_event(internal_event);
+      }
     }
   }
 
@@ -237,6 +250,11 @@ void InputEvent::set_key_repeat(int delay, int interval) {
  */
 bool InputEvent::is_shift_down() {
 
+  if (Replay::is_replaying()) {
+    return Replay::is_key_down(KEY_LEFT_SHIFT)
+        || Replay::is_key_down(KEY_RIGHT_SHIFT);
+  }
+
   SDLMod mod = SDL_GetModState();
   return mod & (KMOD_LSHIFT | KMOD_RSHIFT);
 }
@@ -250,6 +268,11 @@ bool InputEvent::is_shift_down() {
  */
 bool InputEvent::is_control_down() {
 
+  if (Replay::is_replaying()) {
+    return Replay::is_key_down(KEY_LEFT_CONTROL)
+        || Replay::is_key_down(KEY_RIGHT_CONTROL);
+  }
+
   SDLMod mod = SDL_GetModState();
   return mod & (KMOD_LCTRL | KMOD_RCTRL);
 }
@@ -263,6 +286,11 @@ bool InputEvent::is_control_down() {
  */
 bool InputEvent::is_alt_down() {
 
+  if (Replay::is_replaying()) {
+    return Replay::is_key_down(KEY_LEFT_ALT)
+        || Replay::is_key_down(KEY_RIGHT_ALT);
+  }
+
   SDLMod mod = SDL_GetModState();
   return mod & (KMOD_LALT | KMOD_RALT);
 }
@@ -274,6 +302,10 @@ bool InputEvent::is_alt_down() {
  */
 bool InputEvent::is_key_down(KeyboardKey key) {
 
+  if (Replay::is_replaying()) {
+    return Replay::is_key_down(key);
+  }
+
   int num_keys = 0;
   Uint8* keys_state = SDL_GetKeyState(&num_keys);
   return keys_state[key];
@@ -286,6 +318,10 @@ bool InputEvent::is_key_down(KeyboardKey key) {
  */
 bool InputEvent::is_joypad_button_down(int button) {
 
+  if (Replay::is_replaying()) {
+    return Replay::is_joypad_button_down(button);
+  }
+
   if (joystick == NULL) {
     return false;
   }
@@ -301,11 +337,16 @@ bool InputEvent::is_joypad_button_down(int button) {
  */
 int InputEvent::get_joypad_axis_state(int axis) {
 
-  if (joystick == NULL) {
+  int state;
+  if (Replay::is_replaying()) {
+    state = Replay::get_joypad_axis(axis);
+  }
+  else if (joystick == NULL) {
     return 0;
   }
-
-  int state = SDL_JoystickGetAxis(joystick, axis);
+  else {
+    state = SDL_JoystickGetAxis(joystick, axis);
+  }
 
   int result;
   if (abs(state) < 10000) {
@@ -325,11 +366,16 @@ int InputEvent::get_joypad_axis_state(int axis) {
  */
 int InputEvent::get_joypad_hat_direction(int hat) {
 
-  if (joystick == NULL) {
+  int state;
+  if (Replay::is_replaying()) {
+    state = Replay::get_joypad_hat(hat);
+  }
+  else if (joystick == NULL) {
     return -1;
   }
-
-  int state = SDL_JoystickGetHat(joystick, hat);
+  else {
+    state = SDL_JoystickGetHat(joystick, hat);
+  }
   int result = -1;
 
   switch (state) {
@@ -684,7 +730,7 @@ void InputEvent::set_joypad_enabled(bool joypad_enabled) {
       joystick = NULL;
     }
 
-    if (joypad_enabled && SDL_NumJoysticks() > 0) {
+    if (joypad_enabled && SDL_NumJoysticks() > 0 && !Replay::is_replaying()) {
         SDL_InitSubSystem(SDL_INIT_JOYSTICK);
         joystick = SDL_JoystickOpen(0);
     }
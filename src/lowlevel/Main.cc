@@ -40,6 +40,13 @@ static void print_help(int argc, char** argv);
  *   -no-audio           disables sounds and musics
  *   -no-video           disables displaying (used for unitary tests)
  *   -quest-size=<width>x<height>         sets the size of the drawing area (if compatible with the quest)
+ *   -lua-profiler[=flat|folded]          measures Lua callbacks and writes a report when exiting
+ *   -lua-profiler-sampling[=<instructions>]  also samples the Lua call stack every n instructions
+ *   -image-cache-budget=<megabytes>      sets the memory used to keep image files loaded (16 by default)
+ *   -frame-profiler[=overlay|csv|all]    measures the main parts of each frame
+ *   -record-inputs=<file>                records the input events to a file
+ *   -replay=<file>                       replays recorded input events without window nor audio and measures each frame
+ *   -record-step=<milliseconds>          sets the simulated time of a cycle during a recording (10 by default)
  *
  * \param argc number of command-line arguments
  * \param argv command-line arguments
@@ -92,6 +99,50 @@ static void print_help(int argc, char **argv) {
     << "  -no-audio           disables sounds and musics"
     << std::endl
     << "  -no-video           disables displaying (may be useful for tests)"
+    << std::endl
+    << "  -lua-profiler[=flat|folded]"
+    << std::endl
+    << "                      measures the time spent in Lua callbacks and writes"
+    << std::endl
+    << "                      lua_profile.txt (flat) or lua_profile.folded"
+    << std::endl
+    << "                      (flame graph stacks) when exiting"
+    << std::endl
+    << "  -lua-profiler-sampling[=<instructions>]"
+    << std::endl
+    << "                      also samples the Lua call stack every n instructions"
+    << std::endl
+    << "  -image-cache-budget=<megabytes>"
+    << std::endl
+    << "                      sets the memory used to keep image files loaded"
+    << std::endl
+    << "                      (16 by default, 0 to disable)"
+    << std::endl
+    << "  -frame-profiler[=overlay|csv|all]"
+    << std::endl
+    << "                      measures the main parts of each frame and shows them"
+    << std::endl
+    << "                      on the screen (overlay) and/or writes them to"
+    << std::endl
+    << "                      frame_profile.csv (csv)"
+    << std::endl
+    << "  -record-inputs=<file>"
+    << std::endl
+    << "                      records the keyboard and joypad events to a file"
+    << std::endl
+    << "  -replay=<file>"
+    << std::endl
+    << "                      replays recorded events without window nor audio,"
+    << std::endl
+    << "                      with a simulated clock, and writes the time of each"
+    << std::endl
+    << "                      frame to replay_stats.csv"
+    << std::endl
+    << "  -record-step=<milliseconds>"
+    << std::endl
+    << "                      sets the simulated time of a cycle during a recording"
+    << std::endl
+    << "                      (10 by default), replays use the same one"
     << std::endl;
 }
 
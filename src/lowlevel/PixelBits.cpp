@@ -20,57 +20,83 @@
 #include "lowlevel/Debug.h"
 #include "lowlevel/System.h"
 #include <SDL.h>
+#include <algorithm>
 #include <iostream> // print functions
 
 /**
  * \brief Creates a pixel bits object.
  * \param surface the surface where the image is
  * \param image_position position of the image on this surface
+ * \param bounds region of the surface that belongs to the image: pixels
+ * of image_position outside it are considered transparent
  */
-PixelBits::PixelBits(Surface& surface, const Rectangle& image_position) {
+PixelBits::PixelBits(Surface& surface, const Rectangle& image_position,
+    const Rectangle& bounds) {
 
   SDL_PixelFormat* format = surface.get_internal_surface()->format;
 
   // Create a list of boolean values representing the transparency of each pixel.
   // This list is implemented as bit fields.
 
-  uint32_t colorkey = format->colorkey;
+  // Transparent pixels have the transparency color, or an alpha value of zero
+  // for surfaces with an alpha channel (like sprite atlas pages).
+  // Surfaces with neither (like opaque atlas pages) only have opaque pixels.
+  const bool has_colorkey = surface.has_transparency_color();
+  const uint32_t colorkey = has_colorkey ? format->colorkey : 0;
+  const uint32_t alpha_mask = surface.has_alpha_channel() ? format->Amask : 0;
+  const bool all_opaque = !has_colorkey && alpha_mask == 0;
 
   width = image_position.get_width();
   height = image_position.get_height();
 
-  nb_integers_per_row = width >> 5; // width / 32
-  if ((width & 31) != 0) { // width % 32 != 0
-    nb_integers_per_row++;
-  }
-
-  int pixel_index = image_position.get_y() * surface.get_width() + image_position.get_x();
-
-  bits = new uint32_t*[height];
-  for (int i = 0; i < height; i++) {
-    bits[i] = new uint32_t[nb_integers_per_row];
-
-    // Fill the bits for this row, using nb_integers_per_row sequences of 32 bits.
-    int k = -1;
-    uint32_t mask = 0x00000000;  // Current bit in the sequence of 32 bits.
-    for (int j = 0; j < width; j++) {
-      if (mask == 0x00000000) {
-        // Time for a new sequence of 32 bits.
-        k++;
-        mask = 0x80000000;
-        bits[i][k] = 0x00000000;  // Initialize the sequence to transparent.
+  nb_words_per_row = ((width + 63) >> 6) + 1; // width / 64 rounded up, plus a zero word
+  bits.assign(nb_words_per_row * height, 0);
+  row_min_x.assign(height, width);
+  row_max_x.assign(height, -1);
+
+  // Only read the pixels inside the bounds and the surface.
+  const int first_i = std::max(0, std::max(bounds.get_y(), 0) - image_position.get_y());
+  const int last_i = std::min(height, std::min(bounds.get_y() + bounds.get_height(),
+      surface.get_height()) - image_position.get_y());
+  const int first_j = std::max(0, std::max(bounds.get_x(), 0) - image_position.get_x());
+  const int last_j = std::min(width, std::min(bounds.get_x() + bounds.get_width(),
+      surface.get_width()) - image_position.get_x());
+
+  SDL_Surface* internal_surface = surface.get_internal_surface();
+  const int bytes_per_pixel = format->BytesPerPixel;
+  SDL_LockSurface(internal_surface);
+
+  for (int i = first_i; i < last_i; i++) {
+    uint64_t* row = &bits[i * nb_words_per_row];
+    const int y = image_position.get_y() + i;
+    const uint8_t* pixels = (uint8_t*) internal_surface->pixels
+        + y * internal_surface->pitch + image_position.get_x() * bytes_per_pixel;
+
+    for (int j = first_j; j < last_j; j++) {
+
+      // Images are converted to 16 or 32 bits when loaded.
+      uint32_t pixel;
+      if (bytes_per_pixel == 4) {
+        pixel = ((const uint32_t*) pixels)[j];
+      }
+      else if (bytes_per_pixel == 2) {
+        pixel = ((const uint16_t*) pixels)[j];
+      }
+      else {
+        pixel = Surface::read_pixel(internal_surface, image_position.get_x() + j, y);
       }
 
-      if (!surface.get_pixel32(pixel_index) == colorkey) {
+      if (all_opaque
+          || (alpha_mask != 0 ? (pixel & alpha_mask) != 0 : pixel != colorkey)) {
         // The pixel is opaque.
-        bits[i][k] |= mask;
+        row[j >> 6] |= uint64_t(1) << (63 - (j & 63));
+        row_min_x[i] = std::min(row_min_x[i], j);
+        row_max_x[i] = j;
       }
-
-      mask >>= 1;
-      pixel_index++;
     }
-    pixel_index += surface.get_width() - width;
   }
+
+  SDL_UnlockSurface(internal_surface);
 }
 
 /**
@@ -78,10 +104,26 @@ PixelBits::PixelBits(Surface& surface, const Rectangle& image_position) {
  */
 PixelBits::~PixelBits() {
 
-  for (int i = 0; i < height; i++) {
-    delete[] bits[i];
+}
+
+/**
+ * \brief Returns 64 consecutive bits of a row.
+ *
+ * Bits after the end of the row are zero.
+ *
+ * \param row A row of the image.
+ * \param x X coordinate of the first pixel to get, between 0 and width - 1.
+ * \return The bits of pixels x to x + 63, pixel x being the most significant bit.
+ */
+uint64_t PixelBits::get_bits(int row, int x) const {
+
+  const uint64_t* words = &bits[row * nb_words_per_row + (x >> 6)];
+  const int shift = x & 63;
+  if (shift == 0) {
+    return words[0];
   }
-  delete[] bits;
+  // The last word of a row is always zero: words[1] exists.
+  return (words[0] << shift) | (words[1] >> (64 - shift));
 }
 
 /**
@@ -115,119 +157,48 @@ bool PixelBits::test_collision(const PixelBits& other, const Rectangle& location
     other.print();
   }
 
-  // compute the intersection between the two rectangles
-  Rectangle intersection;
-  intersection.set_x(std::max(bounding_box1.get_x(), bounding_box2.get_x()));
-  intersection.set_y(std::max(bounding_box1.get_y(), bounding_box2.get_y()));
-  intersection.set_width(std::min(bounding_box1.get_x() + bounding_box1.get_width(),
-      bounding_box2.get_x() + bounding_box2.get_width()) - intersection.get_x());
-  intersection.set_height(std::min(bounding_box1.get_y() + bounding_box1.get_height(),
-      bounding_box2.get_y() + bounding_box2.get_height()) - intersection.get_y());
-
-  if (debug_pixel_collisions) {
-    std::cout << "intersection: " << intersection << "\n";
-  }
-
-  // compute the relative position of the intersection rectangle for each bounding_box
-  int offset_x1 = intersection.get_x() - bounding_box1.get_x();
-  int offset_y1 = intersection.get_y() - bounding_box1.get_y();
-
-  int offset_x2 = intersection.get_x() - bounding_box2.get_x();
-  int offset_y2 = intersection.get_y() - bounding_box2.get_y();
-
-  if (debug_pixel_collisions) {
-    std::cout << "offset_x1 = " << offset_x1 << ", offset_y1 = " << offset_y1;
-    std::cout << ", offset_x2 = " << offset_x2 << ", offset_y2 = " << offset_y2 << std::endl;
-  }
-
-  /*
-   * For each row of the intersection, we will call row 'a' the row coming from the right bounding box
-   * and row 'b' the one coming from the left bounding box.
-   */
-
-  uint32_t** rows_a;           // for each row: array of masks of the right bounding box
-  uint32_t** rows_b;           // for each row: array of masks of the left bounding box
-
-  uint32_t* bits_a;            // for the current row: array of masks of the right bounding box
-  uint32_t* bits_b;            // for the current row: array of masks of the left bounding box
-
-  int nb_masks_per_row_a;    // number of masks on row a that are in the intersection (row b may have one more mask)
-  int nb_masks_per_row_b;    // number of masks on row b that are in the intersection
-  int nb_unused_masks_row_b; // number of unused masks on row b (i.e. before the intersection)
-  int nb_unused_bits_row_b;  // number of unused bits on the first used mask of row b
-  int nb_used_bits_row_b;    // number of bits used on the first used mask of row b
-
-  // make sure row a starts after row b
-  if (bounding_box1.get_x() > bounding_box2.get_x()) {
-    rows_a = &this->bits[offset_y1];
-    rows_b = &other.bits[offset_y2];
-    nb_unused_masks_row_b = offset_x2 >> 5;
-    nb_unused_bits_row_b = offset_x2 & 31;
-  }
-  else {
-    rows_a = &other.bits[offset_y2];
-    rows_b = &this->bits[offset_y1];
-    nb_unused_masks_row_b = offset_x1 >> 5;
-    nb_unused_bits_row_b = offset_x1 & 31;
-  }
-  nb_used_bits_row_b = 32 - nb_unused_bits_row_b;
-
-  // compute the number of masks in the intersection on row a
-  nb_masks_per_row_a = intersection.get_width() >> 5;
-  if ((intersection.get_width() & 31) != 0) {
-    nb_masks_per_row_a++;
-  }
+  const int x1 = bounding_box1.get_x();
+  const int y1 = bounding_box1.get_y();
+  const int x2 = bounding_box2.get_x();
+  const int y2 = bounding_box2.get_y();
 
-  // compute the number of masks in the intersection on row b
-  nb_masks_per_row_b = (intersection.get_width() + nb_unused_bits_row_b) >> 5;
-  if (((intersection.get_width() + nb_unused_bits_row_b) & 31) != 0) {
-    nb_masks_per_row_b++;
-  }
+  // compute the intersection between the two rectangles (in map coordinates)
+  const int min_x = std::max(x1, x2);
+  const int max_x = std::min(x1 + width, x2 + other.width) - 1;
+  const int min_y = std::max(y1, y2);
+  const int max_y = std::min(y1 + height, y2 + other.height) - 1;
 
   // check the collisions each row of the intersection rectangle
-  bool collision = false;
-  for (int i = 0; i < intersection.get_height() && !collision; i++) {
+  for (int y = min_y; y <= max_y; y++) {
 
-    // current row
-    bits_a = rows_a[i];
-    bits_b = rows_b[i];
+    const int row1 = y - y1;
+    const int row2 = y - y2;
 
-    if (debug_pixel_collisions) {
-      std::cout << "*** checking row " << i << " of the intersection rectangle\n";
-    }
+    // Only compare the span where both rows have opaque pixels.
+    const int span_min_x = std::max(min_x,
+        std::max(x1 + row_min_x[row1], x2 + other.row_min_x[row2]));
+    const int span_max_x = std::min(max_x,
+        std::min(x1 + row_max_x[row1], x2 + other.row_max_x[row2]));
 
-    // check each mask
-    for (int j = 0; j < nb_masks_per_row_a && !collision; j++) {
-
-      /*
-       * We compare the left of a with the right part of b,
-       * and the right part of a with the right part of the next b if any.
-       */
-
-      uint32_t mask_a = bits_a[j];
-      uint32_t mask_b = bits_b[j + nb_unused_masks_row_b];
-      uint32_t mask_a_left = mask_a >> nb_unused_bits_row_b;
-      uint32_t next_mask_b_left = 0x00000000;
-      if (j + 1 < nb_masks_per_row_a ||            // Not the last a-mask.
-          nb_masks_per_row_b > nb_masks_per_row_a  // Last a-mask but there exists one more b-mask.
-          ) {
-        // We are still inside the intersection: next_mask_b_left exists.
-        next_mask_b_left = bits_b[j + nb_unused_masks_row_b + 1] >> nb_used_bits_row_b;
-      }
+    for (int x = span_min_x; x <= span_max_x; x += 64) {
 
-      if (debug_pixel_collisions) {
-        std::cout << "mask_a = ";
-        print_mask(mask_a);
-        std::cout << ", mask b = ";
-        print_mask(mask_b);
-        std::cout << "\n";
+      uint64_t mask = get_bits(row1, x - x1) & other.get_bits(row2, x - x2);
+      const int nb_remaining_bits = span_max_x - x + 1;
+      if (nb_remaining_bits < 64) {
+        // Ignore the bits after the span.
+        mask &= ~uint64_t(0) << (64 - nb_remaining_bits);
       }
 
-      collision = ((mask_a_left & mask_b) | (mask_a & next_mask_b_left)) != 0x00000000;
+      if (mask != 0) {
+        if (debug_pixel_collisions) {
+          std::cout << "collision on row " << y << " at x = " << x << std::endl;
+        }
+        return true;
+      }
     }
   }
- 
-  return collision;
+
+  return false;
 }
 
 /**
@@ -237,36 +208,11 @@ void PixelBits::print() const {
 
   std::cout << "frame size is " << width << " x " << height << std::endl;
   for (int i = 0; i < height; i++) {
-    int k = -1;
-    uint32_t mask = 0x00000000;
     for (int j = 0; j < width; j++) {
-
-      if (mask == 0x00000000) {
-        k++;
-        mask = 0x80000000;
-      }
-
-      if (bits[i][k] & mask) {
-        std::cout << "X";
-      }
-      else {
-        std::cout << ".";
-      }
-
-      mask >>= 1;
+      const uint64_t word = bits[i * nb_words_per_row + (j >> 6)];
+      std::cout << (((word >> (63 - (j & 63))) & 1) ? "X" : ".");
     }
     std::cout << std::endl;
   }
 }
 
-/**
- * \brief Prints an ASCII representation of a 32-bit mask (for debugging purposes only).
- */
-void PixelBits::print_mask(uint32_t mask) const {
-
-  for (int i = 0; i < 32; i++) {
-    std::cout << (((mask & 0x80000000) != 0x00000000) ? "X" : ".");
-    mask <<= 1;
-  }
-}
-
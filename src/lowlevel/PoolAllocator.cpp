@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/PoolAllocator.h"
+#include "lowlevel/Debug.h"
+#include <algorithm>
+#include <new>
+
+/**
+ * \brief Creates a pool allocator.
+ * \param object_size Size of the objects to allocate.
+ * \param blocks_per_chunk Number of objects to reserve each time the pool
+ * needs more memory.
+ */
+PoolAllocator::PoolAllocator(size_t object_size, int blocks_per_chunk):
+  object_size(object_size),
+  block_size(((std::max(object_size, sizeof(FreeBlock)) + sizeof(double) - 1)
+      / sizeof(double)) * sizeof(double)),
+  blocks_per_chunk(blocks_per_chunk),
+  free_blocks(NULL),
+  num_blocks_used(0) {
+
+  Debug::check_assertion(blocks_per_chunk > 0, "Invalid number of blocks per chunk");
+}
+
+/**
+ * \brief Destroys the pool and releases all its memory.
+ *
+ * Objects still allocated from this pool become invalid.
+ */
+PoolAllocator::~PoolAllocator() {
+
+  std::vector<char*>::iterator it;
+  for (it = chunks.begin(); it != chunks.end(); ++it) {
+    delete[] *it;
+  }
+}
+
+/**
+ * \brief Allocates memory for an object.
+ * \param size Size of the object. If this is not the size of objects of this
+ * pool, the memory is obtained from the global operator new.
+ * \return The allocated memory.
+ */
+void* PoolAllocator::allocate(size_t size) {
+
+  if (size != object_size) {
+    return ::operator new(size);
+  }
+
+  if (free_blocks == NULL) {
+    add_chunk();
+  }
+
+  FreeBlock* block = free_blocks;
+  free_blocks = block->next;
+  ++num_blocks_used;
+  return block;
+}
+
+/**
+ * \brief Releases memory obtained from allocate().
+ * \param block The memory to release (can be NULL).
+ * \param size Size of the object, as passed to allocate().
+ */
+void PoolAllocator::deallocate(void* block, size_t size) {
+
+  if (block == NULL) {
+    return;
+  }
+
+  if (size != object_size) {
+    ::operator delete(block);
+    return;
+  }
+
+  FreeBlock* free_block = static_cast<FreeBlock*>(block);
+  free_block->next = free_blocks;
+  free_blocks = free_block;
+  --num_blocks_used;
+}
+
+/**
+ * \brief Returns the number of objects currently allocated from this pool.
+ * \return The number of blocks in use.
+ */
+int PoolAllocator::get_num_blocks_used() const {
+  return num_blocks_used;
+}
+
+/**
+ * \brief Obtains a new chunk of memory and adds its blocks to the free list.
+ */
+void PoolAllocator::add_chunk() {
+
+  char* chunk = new char[block_size * blocks_per_chunk];
+  chunks.push_back(chunk);
+
+  // Link the new blocks in the order of their addresses.
+  for (int i = blocks_per_chunk - 1; i >= 0; --i) {
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * block_size);
+    block->next = free_blocks;
+    free_blocks = block;
+  }
+}
+
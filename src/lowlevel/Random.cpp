@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "lowlevel/Random.h"
+#include "lowlevel/Replay.h"
 #include <ctime>
 #include <cstdlib>
 
@@ -22,7 +23,14 @@
  * \brief Initializes the random number generator.
  */
 void Random::initialize() {
-  srand((int) time(NULL));
+
+  if (Replay::is_recording() || Replay::is_replaying()) {
+    // Make the replays reproducible.
+    srand(0);
+  }
+  else {
+    srand((int) time(NULL));
+  }
 }
 
 /**
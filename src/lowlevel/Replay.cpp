@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/Replay.h"
+#include "lowlevel/System.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+bool Replay::recording = false;
+std::ofstream Replay::record_file;
+uint64_t Replay::record_start_date = 0;
+bool Replay::replaying = false;
+uint32_t Replay::time_step = 10;
+uint32_t Replay::date = 0;
+int Replay::end_cycle = 0;
+std::vector<Replay::RecordedEvent> Replay::events;
+unsigned int Replay::next_event = 0;
+std::set<int> Replay::keys_down;
+std::set<int> Replay::joypad_buttons_down;
+std::map<int, int> Replay::joypad_axes;
+std::map<int, int> Replay::joypad_hats;
+std::ofstream Replay::stats_file;
+uint64_t Replay::frame_start_date = 0;
+int Replay::nb_cycles = 0;
+int Replay::total_cycles = 0;
+std::vector<uint32_t> Replay::frame_times;
+
+/**
+ * \brief Initializes the recording or the replay of input events.
+ *
+ * The option "-record-inputs=<file>" records the input events, with
+ * a simulated time step that can be set with "-record-step=<milliseconds>".
+ * The option "-replay=<file>" replays them in a headless benchmark, with
+ * the time step of the recording.
+ *
+ * This function must be called before SDL is initialized.
+ *
+ * \param argc command-line arguments number
+ * \param argv command-line arguments
+ */
+void Replay::initialize(int argc, char** argv) {
+
+  // Check the -record-inputs, -record-step and -replay options.
+  std::string record_file_name;
+  std::string replay_file_name;
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+
+    if (arg.find("-record-inputs=") == 0) {
+      record_file_name = arg.substr(15);
+    }
+    else if (arg.find("-record-step=") == 0) {
+      int step = std::atoi(arg.substr(13).c_str());
+      if (step <= 0) {
+        Debug::error(StringConcat() << "Invalid record step: '" << arg << "'");
+      }
+      else {
+        time_step = step;
+      }
+    }
+    else if (arg.find("-replay=") == 0) {
+      replay_file_name = arg.substr(8);
+    }
+  }
+
+  if (!replay_file_name.empty()) {
+
+    if (!record_file_name.empty()) {
+      Debug::error("Cannot record input events during a replay");
+    }
+
+    replaying = true;
+    load_events(replay_file_name);
+
+    // No window: SDL draws into a surface in memory.
+    putenv((char*) "SDL_VIDEODRIVER=dummy");
+
+    const std::string stats_file_name = "replay_stats.csv";
+    stats_file.open(stats_file_name.c_str());
+    if (!stats_file) {
+      Debug::error(StringConcat() << "Cannot write replay statistics '" << stats_file_name << "'");
+    }
+    else {
+      stats_file << "frame,cycles,date,frame_time" << std::endl;
+    }
+    frame_start_date = System::get_precise_ticks();
+  }
+  else if (!record_file_name.empty()) {
+
+    record_file.open(record_file_name.c_str());
+    if (!record_file) {
+      Debug::error(StringConcat() << "Cannot write input recording '" << record_file_name << "'");
+    }
+    else {
+      recording = true;
+      record_file << "# Solarus input recording" << std::endl;
+      record_file << "0 time_step " << time_step << std::endl;
+    }
+  }
+}
+
+/**
+ * \brief Ends the recording or the replay.
+ *
+ * When recording, the end of the recording is written.
+ * When replaying, the summary of the frame times is printed.
+ */
+void Replay::quit() {
+
+  if (recording) {
+    record_file << total_cycles << " end" << std::endl;
+    record_file.close();
+    recording = false;
+  }
+
+  if (replaying) {
+    print_statistics();
+    if (stats_file.is_open()) {
+      stats_file.close();
+    }
+    events.clear();
+    keys_down.clear();
+    joypad_buttons_down.clear();
+    joypad_axes.clear();
+    joypad_hats.clear();
+    frame_times.clear();
+    replaying = false;
+  }
+}
+
+/**
+ * \brief Returns whether the input events are being recorded.
+ * \return true if the input events are recorded.
+ */
+bool Replay::is_recording() {
+  return recording;
+}
+
+/**
+ * \brief Returns whether recorded input events are being replayed.
+ *
+ * In this case, the clock is simulated and the real input events are
+ * ignored.
+ *
+ * \return true in a replay.
+ */
+bool Replay::is_replaying() {
+  return replaying;
+}
+
+/**
+ * \brief Returns whether the end of the recording is reached.
+ * \return true if the replay is finished.
+ */
+bool Replay::is_finished() {
+
+  return replaying
+      && next_event >= events.size()
+      && total_cycles >= end_cycle;
+}
+
+/**
+ * \brief Returns whether System::now() is simulated.
+ *
+ * This is the case when recording and when replaying: the clock advances
+ * by a fixed step at each cycle (see update()).
+ *
+ * \return true if the clock is simulated.
+ */
+bool Replay::is_clock_simulated() {
+  return recording || replaying;
+}
+
+/**
+ * \brief Advances the simulated clock by one time step.
+ *
+ * This function is called at each cycle of the main loop during a
+ * recording or a replay.
+ * When recording, it waits until the real time reaches the simulated
+ * clock, so that the game runs at its normal speed.
+ */
+void Replay::update() {
+
+  date += time_step;
+  ++nb_cycles;
+  ++total_cycles;
+
+  if (recording) {
+    const uint64_t now = System::get_precise_ticks();
+    if (total_cycles == 1) {
+      record_start_date = now;
+    }
+    const uint64_t real_date = (now - record_start_date) / 1000 + time_step;
+    if (date > real_date) {
+      SDL_Delay(uint32_t(date - real_date));
+    }
+  }
+}
+
+/**
+ * \brief Returns the current simulated date.
+ * \return The number of simulated milliseconds since the beginning of the
+ * recording or of the replay.
+ */
+uint32_t Replay::get_date() {
+  return date;
+}
+
+/**
+ * \brief Stores the real time of the frame that was just drawn.
+ *
+ * This function is called after each drawing of the screen during a replay.
+ */
+void Replay::end_frame() {
+
+  uint64_t now = System::get_precise_ticks();
+  uint32_t frame_time = uint32_t(now - frame_start_date);
+  frame_start_date = now;
+
+  if (stats_file.is_open()) {
+    stats_file << frame_times.size() << "," << nb_cycles << ","
+        << date << "," << frame_time << "\n";
+  }
+  frame_times.push_back(frame_time);
+  nb_cycles = 0;
+}
+
+/**
+ * \brief Writes an input event to the recording.
+ *
+ * Only keyboard, joypad and window closing events are recorded, with the
+ * index of the current cycle.
+ *
+ * \param event An input event that was just received.
+ */
+void Replay::record_event(const SDL_Event& event) {
+
+  switch (event.type) {
+
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      record_file << total_cycles
+          << (event.type == SDL_KEYDOWN ? " key_pressed " : " key_released ")
+          << int(event.key.keysym.sym) << " " << int(event.key.keysym.mod)
+          << " " << int(event.key.keysym.unicode) << "\n";
+      break;
+
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+      record_file << total_cycles
+          << (event.type == SDL_JOYBUTTONDOWN ? " joypad_button_pressed " : " joypad_button_released ")
+          << int(event.jbutton.button) << "\n";
+      break;
+
+    case SDL_JOYAXISMOTION:
+      record_file << total_cycles << " joypad_axis_moved "
+          << int(event.jaxis.axis) << " " << int(event.jaxis.value) << "\n";
+      break;
+
+    case SDL_JOYHATMOTION:
+      record_file << total_cycles << " joypad_hat_moved "
+          << int(event.jhat.hat) << " " << int(event.jhat.value) << "\n";
+      break;
+
+    case SDL_QUIT:
+      record_file << total_cycles << " window_closing\n";
+      break;
+  }
+}
+
+/**
+ * \brief Returns the next recorded event if its cycle is reached.
+ * \param event Where to store the event.
+ * \return true if there was an event to replay.
+ */
+bool Replay::get_event(SDL_Event& event) {
+
+  if (next_event >= events.size()
+      || events[next_event].cycle > total_cycles) {
+    return false;
+  }
+
+  event = events[next_event].event;
+  ++next_event;
+  update_input_state(event);
+  return true;
+}
+
+/**
+ * \brief Returns whether a keyboard key is pressed in the replay.
+ * \param key A keyboard key.
+ * \return true if this key is pressed.
+ */
+bool Replay::is_key_down(int key) {
+  return keys_down.find(key) != keys_down.end();
+}
+
+/**
+ * \brief Returns whether a joypad button is pressed in the replay.
+ * \param button A joypad button.
+ * \return true if this button is pressed.
+ */
+bool Replay::is_joypad_button_down(int button) {
+  return joypad_buttons_down.find(button) != joypad_buttons_down.end();
+}
+
+/**
+ * \brief Returns the value of a joypad axis in the replay.
+ * \param axis A joypad axis.
+ * \return Its value, as returned by SDL_JoystickGetAxis().
+ */
+int Replay::get_joypad_axis(int axis) {
+
+  std::map<int, int>::const_iterator it = joypad_axes.find(axis);
+  return (it != joypad_axes.end()) ? it->second : 0;
+}
+
+/**
+ * \brief Returns the value of a joypad hat in the replay.
+ * \param hat A joypad hat.
+ * \return Its value, as returned by SDL_JoystickGetHat().
+ */
+int Replay::get_joypad_hat(int hat) {
+
+  std::map<int, int>::const_iterator it = joypad_hats.find(hat);
+  return (it != joypad_hats.end()) ? it->second : SDL_HAT_CENTERED;
+}
+
+/**
+ * \brief Reads the input events to replay.
+ *
+ * Each line of the file is an event: the index of its cycle, its type
+ * and its parameters. Events must be in chronological order.
+ * A line of type time_step gives the simulated time of a cycle.
+ *
+ * \param file_name The file written by a previous recording.
+ */
+void Replay::load_events(const std::string& file_name) {
+
+  std::ifstream in(file_name.c_str());
+  if (!in) {
+    Debug::die(StringConcat() << "Cannot read input recording '" << file_name << "'");
+  }
+
+  bool has_end = false;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    ++line_number;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream iss(line);
+    RecordedEvent recorded_event;
+    std::string type;
+    std::memset(&recorded_event.event, 0, sizeof(SDL_Event));
+    SDL_Event& event = recorded_event.event;
+    bool valid = (iss >> recorded_event.cycle >> type);
+    int first = 0, second = 0, third = 0;
+
+    if (!valid) {
+      // Invalid cycle or no type.
+    }
+    else if (type == "end") {
+      end_cycle = recorded_event.cycle;
+      has_end = true;
+      continue;
+    }
+    else if (type == "time_step") {
+      valid = (iss >> first) && first > 0;
+      if (valid) {
+        time_step = first;
+        continue;
+      }
+    }
+    else if (type == "key_pressed" || type == "key_released") {
+      valid = (iss >> first >> second >> third);
+      bool pressed = (type == "key_pressed");
+      event.type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
+      event.key.state = pressed ? SDL_PRESSED : SDL_RELEASED;
+      event.key.keysym.sym = SDLKey(first);
+      event.key.keysym.mod = SDLMod(second);
+      event.key.keysym.unicode = Uint16(third);
+    }
+    else if (type == "joypad_button_pressed" || type == "joypad_button_released") {
+      valid = (iss >> first);
+      bool pressed = (type == "joypad_button_pressed");
+      event.type = pressed ? SDL_JOYBUTTONDOWN : SDL_JOYBUTTONUP;
+      event.jbutton.state = pressed ? SDL_PRESSED : SDL_RELEASED;
+      event.jbutton.button = Uint8(first);
+    }
+    else if (type == "joypad_axis_moved") {
+      valid = (iss >> first >> second);
+      event.type = SDL_JOYAXISMOTION;
+      event.jaxis.axis = Uint8(first);
+      event.jaxis.value = Sint16(second);
+    }
+    else if (type == "joypad_hat_moved") {
+      valid = (iss >> first >> second);
+      event.type = SDL_JOYHATMOTION;
+      event.jhat.hat = Uint8(first);
+      event.jhat.value = Uint8(second);
+    }
+    else if (type == "window_closing") {
+      event.type = SDL_QUIT;
+    }
+    else {
+      valid = false;
+    }
+
+    if (!valid) {
+      Debug::error(StringConcat() << "Invalid line " << line_number
+          << " in input recording '" << file_name << "'");
+    }
+    else {
+      events.push_back(recorded_event);
+    }
+  }
+
+  if (!has_end && !events.empty()) {
+    end_cycle = events.back().cycle;
+  }
+}
+
+/**
+ * \brief Updates the state of the keyboard and of the joypad in the replay
+ * after an event.
+ * \param event An event being replayed.
+ */
+void Replay::update_input_state(const SDL_Event& event) {
+
+  switch (event.type) {
+
+    case SDL_KEYDOWN:
+      keys_down.insert(event.key.keysym.sym);
+      break;
+
+    case SDL_KEYUP:
+      keys_down.erase(event.key.keysym.sym);
+      break;
+
+    case SDL_JOYBUTTONDOWN:
+      joypad_buttons_down.insert(event.jbutton.button);
+      break;
+
+    case SDL_JOYBUTTONUP:
+      joypad_buttons_down.erase(event.jbutton.button);
+      break;
+
+    case SDL_JOYAXISMOTION:
+      joypad_axes[event.jaxis.axis] = event.jaxis.value;
+      break;
+
+    case SDL_JOYHATMOTION:
+      joypad_hats[event.jhat.hat] = event.jhat.value;
+      break;
+  }
+}
+
+/**
+ * \brief Prints a summary of the real time of the frames of the replay.
+ */
+void Replay::print_statistics() {
+
+  if (frame_times.empty()) {
+    std::cout << "Replay: no frame drawn" << std::endl;
+    return;
+  }
+
+  std::vector<uint32_t> sorted_times = frame_times;
+  std::sort(sorted_times.begin(), sorted_times.end());
+  const size_t nb_frames = sorted_times.size();
+  uint64_t total_time = 0;
+  std::vector<uint32_t>::const_iterator it;
+  for (it = sorted_times.begin(); it != sorted_times.end(); ++it) {
+    total_time += *it;
+  }
+
+  std::cout << "Replay: " << nb_frames << " frames, " << total_cycles
+      << " cycles, " << date << " ms of simulated time, "
+      << (total_time / 1000) << " ms of real time" << std::endl;
+  std::cout << "Replay: frame time (microseconds): average "
+      << (total_time / nb_frames)
+      << ", median " << sorted_times[nb_frames / 2]
+      << ", 95th percentile " << sorted_times[nb_frames * 95 / 100]
+      << ", 99th percentile " << sorted_times[nb_frames * 99 / 100]
+      << ", worst " << sorted_times.back() << std::endl;
+}
+
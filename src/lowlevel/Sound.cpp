@@ -23,6 +23,7 @@
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/Replay.h"
 #include "QuestResourceList.h"
 
 ALCdevice* Sound::device = NULL;
@@ -82,8 +83,8 @@ Sound::~Sound() {
  */
 void Sound::initialize(int argc, char** argv) {
 
-  // check the -no-audio option
-  bool disable = false;
+  // check the -no-audio option (a replay has no audio either)
+  bool disable = Replay::is_replaying();
   for (argv++; argc > 1 && !disable; argv++, argc--) {
     const std::string arg = *argv;
     disable = (arg.find("-no-audio") == 0);
@@ -17,12 +17,16 @@
 #include "lowlevel/Surface.h"
 #include "lowlevel/Color.h"
 #include "lowlevel/Rectangle.h"
-#include "lowlevel/FileTools.h"
+#include "lowlevel/ImageCache.h"
+#include "lowlevel/Compositor.h"
+#include "lowlevel/SurfacePool.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
 #include "lua/LuaContext.h"
 #include "Transition.h"
-#include <SDL_image.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 /**
  * \brief Creates a surface with the specified size.
@@ -31,12 +35,14 @@
  */
 Surface::Surface(int width, int height):
   Drawable(),
-  internal_surface_created(true) {
+  internal_surface_created(true),
+  opacity(255),
+  blend_mode(BLEND_NORMAL) {
 
   Debug::check_assertion(width > 0 && height > 0,
       "Attempt to create a surface with an empty size");
 
-  this->internal_surface = SDL_CreateRGBSurface(
+  this->internal_surface = SurfacePool::create_surface(
     SDL_SWSURFACE, width, height, SOLARUS_COLOR_DEPTH, 0, 0, 0, 0);
 }
 
@@ -46,11 +52,13 @@ Surface::Surface(int width, int height):
  */
 Surface::Surface(const Rectangle& size):
   Drawable(),
-  internal_surface_created(true) {
+  internal_surface_created(true),
+  opacity(255),
+  blend_mode(BLEND_NORMAL) {
 
   Debug::check_assertion(size.get_width() > 0 && size.get_height() > 0, "Empty surface");
 
-  this->internal_surface = SDL_CreateRGBSurface(
+  this->internal_surface = SurfacePool::create_surface(
       SDL_HWSURFACE, size.get_width(), size.get_height(), SOLARUS_COLOR_DEPTH, 0, 0, 0, 0);
 }
 
@@ -64,7 +72,9 @@ Surface::Surface(const Rectangle& size):
  */
 Surface::Surface(const std::string& file_name, ImageDirectory base_directory):
   Drawable(),
-  internal_surface_created(true) {
+  internal_surface_created(true),
+  opacity(255),
+  blend_mode(BLEND_NORMAL) {
 
   std::string prefix = "";
   bool language_specific = false;
@@ -78,13 +88,7 @@ Surface::Surface(const std::string& file_name, ImageDirectory base_directory):
   }
   std::string prefixed_file_name = prefix + file_name;
 
-  size_t size;
-  char* buffer;
-  FileTools::data_file_open_buffer(prefixed_file_name, &buffer, &size, language_specific);
-  SDL_RWops* rw = SDL_RWFromMem(buffer, int(size));
-  this->internal_surface = IMG_Load_RW(rw, 0);
-  FileTools::data_file_close_buffer(buffer);
-  SDL_RWclose(rw);
+  this->internal_surface = ImageCache::load_image(prefixed_file_name, language_specific);
 
   Debug::check_assertion(internal_surface != NULL, StringConcat() <<
       "Cannot load image '" << prefixed_file_name << "'");
@@ -101,7 +105,9 @@ Surface::Surface(const std::string& file_name, ImageDirectory base_directory):
 Surface::Surface(SDL_Surface* internal_surface):
   Drawable(),
   internal_surface(internal_surface),
-  internal_surface_created(false) {
+  internal_surface_created(false),
+  opacity(255),
+  blend_mode(BLEND_NORMAL) {
 
 }
 
@@ -113,7 +119,9 @@ Surface::Surface(const Surface& other):
   Drawable(),
   internal_surface(SDL_ConvertSurface(other.internal_surface,
       other.internal_surface->format, other.internal_surface->flags)),
-  internal_surface_created(true) {
+  internal_surface_created(true),
+  opacity(other.opacity),
+  blend_mode(other.blend_mode) {
 
 }
 
@@ -123,7 +131,7 @@ Surface::Surface(const Surface& other):
 Surface::~Surface() {
 
   if (internal_surface_created) {
-    SDL_FreeSurface(internal_surface);
+    SurfacePool::free_surface(internal_surface);
   }
 }
 
@@ -152,24 +160,39 @@ Surface* Surface::create_from_file(const std::string& file_name,
   }
   std::string prefixed_file_name = prefix + file_name;
 
-  if (!FileTools::data_file_exists(prefixed_file_name, language_specific)) {
-    // File not found.
+  SDL_Surface* internal_surface = ImageCache::load_image(prefixed_file_name, language_specific);
+  if (internal_surface == NULL) {
+    // File not found or not a valid image.
     return NULL;
   }
 
-  size_t size;
-  char* buffer;
-  FileTools::data_file_open_buffer(prefixed_file_name, &buffer, &size, language_specific);
-  SDL_RWops* rw = SDL_RWFromMem(buffer, int(size));
-  SDL_Surface* internal_surface = IMG_Load_RW(rw, 0);
-  FileTools::data_file_close_buffer(buffer);
-  SDL_RWclose(rw);
+  Surface* surface = new Surface(internal_surface);
+  surface->internal_surface_created = true;
+  return surface;
+}
 
-  if (internal_surface == NULL) {
-    // Not a valid image.
-    return NULL;
-  }
+/**
+ * \brief Creates a fully transparent surface with an alpha channel.
+ *
+ * Unlike the other surfaces, it can store semi-transparent pixels.
+ * All surfaces with an alpha channel created by the engine, including
+ * images loaded from files, have the same 32-bit format.
+ *
+ * \param width The width in pixels.
+ * \param height The height in pixels.
+ * \return The surface created.
+ */
+Surface* Surface::create_with_alpha(int width, int height) {
 
+  Debug::check_assertion(width > 0 && height > 0,
+      "Attempt to create a surface with an empty size");
+
+  // Use the usual ARGB format of 32-bit screens and of SDL_ttf, so that
+  // drawing these surfaces needs no conversion of their pixels.
+  SDL_Surface* internal_surface = SurfacePool::create_surface(SDL_SWSURFACE | SDL_SRCALPHA,
+      width, height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+
+  // SDL initializes the pixels to zero: they are all transparent.
   Surface* surface = new Surface(internal_surface);
   surface->internal_surface_created = true;
   return surface;
@@ -200,6 +223,14 @@ const Rectangle Surface::get_size() const {
   return Rectangle(0, 0, get_width(), get_height());
 }
 
+/**
+ * \brief Returns whether this surface has a transparency color.
+ * \return true if pixels of the transparency color are not drawn.
+ */
+bool Surface::has_transparency_color() const {
+  return (internal_surface->flags & SDL_SRCCOLORKEY) != 0;
+}
+
 /**
  * \brief Returns the transparency color of this surface.
  *
@@ -221,22 +252,46 @@ Color Surface::get_transparency_color() {
  */
 void Surface::set_transparency_color(const Color& color) {
 
+  make_writable();
   SDL_SetColorKey(internal_surface, SDL_SRCCOLORKEY, color.get_internal_value());
 }
 
+/**
+ * \brief Returns the opacity of this surface.
+ * \return the opacity (0 to 255)
+ */
+int Surface::get_opacity() const {
+  return opacity;
+}
+
 /**
  * \brief Sets the opacity of this surface.
+ *
+ * The opacity is applied when this surface is drawn, in addition to its
+ * transparency color or its alpha channel.
+ *
  * \param opacity the opacity (0 to 255)
  */
 void Surface::set_opacity(int opacity) {
+  this->opacity = std::max(0, std::min(opacity, 255));
+}
 
-  // SDL has a special handling of the alpha value 128
-  // which doesn't work well with my computer
-  if (opacity == 128) {
-    opacity = 127;
-  }
+/**
+ * \brief Returns how this surface is combined with the destination when
+ * it is drawn.
+ * \return The blend mode.
+ */
+Surface::BlendMode Surface::get_blend_mode() const {
+  return blend_mode;
+}
 
-  SDL_SetAlpha(internal_surface, SDL_SRCALPHA, opacity);
+/**
+ * \brief Sets how this surface is combined with the destination when
+ * it is drawn.
+ * \param blend_mode The blend mode.
+ */
+void Surface::set_blend_mode(BlendMode blend_mode) {
+  this->blend_mode = blend_mode;
 }
 
 /**
@@ -252,6 +307,7 @@ void Surface::set_opacity(int opacity) {
  */
 void Surface::set_clipping_rectangle(const Rectangle& clipping_rectangle) {
 
+  make_writable();
   if (clipping_rectangle.get_width() == 0) {
     SDL_SetClipRect(internal_surface, NULL);
   }
@@ -266,6 +322,8 @@ void Surface::set_clipping_rectangle(const Rectangle& clipping_rectangle) {
  * \param color a color
  */
 void Surface::fill_with_color(Color& color) {
+
+  make_writable();
   SDL_FillRect(internal_surface, NULL, color.get_internal_value());
 }
 
@@ -275,10 +333,239 @@ void Surface::fill_with_color(Color& color) {
  * \param where the rectangle to fill
  */
 void Surface::fill_with_color(Color& color, const Rectangle& where) {
+
+  make_writable();
   Rectangle where2 = where;
   SDL_FillRect(internal_surface, where2.get_internal_rect(), color.get_internal_value());
 }
 
+/**
+ * \brief Makes all pixels of this surface transparent.
+ *
+ * The surface is filled with its transparency color, or with fully
+ * transparent pixels if it has an alpha channel.
+ */
+void Surface::clear() {
+
+  make_writable();
+  uint32_t transparent_pixel = 0;
+  if ((internal_surface->flags & SDL_SRCCOLORKEY) != 0) {
+    transparent_pixel = internal_surface->format->colorkey;
+  }
+  SDL_FillRect(internal_surface, NULL, transparent_pixel);
+}
+
+/**
+ * \brief Locks this surface to access its pixels directly.
+ *
+ * Calls can be nested: the surface is unlocked when unlock() was called
+ * as many times as lock().
+ */
+void Surface::lock() {
+  SDL_LockSurface(internal_surface);
+}
+
+/**
+ * \brief Unlocks this surface after a call to lock().
+ */
+void Surface::unlock() {
+  SDL_UnlockSurface(internal_surface);
+}
+
+/**
+ * \brief Returns whether a region of this surface has the same colors as
+ * the same region of another surface.
+ *
+ * Both surfaces must be locked with lock(). This allows to compare many
+ * regions without locking and unlocking the surfaces each time.
+ *
+ * \param region The rectangle to compare.
+ * \param other Another surface.
+ * \return true if all pixels of the region have the same color in both
+ * surfaces, false if they differ or if the region is outside a surface.
+ */
+bool Surface::has_same_pixels(const Rectangle& region, Surface& other) {
+
+  if (!get_size().contains(region) || !other.get_size().contains(region)) {
+    return false;
+  }
+
+  SDL_Surface* other_internal_surface = other.internal_surface;
+  const int row_length = internal_surface->pitch / internal_surface->format->BytesPerPixel;
+  const int other_row_length = other_internal_surface->pitch / other_internal_surface->format->BytesPerPixel;
+  bool same = true;
+  for (int y = region.get_y(); y < region.get_y() + region.get_height() && same; y++) {
+    for (int x = region.get_x(); x < region.get_x() + region.get_width() && same; x++) {
+
+      uint8_t r, g, b, a, other_r, other_g, other_b, other_a;
+      SDL_GetRGBA(get_pixel32(y * row_length + x), internal_surface->format,
+          &r, &g, &b, &a);
+      SDL_GetRGBA(other.get_pixel32(y * other_row_length + x), other_internal_surface->format,
+          &other_r, &other_g, &other_b, &other_a);
+      same = r == other_r && g == other_g && b == other_b && a == other_a;
+    }
+  }
+
+  return same;
+}
+
+/**
+ * \brief Returns whether this surface has transparency information for each
+ * pixel.
+ * \return true if the pixels of this surface have an alpha value.
+ */
+bool Surface::has_alpha_channel() const {
+
+  return internal_surface->format->Amask != 0
+      && (internal_surface->flags & SDL_SRCALPHA) != 0;
+}
+
+/**
+ * \brief Copies all pixels of this surface to another surface, converting
+ * them to the format of the other surface.
+ *
+ * Unlike drawing, transparent pixels of this surface are copied too:
+ * they become transparent pixels of the destination surface (pixels with
+ * its transparency color, or with an alpha value of zero).
+ * Other pixels that have the transparency color of the destination surface
+ * become transparent as well: to keep them, the destination surface should
+ * have the same transparency color as this one, or none if this one has none.
+ *
+ * \param dst_surface The destination surface. It must be large enough.
+ * \param dst_position Coordinates on the destination surface.
+ */
+void Surface::copy_pixels(Surface& dst_surface, const Rectangle& dst_position) {
+
+  dst_surface.make_writable();
+  SDL_Surface* dst_internal_surface = dst_surface.internal_surface;
+  Debug::check_assertion(
+      dst_position.get_x() >= 0 && dst_position.get_y() >= 0
+      && dst_position.get_x() + get_width() <= dst_surface.get_width()
+      && dst_position.get_y() + get_height() <= dst_surface.get_height(),
+      "Cannot copy pixels outside the destination surface");
+
+  SDL_PixelFormat* format = internal_surface->format;
+  SDL_PixelFormat* dst_format = dst_internal_surface->format;
+  const bool has_colorkey = has_transparency_color();
+  const bool dst_has_colorkey = dst_surface.has_transparency_color();
+  const bool has_alpha = has_alpha_channel();
+  const uint32_t dst_transparent_pixel = dst_has_colorkey ? dst_format->colorkey : 0;
+
+  SDL_LockSurface(internal_surface);
+  SDL_LockSurface(dst_internal_surface);
+
+  if (format->BytesPerPixel == dst_format->BytesPerPixel
+      && format->BytesPerPixel > 1
+      && format->Rmask == dst_format->Rmask
+      && format->Gmask == dst_format->Gmask
+      && format->Bmask == dst_format->Bmask
+      && format->Amask == dst_format->Amask
+      && has_colorkey == dst_has_colorkey
+      && (!has_colorkey || format->colorkey == dst_transparent_pixel)) {
+    // Same format (usual case since images are converted when loaded):
+    // copy entire rows.
+    const int row_size = get_width() * format->BytesPerPixel;
+    for (int y = 0; y < get_height(); y++) {
+      std::memcpy((uint8_t*) dst_internal_surface->pixels
+          + (dst_position.get_y() + y) * dst_internal_surface->pitch
+          + dst_position.get_x() * format->BytesPerPixel,
+          (uint8_t*) internal_surface->pixels + y * internal_surface->pitch,
+          row_size);
+    }
+    SDL_UnlockSurface(dst_internal_surface);
+    SDL_UnlockSurface(internal_surface);
+    return;
+  }
+
+  for (int y = 0; y < get_height(); y++) {
+    for (int x = 0; x < get_width(); x++) {
+
+      uint32_t pixel = read_pixel(internal_surface, x, y);
+      uint8_t r, g, b, a;
+      SDL_GetRGBA(pixel, format, &r, &g, &b, &a);
+
+      uint32_t dst_pixel;
+      if ((has_colorkey && pixel == format->colorkey) || (has_alpha && a == 0)) {
+        dst_pixel = dst_transparent_pixel;
+      }
+      else {
+        dst_pixel = SDL_MapRGBA(dst_format, r, g, b, a);
+      }
+      write_pixel(dst_internal_surface,
+          dst_position.get_x() + x, dst_position.get_y() + y, dst_pixel);
+    }
+  }
+
+  SDL_UnlockSurface(dst_internal_surface);
+  SDL_UnlockSurface(internal_surface);
+}
+
+/**
+ * \brief Moves all pixels of this surface.
+ *
+ * Pixels moved outside the surface are lost. The area uncovered keeps its
+ * previous pixels.
+ * Unlike drawing the surface on itself, this works even if the source and
+ * the destination overlap.
+ *
+ * \param dx Number of pixels to move to the right (can be negative).
+ * \param dy Number of pixels to move to the bottom (can be negative).
+ */
+void Surface::shift_pixels(int dx, int dy) {
+
+  const int width = get_width();
+  const int height = get_height();
+  if ((dx == 0 && dy == 0) || std::abs(dx) >= width || std::abs(dy) >= height) {
+    return;
+  }
+
+  make_writable();
+  SDL_LockSurface(internal_surface);
+
+  const int bytes_per_pixel = internal_surface->format->BytesPerPixel;
+  const int row_size = (width - std::abs(dx)) * bytes_per_pixel;
+  const int src_offset = std::max(0, -dx) * bytes_per_pixel;
+  const int dst_offset = std::max(0, dx) * bytes_per_pixel;
+  uint8_t* pixels = (uint8_t*) internal_surface->pixels;
+  const int pitch = internal_surface->pitch;
+
+  // When moving down, start from the bottom so that the rows to move are
+  // not overwritten before.
+  const int nb_rows = height - std::abs(dy);
+  for (int i = 0; i < nb_rows; i++) {
+    const int dst_y = (dy > 0) ? height - 1 - i : i;
+    const int src_y = dst_y - dy;
+    std::memmove(pixels + dst_y * pitch + dst_offset,
+        pixels + src_y * pitch + src_offset, row_size);
+  }
+
+  SDL_UnlockSurface(internal_surface);
+}
+
+/**
+ * \brief Draws a subrectangle of this surface on a surface with an alpha
+ * channel, combining the transparency of both.
+ *
+ * Unlike usual drawing, where SDL keeps the alpha values of the
+ * destination, the result is as opaque as if both surfaces were drawn one
+ * after the other. This allows to compose semi-transparent images.
+ *
+ * \param region The subrectangle to draw in this surface. It must be
+ * inside this surface.
+ * \param dst_surface The destination surface. It must have an alpha channel.
+ * \param dst_position Coordinates on the destination surface.
+ */
+void Surface::blend_region(const Rectangle& region, Surface& dst_surface,
+    const Rectangle& dst_position) {
+
+  Debug::check_assertion(dst_surface.has_alpha_channel(),
+      "The destination surface has no alpha channel");
+
+  dst_surface.make_writable();
+  Compositor::draw_region(*this, region, dst_surface, dst_position,
+      255, BLEND_NORMAL);
+}
+
 /**
  * \brief Draws this surface on another surface.
  * \param dst_surface The destination surface.
@@ -287,10 +574,7 @@ void Surface::fill_with_color(Color& color, const Rectangle& where) {
 void Surface::raw_draw(Surface& dst_surface,
     const Rectangle& dst_position) {
 
-  // Make a copy of the rectangle because SDL_BlitSurface modifies it.
-  Rectangle dst_position2(dst_position);
-  SDL_BlitSurface(internal_surface, NULL,
-      dst_surface.internal_surface, dst_position2.get_internal_rect());
+  blit(get_size(), dst_surface, dst_position);
 }
 
 /**
@@ -302,11 +586,7 @@ void Surface::raw_draw(Surface& dst_surface,
 void Surface::raw_draw_region(const Rectangle& region,
     Surface& dst_surface, const Rectangle& dst_position) {
 
-  // Make a copy of the rectangle because SDL_BlitSurface modifies it.
-  Rectangle region2(region);
-  Rectangle dst_position2(dst_position);
-  SDL_BlitSurface(internal_surface, region2.get_internal_rect(),
-      dst_surface.internal_surface, dst_position2.get_internal_rect());
+  blit(region, dst_surface, dst_position);
 }
 
 /**
@@ -327,9 +607,7 @@ void Surface::draw_transition(Transition& transition) {
  */
 void Surface::draw_region(const Rectangle& src_position, Surface& dst_surface) {
 
-  Rectangle src_position2(src_position);
-  SDL_BlitSurface(internal_surface, src_position2.get_internal_rect(),
-      dst_surface.internal_surface, NULL);
+  blit(src_position, dst_surface, Rectangle(0, 0));
 }
 
 /**
@@ -341,10 +619,116 @@ void Surface::draw_region(const Rectangle& src_position, Surface& dst_surface) {
 void Surface::draw_region(const Rectangle &src_position, Surface& dst_surface,
     const Rectangle &dst_position) {
 
-  Rectangle src_position2(src_position);
-  Rectangle dst_position2(dst_position);
-  SDL_BlitSurface(internal_surface, src_position2.get_internal_rect(),
-      dst_surface.internal_surface, dst_position2.get_internal_rect());
+  blit(src_position, dst_surface, dst_position);
+}
+
+/**
+ * \brief Makes sure that the pixels of this surface can be modified.
+ *
+ * Surfaces loaded from an image file share their pixels with the image
+ * cache and with the other surfaces of the same file (see ImageCache).
+ * Before it is modified for the first time, such a surface gets its own
+ * copy of the pixels.
+ */
+void Surface::make_writable() {
+
+  if (internal_surface_created && internal_surface->refcount > 1) {
+    SDL_Surface* copy = SDL_ConvertSurface(internal_surface,
+        internal_surface->format, internal_surface->flags);
+    SDL_FreeSurface(internal_surface);  // Only releases the shared pixels.
+    internal_surface = copy;
+  }
+}
+
+/**
+ * \brief Draws a region of this surface on another surface with the
+ * opacity and the blend mode of this surface.
+ *
+ * Usual drawings are done by SDL. Other ones are done by the Compositor.
+ *
+ * \param region The subrectangle to draw in this surface.
+ * \param dst_surface The destination surface.
+ * \param dst_position Coordinates on the destination surface.
+ */
+void Surface::blit(const Rectangle& region, Surface& dst_surface,
+    const Rectangle& dst_position) {
+
+  dst_surface.make_writable();
+  if (opacity == 255 && blend_mode == BLEND_NORMAL) {
+    // Make a copy of the rectangles because SDL_BlitSurface modifies them.
+    Rectangle region2(region);
+    Rectangle dst_position2(dst_position);
+    SDL_BlitSurface(internal_surface, region2.get_internal_rect(),
+        dst_surface.internal_surface, dst_position2.get_internal_rect());
+  }
+  else {
+    Compositor::draw_region(*this, region, dst_surface, dst_position,
+        opacity, blend_mode);
+  }
+}
+
+/**
+ * \brief Reads a pixel of an SDL surface, whatever its depth.
+ * \param surface A locked SDL surface.
+ * \param x X coordinate of the pixel.
+ * \param y Y coordinate of the pixel.
+ * \return The pixel value in the format of the surface.
+ */
+uint32_t Surface::read_pixel(SDL_Surface* surface, int x, int y) {
+
+  const int bytes_per_pixel = surface->format->BytesPerPixel;
+  uint8_t* pixel = (uint8_t*) surface->pixels + y * surface->pitch + x * bytes_per_pixel;
+
+  switch (bytes_per_pixel) {
+    case 1:
+      return *pixel;
+    case 2:
+      return *(uint16_t*) pixel;
+    case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+      return pixel[0] << 16 | pixel[1] << 8 | pixel[2];
+#else
+      return pixel[0] | pixel[1] << 8 | pixel[2] << 16;
+#endif
+    default:
+      return *(uint32_t*) pixel;
+  }
+}
+
+/**
+ * \brief Writes a pixel of an SDL surface, whatever its depth.
+ * \param surface A locked SDL surface.
+ * \param x X coordinate of the pixel.
+ * \param y Y coordinate of the pixel.
+ * \param value The pixel value in the format of the surface.
+ */
+void Surface::write_pixel(SDL_Surface* surface, int x, int y, uint32_t value) {
+
+  const int bytes_per_pixel = surface->format->BytesPerPixel;
+  uint8_t* pixel = (uint8_t*) surface->pixels + y * surface->pitch + x * bytes_per_pixel;
+
+  switch (bytes_per_pixel) {
+    case 1:
+      *pixel = uint8_t(value);
+      break;
+    case 2:
+      *(uint16_t*) pixel = uint16_t(value);
+      break;
+    case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+      pixel[0] = (value >> 16) & 0xff;
+      pixel[1] = (value >> 8) & 0xff;
+      pixel[2] = value & 0xff;
+#else
+      pixel[0] = value & 0xff;
+      pixel[1] = (value >> 8) & 0xff;
+      pixel[2] = (value >> 16) & 0xff;
+#endif
+      break;
+    default:
+      *(uint32_t*) pixel = value;
+      break;
+  }
 }
 
 /**
@@ -360,6 +744,9 @@ SDL_Surface* Surface::get_internal_surface() {
 
 /**
  * \brief Return the 32bits pixel
+ *
+ * The surface must be locked.
+ *
  * \param idx_pixel The index of the pixel to cast, can be any depth between 1 and 32 bits
  * \return The casted 32bits pixel.
  */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/SurfacePool.h"
+#include <cstring>
+
+std::map<SDL_Surface*, SurfacePool::Format> SurfacePool::pool_surfaces;
+std::map<SurfacePool::Format, std::vector<SDL_Surface*> > SurfacePool::unused_surfaces;
+size_t SurfacePool::unused_memory = 0;
+
+/**
+ * \brief Frees the unused surfaces of the pool.
+ *
+ * Surfaces still used are freed normally when they are destroyed.
+ */
+void SurfacePool::quit() {
+
+  std::map<Format, std::vector<SDL_Surface*> >::iterator it;
+  for (it = unused_surfaces.begin(); it != unused_surfaces.end(); ++it) {
+    std::vector<SDL_Surface*>& surfaces = it->second;
+    for (unsigned int i = 0; i < surfaces.size(); i++) {
+      SDL_FreeSurface(surfaces[i]);
+    }
+  }
+  unused_surfaces.clear();
+  pool_surfaces.clear();
+  unused_memory = 0;
+}
+
+/**
+ * \brief Creates an SDL surface, reusing an unused one if possible.
+ *
+ * The parameters are the ones of SDL_CreateRGBSurface().
+ *
+ * \param flags SDL flags of the surface.
+ * \param width Width in pixels.
+ * \param height Height in pixels.
+ * \param depth Bits per pixel.
+ * \param r_mask Red mask.
+ * \param g_mask Green mask.
+ * \param b_mask Blue mask.
+ * \param a_mask Alpha mask.
+ * \return The surface, to be freed with free_surface().
+ */
+SDL_Surface* SurfacePool::create_surface(uint32_t flags, int width, int height,
+    int depth, uint32_t r_mask, uint32_t g_mask, uint32_t b_mask, uint32_t a_mask) {
+
+  Format format;
+  format.flags = flags;
+  format.width = width;
+  format.height = height;
+  format.depth = depth;
+  format.r_mask = r_mask;
+  format.g_mask = g_mask;
+  format.b_mask = b_mask;
+  format.a_mask = a_mask;
+
+  std::map<Format, std::vector<SDL_Surface*> >::iterator it = unused_surfaces.find(format);
+  if (it != unused_surfaces.end() && !it->second.empty()) {
+    // Recycle an unused surface.
+    SDL_Surface* surface = it->second.back();
+    it->second.pop_back();
+    unused_memory -= surface->pitch * surface->h;
+    reset_surface(surface, format);
+    return surface;
+  }
+
+  SDL_Surface* surface = SDL_CreateRGBSurface(flags, width, height, depth,
+      r_mask, g_mask, b_mask, a_mask);
+  if (surface != NULL) {
+    pool_surfaces[surface] = format;
+  }
+  return surface;
+}
+
+/**
+ * \brief Frees an SDL surface or keeps it in the pool for later reuse.
+ *
+ * Surfaces that were not created by the pool are freed.
+ *
+ * \param surface The surface to free.
+ */
+void SurfacePool::free_surface(SDL_Surface* surface) {
+
+  std::map<SDL_Surface*, Format>::iterator it = pool_surfaces.find(surface);
+  if (it == pool_surfaces.end()) {
+    SDL_FreeSurface(surface);
+    return;
+  }
+
+  const size_t size = surface->pitch * surface->h;
+  if (unused_memory + size > max_unused_memory) {
+    // The pool is full.
+    pool_surfaces.erase(it);
+    SDL_FreeSurface(surface);
+    return;
+  }
+
+  unused_surfaces[it->second].push_back(surface);
+  unused_memory += size;
+}
+
+/**
+ * \brief Restores the initial state of a surface that is going to be reused.
+ * \param surface The surface to reset.
+ * \param format The format it was created with.
+ */
+void SurfacePool::reset_surface(SDL_Surface* surface, const Format& format) {
+
+  SDL_SetColorKey(surface, 0, 0);
+  SDL_SetAlpha(surface, format.flags & SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+  SDL_SetClipRect(surface, NULL);
+
+  SDL_LockSurface(surface);
+  std::memset(surface->pixels, 0, surface->pitch * surface->h);
+  SDL_UnlockSurface(surface);
+}
+
+/**
+ * \brief Compares two surface formats.
+ * \param other Another format.
+ * \return true if this format should be ordered before the other one.
+ */
+bool SurfacePool::Format::operator<(const Format& other) const {
+
+  if (width != other.width) {
+    return width < other.width;
+  }
+  if (height != other.height) {
+    return height < other.height;
+  }
+  if (depth != other.depth) {
+    return depth < other.depth;
+  }
+  if (flags != other.flags) {
+    return flags < other.flags;
+  }
+  if (r_mask != other.r_mask) {
+    return r_mask < other.r_mask;
+  }
+  if (g_mask != other.g_mask) {
+    return g_mask < other.g_mask;
+  }
+  if (b_mask != other.b_mask) {
+    return b_mask < other.b_mask;
+  }
+  return a_mask < other.a_mask;
+}
+
@@ -16,14 +16,23 @@
  */
 #include "lowlevel/System.h"
 #include "lowlevel/FileTools.h"
+#include "lowlevel/ImageCache.h"
+#include "lowlevel/SurfacePool.h"
 #include "lowlevel/VideoManager.h"
 #include "lowlevel/Color.h"
 #include "lowlevel/TextSurface.h"
 #include "lowlevel/Sound.h"
 #include "lowlevel/Random.h"
 #include "lowlevel/InputEvent.h"
+#include "lowlevel/FrameProfiler.h"
+#include "lowlevel/Replay.h"
 #include "Sprite.h"
 #include <SDL.h>
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
 
 uint32_t System::ticks = 0;
 
@@ -38,11 +47,15 @@ uint32_t System::ticks = 0;
  */
 void System::initialize(int argc, char** argv) {
 
+  // recording or replay of the input events (before SDL in case of replay)
+  Replay::initialize(argc, argv);
+
   // initialize SDL
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
 
   // files
   FileTools::initialize(argc, argv);
+  ImageCache::initialize(argc, argv);
 
   // video
   VideoManager::initialize(argc, argv);
@@ -74,7 +87,10 @@ void System::quit() {
   TextSurface::quit();
   Color::quit();
   VideoManager::quit();
+  SurfacePool::quit();
+  ImageCache::quit();
   FileTools::quit();
+  Replay::quit();
 
   SDL_Quit();
 }
@@ -86,7 +102,16 @@ void System::quit() {
  */
 void System::update() {
 
-  ticks = SDL_GetTicks();
+  if (Replay::is_clock_simulated()) {
+    // The clock is simulated.
+    Replay::update();
+    ticks = Replay::get_date();
+  }
+  else {
+    ticks = SDL_GetTicks();
+  }
+
+  FrameProfiler::ScopedSection section(FrameProfiler::SECTION_SOUND_UPDATE);
   Sound::update();
 }
 
@@ -98,6 +123,32 @@ uint32_t System::now() {
   return ticks;
 }
 
+/**
+ * \brief Returns a real time measure with a microsecond resolution.
+ *
+ * Unlike now(), this is not the date of the current cycle but the real time
+ * at the moment of the call.
+ * Use it to measure the duration of some code.
+ *
+ * \return A number of microseconds elapsed since an arbitrary origin.
+ */
+uint64_t System::get_precise_ticks() {
+
+#if defined(_WIN32)
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+  uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+  return seconds * 1000000 + remainder * 1000000 / frequency.QuadPart;
+#else
+  timeval time;
+  gettimeofday(&time, NULL);
+  return uint64_t(time.tv_sec) * 1000000 + time.tv_usec;
+#endif
+}
+
 /**
  * \brief Makes the program sleep during some time.
  *
@@ -106,6 +157,12 @@ uint32_t System::now() {
  * \param duration duration of the sleep in milliseconds
  */
 void System::sleep(uint32_t duration) {
+
+  if (Replay::is_clock_simulated()) {
+    // The simulated clock waits for the real time itself when recording.
+    return;
+  }
+
   SDL_Delay(duration);
 }
 
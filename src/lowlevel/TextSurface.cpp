@@ -23,6 +23,46 @@
 #include "lua/LuaContext.h"
 #include "Transition.h"
 #include <lua.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+  /**
+   * \brief Decodes a UTF-8 string.
+   *
+   * Characters outside the basic multilingual plane are replaced by '?'.
+   *
+   * \param text A UTF-8 string.
+   * \param code_points Vector where to append the code point of each character.
+   */
+  void decode_utf8(const std::string& text, std::vector<uint16_t>& code_points) {
+
+    for (unsigned int i = 0; i < text.size(); i++) {
+      const uint8_t first_byte = text[i];
+      uint16_t code_point = '?';
+      if (first_byte < 0x80) {
+        code_point = first_byte;
+      }
+      else if ((first_byte & 0xE0) == 0xC0 && i + 1 < text.size()) {
+        code_point = ((first_byte & 0x1F) << 6) | (text[i + 1] & 0x3F);
+        i += 1;
+      }
+      else if ((first_byte & 0xF0) == 0xE0 && i + 2 < text.size()) {
+        code_point = ((first_byte & 0x0F) << 12) | ((text[i + 1] & 0x3F) << 6)
+            | (text[i + 2] & 0x3F);
+        i += 2;
+      }
+      else {
+        // Skip the continuation bytes of a longer character.
+        while (i + 1 < text.size() && (uint8_t(text[i + 1]) & 0xC0) == 0x80) {
+          ++i;
+        }
+      }
+      code_points.push_back(code_point);
+    }
+  }
+}
 
 bool TextSurface::fonts_loaded = false;
 std::map<std::string, TextSurface::FontData> TextSurface::fonts;
@@ -83,6 +123,11 @@ void TextSurface::quit() {
     }
     else {
       // It's a normal font.
+      std::map<GlyphKey, Glyph>::iterator glyph_it;
+      for (glyph_it = font->glyphs.begin(); glyph_it != font->glyphs.end(); ++glyph_it) {
+        delete glyph_it->second.image;
+      }
+      font->glyphs.clear();
       TTF_CloseFont(font->internal_font);
       SDL_RWclose(font->rw);
       FileTools::data_file_close_buffer(font->buffer);
@@ -161,7 +206,8 @@ TextSurface::TextSurface(int x, int y):
   horizontal_alignment(ALIGN_LEFT),
   vertical_alignment(ALIGN_MIDDLE),
   rendering_mode(TEXT_SOLID),
-  surface(NULL) {
+  surface(NULL),
+  next_x(0) {
 
   text = "";
   set_text_color(Color::get_white());
@@ -185,7 +231,8 @@ TextSurface::TextSurface(int x, int y,
   horizontal_alignment(horizontal_alignment),
   vertical_alignment(vertical_alignment),
   rendering_mode(TEXT_SOLID),
-  surface(NULL) {
+  surface(NULL),
+  next_x(0) {
 
   text = "";
   set_text_color(Color::get_white());
@@ -197,9 +244,6 @@ TextSurface::TextSurface(int x, int y,
  */
 TextSurface::~TextSurface() {
 
-  if (surface != NULL && !surface->internal_surface_created) {
-    SDL_FreeSurface(surface->get_internal_surface());
-  }
   delete surface;
 }
 
@@ -249,7 +293,7 @@ void TextSurface::set_horizontal_alignment(HorizontalAlignment horizontal_alignm
 
   this->horizontal_alignment = horizontal_alignment;
 
-  rebuild();
+  update_position();
 }
 
 /**
@@ -270,7 +314,7 @@ void TextSurface::set_vertical_alignment(VerticalAlignment vertical_alignment) {
 
   this->vertical_alignment = vertical_alignment;
 
-  rebuild();
+  update_position();
 }
 
 /**
@@ -285,7 +329,7 @@ void TextSurface::set_alignment(HorizontalAlignment horizontal_alignment,
   this->horizontal_alignment = horizontal_alignment;
   this->vertical_alignment = vertical_alignment;
 
-  rebuild();
+  update_position();
 }
 
 /**
@@ -319,8 +363,11 @@ const Color& TextSurface::get_text_color() {
  * \param color The color to set.
  */
 void TextSurface::set_text_color(const Color &color) {
-  this->text_color = color;
-  rebuild();
+
+  if (color.get_internal_value() != text_color.get_internal_value()) {
+    this->text_color = color;
+    rebuild();
+  }
 }
 
 /**
@@ -330,8 +377,7 @@ void TextSurface::set_text_color(const Color &color) {
  * \param b blue component (0 to 255)
  */
 void TextSurface::set_text_color(int r, int g, int b) {
-  this->text_color = Color(r, g, b);
-  rebuild();
+  set_text_color(Color(r, g, b));
 }
 
 /**
@@ -342,7 +388,7 @@ void TextSurface::set_text_color(int r, int g, int b) {
 void TextSurface::set_position(int x, int y) {
   this->x = x;
   this->y = y;
-  rebuild();
+  update_position();
 }
 
 /**
@@ -359,7 +405,7 @@ int TextSurface::get_x() {
  */
 void TextSurface::set_x(int x) {
   this->x = x;
-  rebuild();
+  update_position();
 }
 
 /**
@@ -376,7 +422,7 @@ int TextSurface::get_y() {
  */
 void TextSurface::set_y(int y) {
   this->y = y;
-  rebuild();
+  update_position();
 }
 
 /**
@@ -412,8 +458,10 @@ void TextSurface::set_text(const std::string& text) {
   if (text != this->text) {
 
     // there is a change
-    this->text = text;
-    rebuild();
+    if (!append_text(text)) {
+      this->text = text;
+      rebuild();
+    }
   }
 }
 
@@ -429,19 +477,19 @@ void TextSurface::add_char(char c) {
 }
 
 /**
- * \brief Returns the width of the surface containing the text.
+ * \brief Returns the width of the text.
  * \return the width in pixels
  */
 int TextSurface::get_width() {
-  return surface->get_width();
+  return text_position.get_width();
 }
 
 /**
- * \brief Returns the height of the surface containing the text.
+ * \brief Returns the height of the text.
  * \return the height in pixels
  */
 int TextSurface::get_height() {
-  return surface->get_height();
+  return text_position.get_height();
 }
 
 
@@ -465,18 +513,10 @@ void TextSurface::rebuild() {
     load_fonts();
   }
 
-  if (surface != NULL) {
-    // another text was previously set: delete it
-    if (!surface->internal_surface_created) {
-      SDL_FreeSurface(surface->get_internal_surface());
-    }
-    delete surface;
-    surface = NULL;
-  }
-
   if (is_empty()) {
-    // Empty string or only whitespaces: no surface to create.
+    // Empty string or only whitespaces: nothing to draw.
     // Some fonts make TTF_Font fail if the string contains only whitespaces.
+    text_position.set_size(0, 0);
     return;
   }
 
@@ -490,7 +530,18 @@ void TextSurface::rebuild() {
     rebuild_ttf();
   }
 
-  // calculate the coordinates of the top-left corner
+  update_position();
+}
+
+/**
+ * \brief Calculates the coordinates of the top-left corner of the text
+ * from the position and the alignment.
+ *
+ * This function is called when the position, the alignment or the size
+ * of the text changes.
+ */
+void TextSurface::update_position() {
+
   int x_left = 0, y_top = 0;
 
   switch (horizontal_alignment) {
@@ -500,11 +551,11 @@ void TextSurface::rebuild() {
     break;
 
   case ALIGN_CENTER:
-    x_left = x - surface->get_width() / 2;
+    x_left = x - text_position.get_width() / 2;
     break;
 
   case ALIGN_RIGHT:
-    x_left = x - surface->get_width();
+    x_left = x - text_position.get_width();
     break;
   }
 
@@ -515,17 +566,98 @@ void TextSurface::rebuild() {
     break;
 
   case ALIGN_MIDDLE:
-    y_top = y - surface->get_height() / 2;
+    y_top = y - text_position.get_height() / 2;
     break;
 
   case ALIGN_BOTTOM:
-    y_top = y - surface->get_height();
+    y_top = y - text_position.get_height();
     break;
   }
 
   text_position.set_xy(x_left, y_top);
 }
 
+/**
+ * \brief Makes sure that the surface can contain a text of the specified
+ * size.
+ *
+ * The current surface is kept if it is big enough and has the right kind
+ * of transparency. Otherwise, a new one is created.
+ * The caller has to clear the surface.
+ *
+ * \param width Width of the text.
+ * \param height Height of the text.
+ * \param alpha true for a surface with an alpha channel, false for a
+ * surface with a transparency color.
+ */
+void TextSurface::prepare_surface(int width, int height, bool alpha) {
+
+  if (surface != NULL
+      && surface->has_alpha_channel() == alpha
+      && surface->get_width() >= width
+      && surface->get_height() >= height) {
+    // The surface can be reused.
+    return;
+  }
+
+  if (surface != NULL) {
+    // Don't reallocate each time if the text grows step by step.
+    if (surface->has_alpha_channel() == alpha) {
+      width = std::max(width, surface->get_width() * 2);
+      height = std::max(height, surface->get_height());
+    }
+    delete surface;
+  }
+
+  if (alpha) {
+    surface = Surface::create_with_alpha(width, height);
+  }
+  else {
+    surface = new Surface(width, height);
+  }
+}
+
+/**
+ * \brief Tries to draw only the characters added at the end of the text.
+ *
+ * This is possible if the new text starts with the current one and if the
+ * current surface is big enough for the new text.
+ * Revealing a text character by character (like dialog boxes do) then
+ * only draws the new characters.
+ *
+ * \param text The new text.
+ * \return true if the text was changed, false if the text surface has to
+ * be rebuilt.
+ */
+bool TextSurface::append_text(const std::string& text) {
+
+  if (text_position.is_flat()
+      || text.size() <= this->text.size()
+      || text.compare(0, this->text.size(), this->text) != 0) {
+    return false;
+  }
+
+  std::string characters = text.substr(this->text.size());
+  if ((characters[0] & 0xC0) == 0x80) {
+    // The previous text ended in the middle of a UTF-8 character.
+    return false;
+  }
+
+  bool appended;
+  if (fonts[font_id].bitmap) {
+    appended = append_bitmap(characters);
+  }
+  else {
+    appended = append_ttf(characters);
+  }
+
+  if (appended) {
+    this->text = text;
+    update_position();
+  }
+  return appended;
+}
+
 /**
  * \brief Redraws the text surface in the case of a bitmap font.
  *
@@ -533,10 +665,27 @@ void TextSurface::rebuild() {
  */
 void TextSurface::rebuild_bitmap() {
 
-  // First count the number of characters in the UTF-8 string.
+  Surface& bitmap = *fonts[font_id].bitmap;
+  text_position.set_size(0, 0);
+  next_x = 0;
+  prepare_surface(get_bitmap_text_width(text), bitmap.get_height() / 16, false);
+  surface->set_transparency_color(bitmap.get_transparency_color());
+  surface->clear();
+
+  append_bitmap(text);
+}
+
+/**
+ * \brief Returns the width of some characters of a bitmap font.
+ * \param characters A UTF-8 string.
+ * \return Its width in pixels.
+ */
+int TextSurface::get_bitmap_text_width(const std::string& characters) {
+
+  // Count the number of characters in the UTF-8 string.
   int num_chars = 0;
-  for (unsigned i = 0; i < text.size(); i++) {
-    char current_char = text[i];
+  for (unsigned i = 0; i < characters.size(); i++) {
+    char current_char = characters[i];
     if ((current_char & 0xE0) == 0xC0) {
       // This character uses two bytes.
       ++i;
@@ -544,19 +693,33 @@ void TextSurface::rebuild_bitmap() {
     ++num_chars;
   }
 
+  int char_width = fonts[font_id].bitmap->get_width() / 128;
+  return char_width * num_chars;
+}
+
+/**
+ * \brief Draws characters of a bitmap font after the existing text.
+ * \param characters The characters to add (UTF-8 string).
+ * \return false if the surface is too small to add these characters.
+ */
+bool TextSurface::append_bitmap(const std::string& characters) {
+
   // Determine the letter size from the surface size.
   Surface& bitmap = *fonts[font_id].bitmap;
   const Rectangle& bitmap_size = bitmap.get_size();
   int char_width = bitmap_size.get_width() / 128;
   int char_height = bitmap_size.get_height() / 16;
 
-  surface = new Surface(char_width * num_chars, char_height);
-  surface->set_transparency_color(bitmap.get_transparency_color());
+  int width = text_position.get_width() + get_bitmap_text_width(characters);
+  if (width > surface->get_width()) {
+    return false;
+  }
+  text_position.set_size(width, char_height);
 
-  // Traverse the string again to draw the characters.
-  Rectangle dst_position(0, 0);
-  for (unsigned i = 0; i < text.size(); i++) {
-    char first_byte = text[i];
+  // Traverse the string to draw the characters.
+  Rectangle dst_position(next_x, 0);
+  for (unsigned i = 0; i < characters.size(); i++) {
+    char first_byte = characters[i];
     Rectangle src_position(0, 0, char_width, char_height);
     if ((first_byte & 0xE0) != 0xC0) {
       // This character uses one byte.
@@ -565,7 +728,7 @@ void TextSurface::rebuild_bitmap() {
     else {
       // This character uses two bytes.
       ++i;
-      char second_byte = text[i];
+      char second_byte = characters[i];
       uint16_t code_point = ((first_byte & 0x1F) << 6) | (second_byte & 0x3F);
       src_position.set_xy((code_point % 128) * char_width,
           (code_point / 128) * char_height);
@@ -573,32 +736,227 @@ void TextSurface::rebuild_bitmap() {
     bitmap.draw_region(src_position, *surface, dst_position);
     dst_position.add_x(char_width - 1);
   }
+  next_x = dst_position.get_x();
+  return true;
 }
 
 /**
  * \brief Redraws the text surface in the case of a normal font.
  *
+ * The characters come from the glyph cache of the font, so only
+ * characters never rendered before with this rendering mode are rendered by
+ * SDL_ttf.
+ *
  * This function is called when there is a change.
  */
 void TextSurface::rebuild_ttf() {
 
-  // create the text surface
+  FontData& font = fonts[font_id];
+  std::vector<uint16_t> code_points;
+  decode_utf8(text, code_points);
+
+  // Don't cut the left part of the first character.
+  const Glyph& first_glyph = get_glyph(font, code_points[0]);
+  int x_start = std::max(0, -first_glyph.x_offset);
+
+  text_position.set_size(0, 0);
+  next_x = x_start;
+  int width = get_ttf_text_width(code_points);
+  int height = std::max(1, TTF_FontHeight(font.internal_font));
+
+  bool antialiasing = (rendering_mode == TEXT_ANTIALIASING);
+  prepare_surface(width, height, antialiasing);
+  if (!antialiasing) {
+    // Any color different from the text works as transparency color.
+    Color transparency_color = Color::get_magenta();
+    if (text_color.get_internal_value() == transparency_color.get_internal_value()) {
+      transparency_color = Color::get_black();
+    }
+    surface->set_transparency_color(transparency_color);
+  }
+  surface->clear();
+
+  draw_ttf_glyphs(code_points, width);
+}
+
+/**
+ * \brief Returns the width that some characters of a normal font need
+ * after the existing text.
+ * \param code_points The characters to add.
+ * \return The new width of the text in pixels.
+ */
+int TextSurface::get_ttf_text_width(const std::vector<uint16_t>& code_points) {
+
+  FontData& font = fonts[font_id];
+  int width = text_position.get_width();
+  int pen_x = next_x;
+  for (unsigned int i = 0; i < code_points.size(); i++) {
+    const Glyph& glyph = get_glyph(font, code_points[i]);
+    int glyph_width = glyph.advance;
+    if (glyph.image != NULL) {
+      glyph_width = std::max(glyph_width, glyph.x_offset + glyph.image->get_width());
+    }
+    width = std::max(width, pen_x + glyph_width);
+    pen_x += glyph.advance;
+  }
+  return std::max(1, width);
+}
+
+/**
+ * \brief Draws characters of a normal font after the existing text.
+ * \param characters The characters to add (UTF-8 string).
+ * \return false if the surface is too small to add these characters.
+ */
+bool TextSurface::append_ttf(const std::string& characters) {
+
+  std::vector<uint16_t> code_points;
+  decode_utf8(characters, code_points);
+
+  int width = get_ttf_text_width(code_points);
+  if (width > surface->get_width()) {
+    return false;
+  }
+
+  draw_ttf_glyphs(code_points, width);
+  return true;
+}
+
+/**
+ * \brief Draws characters of a normal font from the glyph cache after
+ * the existing text.
+ *
+ * Glyphs are cached in white: in solid mode, each glyph is drawn with the
+ * text color as foreground color of its palette, and in antialiased mode,
+ * the drawn pixels get the text color afterwards.
+ *
+ * \param code_points The characters to draw.
+ * \param width The new width of the text, as returned by
+ * get_ttf_text_width().
+ */
+void TextSurface::draw_ttf_glyphs(const std::vector<uint16_t>& code_points,
+    int width) {
+
+  FontData& font = fonts[font_id];
+  bool antialiasing = (rendering_mode == TEXT_ANTIALIASING);
+  int min_x = width;
+  for (unsigned int i = 0; i < code_points.size(); i++) {
+    const Glyph& glyph = get_glyph(font, code_points[i]);
+    if (glyph.image != NULL) {
+      Rectangle dst_position(next_x + glyph.x_offset, glyph.y_offset);
+      min_x = std::min(min_x, dst_position.get_x());
+      if (antialiasing) {
+        glyph.image->blend_region(glyph.image->get_size(), *surface, dst_position);
+      }
+      else {
+        // Index 1 of the palette of a solid glyph is its foreground color.
+        SDL_SetColors(glyph.image->internal_surface, text_color.get_internal_color(), 1, 1);
+        glyph.image->draw_region(glyph.image->get_size(), *surface, dst_position);
+      }
+    }
+    next_x += glyph.advance;
+  }
 
-  SDL_Surface *internal_surface = NULL;
+  if (antialiasing && min_x < width) {
+    set_ttf_pixels_color(min_x, width);
+  }
+  text_position.set_size(width, std::max(1, TTF_FontHeight(font.internal_font)));
+}
+
+/**
+ * \brief Gives the text color to the pixels of some columns of the
+ * antialiased text surface, keeping their alpha value.
+ *
+ * Doing it again on pixels that already have the text color has no effect,
+ * so the columns may include characters drawn before.
+ *
+ * \param x The first column to change.
+ * \param width The column after the last one to change.
+ */
+void TextSurface::set_ttf_pixels_color(int x, int width) {
+
+  SDL_Surface* internal_surface = surface->internal_surface;
+  SDL_PixelFormat* format = internal_surface->format;
+  const SDL_Color* color = text_color.get_internal_color();
+  const uint32_t color_bits = SDL_MapRGB(format,
+      color->r, color->g, color->b) & ~format->Amask;
+
+  x = std::max(0, x);
+  width = std::min(width, internal_surface->w);
+
+  SDL_LockSurface(internal_surface);
+  const int row_length = internal_surface->pitch / format->BytesPerPixel;
+  uint32_t* pixels = static_cast<uint32_t*>(internal_surface->pixels);
+  for (int j = 0; j < internal_surface->h; j++) {
+    uint32_t* row = &pixels[j * row_length];
+    for (int i = x; i < width; i++) {
+      row[i] = (row[i] & format->Amask) | color_bits;
+    }
+  }
+  SDL_UnlockSurface(internal_surface);
+}
+
+/**
+ * \brief Returns a character of a normal font rendered in white with the
+ * rendering mode of this text surface.
+ *
+ * The character is rendered the first time and then kept in the glyph
+ * cache of the font until quit() is called.
+ *
+ * \param font A normal font.
+ * \param code_point The character.
+ * \return The rendered character and its metrics.
+ */
+const TextSurface::Glyph& TextSurface::get_glyph(FontData& font, uint16_t code_point) {
+
+  GlyphKey key;
+  key.rendering_mode = rendering_mode;
+  key.code_point = code_point;
+
+  std::map<GlyphKey, Glyph>::iterator it = font.glyphs.find(key);
+  if (it != font.glyphs.end()) {
+    return it->second;
+  }
+
+  Glyph& glyph = font.glyphs[key];
+  glyph.image = NULL;
+  glyph.x_offset = 0;
+  glyph.y_offset = 0;
+  glyph.advance = 0;
+
+  int min_x, max_x, min_y, max_y, advance;
+  if (TTF_GlyphMetrics(font.internal_font, code_point,
+      &min_x, &max_x, &min_y, &max_y, &advance) != 0) {
+    // This font has no such character.
+    return glyph;
+  }
+  glyph.x_offset = min_x;
+  glyph.y_offset = TTF_FontAscent(font.internal_font) - max_y;
+  glyph.advance = advance;
+
+  SDL_Surface* internal_surface = NULL;
   switch (rendering_mode) {
 
   case TEXT_SOLID:
-    internal_surface = TTF_RenderUTF8_Solid(fonts[font_id].internal_font, text.c_str(), *text_color.get_internal_color());
+    internal_surface = TTF_RenderGlyph_Solid(font.internal_font, code_point, *Color::get_white().get_internal_color());
     break;
 
   case TEXT_ANTIALIASING:
-    internal_surface = TTF_RenderUTF8_Blended(fonts[font_id].internal_font, text.c_str(), *text_color.get_internal_color());
+    internal_surface = TTF_RenderGlyph_Blended(font.internal_font, code_point, *Color::get_white().get_internal_color());
     break;
   }
 
-  Debug::check_assertion(internal_surface != NULL, StringConcat()
-      << "Cannot create the text surface for string '" << text << "': " << SDL_GetError());
-  surface = new Surface(internal_surface);
+  if (internal_surface != NULL) {
+    if (internal_surface->w > 0 && internal_surface->h > 0) {
+      glyph.image = new Surface(internal_surface);
+      glyph.image->internal_surface_created = true;
+    }
+    else {
+      // A character without pixels, like a space.
+      SDL_FreeSurface(internal_surface);
+    }
+  }
+
+  return glyph;
 }
 
 /**
@@ -614,11 +972,12 @@ void TextSurface::rebuild_ttf() {
 void TextSurface::raw_draw(Surface& dst_surface,
     const Rectangle& dst_position) {
 
-  if (surface != NULL) {
+  if (!text_position.is_flat()) {
 
     Rectangle dst_position2(text_position);
     dst_position2.add_xy(dst_position);
-    surface->raw_draw(dst_surface, dst_position2);
+    surface->raw_draw_region(Rectangle(0, 0, get_width(), get_height()),
+        dst_surface, dst_position2);
   }
 }
 
@@ -631,7 +990,7 @@ void TextSurface::raw_draw(Surface& dst_surface,
 void TextSurface::raw_draw_region(const Rectangle& region,
     Surface& dst_surface, const Rectangle& dst_position) {
 
-  if (surface != NULL) {
+  if (!text_position.is_flat()) {
 
     Rectangle dst_position2(text_position);
     dst_position2.add_xy(dst_position);
@@ -644,7 +1003,23 @@ void TextSurface::raw_draw_region(const Rectangle& region,
  * \param transition The transition effect to apply.
  */
 void TextSurface::draw_transition(Transition& transition) {
-  transition.draw(*surface);
+
+  if (surface != NULL) {
+    transition.draw(*surface);
+  }
+}
+
+/**
+ * \brief Compares two glyph keys.
+ * \param other Another glyph key.
+ * \return true if this key should be ordered before the other one.
+ */
+bool TextSurface::GlyphKey::operator<(const GlyphKey& other) const {
+
+  if (rendering_mode != other.rendering_mode) {
+    return rendering_mode < other.rendering_mode;
+  }
+  return code_point < other.code_point;
 }
 
 /**
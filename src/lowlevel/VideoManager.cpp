@@ -487,6 +487,27 @@ void VideoManager::draw_unscaled(Surface& quest_surface) {
   }
 }
 
+/**
+ * \brief Returns whether two surfaces have the same 32-bit pixel format.
+ *
+ * In this case, pixels can be copied from one to the other without
+ * conversion.
+ *
+ * \param src_surface A surface.
+ * \param dst_surface Another surface.
+ * \return true if both surfaces have 32-bit pixels with the same masks.
+ */
+bool VideoManager::has_same_format(SDL_Surface* src_surface, SDL_Surface* dst_surface) {
+
+  const SDL_PixelFormat* src_format = src_surface->format;
+  const SDL_PixelFormat* dst_format = dst_surface->format;
+  return src_format->BytesPerPixel == 4
+    && dst_format->BytesPerPixel == 4
+    && src_format->Rmask == dst_format->Rmask
+    && src_format->Gmask == dst_format->Gmask
+    && src_format->Bmask == dst_format->Bmask;
+}
+
 /**
  * \brief Draws the quest surface on the screen, stretching the image by
  * a factor of 2.
@@ -504,15 +525,18 @@ void VideoManager::draw_stretched(Surface& quest_surface) {
     SDL_LockSurface(dst_internal_surface);
 
     int idx_src = 0;
+    const uint32_t* src = static_cast<uint32_t*>(src_internal_surface->pixels);
     uint32_t* dst = static_cast<uint32_t*>(dst_internal_surface->pixels);
+    const bool same_format = has_same_format(src_internal_surface, dst_internal_surface);
 
     const int width = dst_internal_surface->w;
     const int end_row_increment = 2 * offset_x + width;
     int p = width * offset_y + offset_x;
     for (int i = 0; i < quest_size.get_height(); i++) {
         for (int j = 0; j < quest_size.get_width(); j++) {
-            dst[p] = dst[p + 1] = dst[p + width] = dst[p + width + 1] 
-                   = quest_surface.get_mapped_pixel(idx_src, dst_internal_surface->format);
+            dst[p] = dst[p + 1] = dst[p + width] = dst[p + width + 1]
+                   = same_format ? src[idx_src] :
+                   quest_surface.get_mapped_pixel(idx_src, dst_internal_surface->format);
             p += 2;
             idx_src++;
         }
@@ -542,6 +566,7 @@ void VideoManager::draw_scale2x(Surface& quest_surface) {
 
     uint32_t* src = (uint32_t*) src_internal_surface->pixels;
     uint32_t* dst = (uint32_t*) dst_internal_surface->pixels;
+    const bool same_format = has_same_format(src_internal_surface, dst_internal_surface);
 
     const int end_row_increment = 2 * offset_x + dst_internal_surface->w;
 
@@ -578,7 +603,19 @@ void VideoManager::draw_scale2x(Surface& quest_surface) {
 
             // compute the color
 
-            if (src[b] != src[h] && src[d] != src[f]) {
+            if (same_format) {
+              // No conversion needed (usual case).
+              if (src[b] != src[h] && src[d] != src[f]) {
+                  dst[e1] = src[(src[d] == src[b]) ? d : e];
+                  dst[e2] = src[(src[b] == src[f]) ? f : e];
+                  dst[e3] = src[(src[d] == src[h]) ? d : e];
+                  dst[e4] = src[(src[h] == src[f]) ? f : e];
+              }
+              else {
+                  dst[e1] = dst[e2] = dst[e3] = dst[e4] = src[e];
+              }
+            }
+            else if (src[b] != src[h] && src[d] != src[f]) {
                 dst[e1] = quest_surface.get_mapped_pixel((src[d] == src[b]) ? d : e, dst_internal_surface->format);
                 dst[e2] = quest_surface.get_mapped_pixel((src[b] == src[f]) ? f : e, dst_internal_surface->format);
                 dst[e3] = quest_surface.get_mapped_pixel((src[d] == src[h]) ? d : e, dst_internal_surface->format);
@@ -102,6 +102,9 @@ void LuaContext::register_entity_module() {
       { "get_angle", entity_api_get_angle},
       { "get_optimization_distance", entity_api_get_optimization_distance },
       { "set_optimization_distance", entity_api_set_optimization_distance },
+      { "is_sleep_allowed", entity_api_is_sleep_allowed },
+      { "set_sleep_allowed", entity_api_set_sleep_allowed },
+      { "is_sleeping", entity_api_is_sleeping },
       { "is_in_same_region", entity_api_is_in_same_region },
       { "test_obstacles", entity_api_test_obstacles },
       { "is_visible", entity_api_is_visible },
@@ -325,6 +328,27 @@ void LuaContext::push_entity(lua_State* l, MapEntity& entity) {
   push_userdata(l, entity);
 }
 
+/**
+ * \brief Pushes an array of entity userdata onto the stack.
+ *
+ * The table is allocated once with the final number of elements.
+ *
+ * \param l A Lua context.
+ * \param entities The entities to put in the array, in this order.
+ */
+void LuaContext::push_entity_array(lua_State* l,
+    const std::vector<MapEntity*>& entities) {
+
+  lua_createtable(l, entities.size(), 0);
+                                  // entities
+  for (size_t i = 0; i < entities.size(); ++i) {
+    push_entity(l, *entities[i]);
+                                  // entities entity
+    lua_rawseti(l, -2, i + 1);
+                                  // entities
+  }
+}
+
 /**
  * \brief Implementation of entity:get_map().
  * \param l The Lua context that is calling this function.
@@ -792,6 +816,50 @@ int LuaContext::entity_api_set_optimization_distance(lua_State* l) {
   return 0;
 }
 
+/**
+ * \brief Implementation of entity:is_sleep_allowed().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_is_sleep_allowed(lua_State* l) {
+
+  MapEntity& entity = check_entity(l, 1);
+
+  lua_pushboolean(l, entity.is_sleep_allowed());
+  return 1;
+}
+
+/**
+ * \brief Implementation of entity:set_sleep_allowed().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_set_sleep_allowed(lua_State* l) {
+
+  MapEntity& entity = check_entity(l, 1);
+  bool sleep_allowed = true;
+  if (lua_gettop(l) >= 2) {
+    sleep_allowed = lua_toboolean(l, 2);
+  }
+
+  entity.set_sleep_allowed(sleep_allowed);
+
+  return 0;
+}
+
+/**
+ * \brief Implementation of entity:is_sleeping().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_is_sleeping(lua_State* l) {
+
+  MapEntity& entity = check_entity(l, 1);
+
+  lua_pushboolean(l, entity.is_sleeping());
+  return 1;
+}
+
 /**
  * \brief Implementation of entity:is_in_same_region().
  * \param l The Lua context that is calling this function.
@@ -2400,6 +2468,7 @@ int LuaContext::enemy_api_create_enemy(lua_State* l) {
   }
 
   entity->set_optimization_distance(enemy.get_optimization_distance());
+  entity->set_sleep_allowed(enemy.is_sleep_allowed());
   map.get_entities().add_entity(entity);
 
   if (entity->get_type() == ENEMY) {  // Because it may also be a pickable treasure.
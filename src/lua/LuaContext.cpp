@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "lua/LuaContext.h"
+#include "lua/LuaProfiler.h"
 #include "entities/Destination.h"
 #include "entities/Switch.h"
 #include "entities/Sensor.h"
@@ -28,11 +29,13 @@
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/System.h"
 #include "EquipmentItem.h"
 #include "Treasure.h"
 #include "Map.h"
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 std::map<lua_State*, LuaContext*> LuaContext::lua_contexts;
 
@@ -42,7 +45,12 @@ std::map<lua_State*, LuaContext*> LuaContext::lua_contexts;
  */
 LuaContext::LuaContext(MainLoop& main_loop):
   l(NULL),
-  main_loop(main_loop) {
+  main_loop(main_loop),
+  next_timer_schedule_id(1),
+  gc_time_budget(2000),
+  gc_time(0),
+  last_gc_time(0),
+  gc_memory_after_cycle(0) {
 
 }
 
@@ -92,6 +100,7 @@ void LuaContext::initialize() {
 
   // Create an execution context.
   l = luaL_newstate();
+  LuaProfiler::attach(l);
   lua_atpanic(l, l_panic);
   luaL_openlibs(l);
 
@@ -143,6 +152,11 @@ void LuaContext::initialize() {
   lua_pop(l, 1);
                                   // --
 
+  // From now on, garbage is collected incrementally in the spare time
+  // of each frame rather than whenever Lua allocates.
+  gc_memory_after_cycle = lua_gc(l, LUA_GCCOUNT, 0);
+  set_gc_time_budget(gc_time_budget);
+
   // Execute the main file.
   do_file_if_exists(l, "main");
   main_on_started();
@@ -184,6 +198,138 @@ void LuaContext::update() {
 
   // Call sol.main.on_update().
   main_on_update();
+
+  // Make sure that the garbage collector keeps up with allocations even if
+  // frames leave no spare time: the more memory exceeds twice the memory
+  // of the last cycle, the bigger the step. Past four times, finish the
+  // cycle at once.
+  if (gc_time_budget != 0) {
+    int memory = lua_gc(l, LUA_GCCOUNT, 0);
+    int threshold = 2 * gc_memory_after_cycle;
+    if (memory >= 2 * threshold) {
+      finish_garbage_collection();
+    }
+    else if (memory >= threshold) {
+      step_garbage_collector(memory - threshold);
+    }
+  }
+}
+
+/**
+ * \brief Runs incremental steps of the Lua garbage collector.
+ *
+ * This function should be called once per frame with the spare time
+ * remaining before the next frame.
+ * Steps are run until the time budget of the garbage collector is consumed,
+ * the spare time is consumed or a collection cycle is finished.
+ *
+ * \param max_duration Spare time of the current frame in milliseconds.
+ */
+void LuaContext::collect_garbage(uint32_t max_duration) {
+
+  if (gc_time_budget != 0) {
+    uint64_t budget = std::min(uint64_t(gc_time_budget),
+        uint64_t(max_duration) * 1000);
+    uint64_t start_date = System::get_precise_ticks();
+    while (System::get_precise_ticks() - start_date < budget) {
+      if (step_garbage_collector()) {
+        // A full cycle is finished: there is nothing more to collect now.
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * \brief Notifies Lua that a frame has just been drawn.
+ *
+ * This function should be called after each drawing, even if frames
+ * leave no spare time to collect_garbage().
+ * The garbage collection time measured since the previous drawing becomes
+ * the one returned by get_gc_time().
+ */
+void LuaContext::notify_frame_drawn() {
+
+  last_gc_time = gc_time;
+  gc_time = 0;
+}
+
+/**
+ * \brief Runs one step of the Lua garbage collector.
+ * \param step_size Size of the step in KB of allocated memory
+ * (0 means the smallest step).
+ * \return true if this step finished a collection cycle.
+ */
+bool LuaContext::step_garbage_collector(int step_size) {
+
+  uint64_t start_date = System::get_precise_ticks();
+
+  bool cycle_finished = lua_gc(l, LUA_GCSTEP, step_size) != 0;
+  lua_gc(l, LUA_GCSTOP, 0);  // Stepping restarts the automatic collection.
+  if (cycle_finished) {
+    gc_memory_after_cycle = lua_gc(l, LUA_GCCOUNT, 0);
+  }
+
+  gc_time += uint32_t(System::get_precise_ticks() - start_date);
+  return cycle_finished;
+}
+
+/**
+ * \brief Runs a full cycle of the Lua garbage collector at once.
+ *
+ * This is only done when memory grows too fast for incremental steps.
+ */
+void LuaContext::finish_garbage_collection() {
+
+  uint64_t start_date = System::get_precise_ticks();
+
+  lua_gc(l, LUA_GCCOLLECT, 0);
+  lua_gc(l, LUA_GCSTOP, 0);  // Collecting restarts the automatic collection.
+  gc_memory_after_cycle = lua_gc(l, LUA_GCCOUNT, 0);
+
+  gc_time += uint32_t(System::get_precise_ticks() - start_date);
+}
+
+/**
+ * \brief Returns the maximum time given to the garbage collector per frame.
+ * \return The garbage collection time budget in microseconds
+ * (0 means that Lua collects garbage automatically).
+ */
+uint32_t LuaContext::get_gc_time_budget() {
+  return gc_time_budget;
+}
+
+/**
+ * \brief Sets the maximum time given to the garbage collector per frame.
+ * \param gc_time_budget The garbage collection time budget in microseconds.
+ * 0 means that the engine does not drive the garbage collector and lets Lua
+ * collect garbage automatically when it allocates memory.
+ */
+void LuaContext::set_gc_time_budget(uint32_t gc_time_budget) {
+
+  this->gc_time_budget = gc_time_budget;
+
+  if (l != NULL) {
+    if (gc_time_budget == 0) {
+      lua_gc(l, LUA_GCRESTART, 0);
+    }
+    else {
+      lua_gc(l, LUA_GCSTOP, 0);
+    }
+  }
+}
+
+/**
+ * \brief Returns the time spent collecting garbage during the last frame.
+ *
+ * This includes the steps run by collect_garbage() and the ones forced
+ * during updates since the previous drawing, but not the automatic collection made by Lua itself
+ * when the time budget is 0.
+ *
+ * \return The garbage collection time of the last frame in microseconds.
+ */
+uint32_t LuaContext::get_gc_time() {
+  return last_gc_time;
 }
 
 /**
@@ -902,7 +1048,20 @@ bool LuaContext::call_function(int nb_arguments, int nb_results,
 bool LuaContext::call_function(lua_State* l, int nb_arguments, int nb_results,
     const std::string& function_name) {
 
-  if (lua_pcall(l, nb_arguments, nb_results, 0) != 0) {
+  const bool profiling = LuaProfiler::is_enabled();
+  if (profiling) {
+    const std::string& object_type = (nb_arguments > 0) ?
+        get_profiled_type_name(l, -nb_arguments) : "none";
+    LuaProfiler::begin_call(l, nb_arguments, object_type, function_name);
+  }
+
+  int status = lua_pcall(l, nb_arguments, nb_results, 0);
+
+  if (profiling) {
+    LuaProfiler::end_call();
+  }
+
+  if (status != 0) {
     Debug::error(StringConcat() << "In " << function_name << "(): "
         << lua_tostring(l, -1));
     lua_pop(l, 1);
@@ -912,6 +1071,33 @@ bool LuaContext::call_function(lua_State* l, int nb_arguments, int nb_results,
   return true;
 }
 
+/**
+ * \brief Returns the name of the type of an object a callback is called on,
+ * as shown in the reports of the Lua profiler.
+ * \param l A Lua state.
+ * \param index Index of the object in the stack.
+ * \return The Solarus type name for a userdata (like "enemy"),
+ * or the Lua type name otherwise.
+ */
+std::string LuaContext::get_profiled_type_name(lua_State* l, int index) {
+
+  int type = lua_type(l, index);
+  if (type == LUA_TUSERDATA && luaL_getmetafield(l, index, "__gc")) {
+                                  // ... gc
+    bool is_exportable = (lua_tocfunction(l, -1) == userdata_meta_gc);
+    lua_pop(l, 1);
+                                  // ...
+    if (is_exportable) {
+      ExportableToLua* userdata = *(static_cast<ExportableToLua**>(
+          lua_touserdata(l, index)));
+      const std::string& lua_type_name = userdata->get_lua_type_name();
+      return lua_type_name.substr(lua_type_name.find_last_of('.') + 1);
+    }
+  }
+
+  return lua_typename(l, type);
+}
+
 /**
  * \brief Opens a script and lets it on top of the stack as a function.
  * \param l A Lua state.
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/LuaProfiler.h"
+#include "lowlevel/System.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+bool LuaProfiler::enabled = false;
+LuaProfiler::Format LuaProfiler::format = LuaProfiler::FORMAT_FLAT;
+int LuaProfiler::sampling_interval = 0;
+lua_Alloc LuaProfiler::original_allocator = NULL;
+void* LuaProfiler::original_allocator_data = NULL;
+uint64_t LuaProfiler::allocated_bytes = 0;
+std::vector<LuaProfiler::Frame> LuaProfiler::frames;
+std::map<LuaProfiler::CallbackId, LuaProfiler::CallbackStats> LuaProfiler::stats;
+std::map<std::string, uint64_t> LuaProfiler::callback_stacks;
+std::map<std::string, uint64_t> LuaProfiler::sampled_stacks;
+uint64_t LuaProfiler::last_sample_date = 0;
+
+namespace {
+
+  /**
+   * \brief Returns a short description of where a Lua function is defined.
+   * \param ar Debug information filled with at least the "S" option.
+   * \return The script file and line of the function, or "[C]" for a C
+   * function.
+   */
+  std::string get_source_name(const lua_Debug& ar) {
+
+    if (ar.what != NULL && std::string(ar.what) == "C") {
+      return "[C]";
+    }
+
+    std::string source = (ar.source != NULL) ? ar.source : "?";
+    if (!source.empty() && (source[0] == '@' || source[0] == '=')) {
+      source = source.substr(1);
+    }
+    if (source.size() > 60) {
+      // Code loaded from a string: only keep its beginning.
+      source = source.substr(0, 57) + "...";
+    }
+    std::replace(source.begin(), source.end(), ';', ',');
+    std::replace(source.begin(), source.end(), '\n', ' ');
+
+    std::ostringstream oss;
+    oss << source << ":" << ar.linedefined;
+    return oss.str();
+  }
+
+  /**
+   * \brief Orders callback stats by decreasing total time.
+   */
+  template<typename T>
+  bool compare_total_time(const T& first, const T& second) {
+    return first.second.total_time > second.second.total_time;
+  }
+}
+
+/**
+ * \brief Compares two callback ids.
+ * \param other Another callback id.
+ * \return true if this id is before the other one.
+ */
+bool LuaProfiler::CallbackId::operator<(const CallbackId& other) const {
+
+  if (object_type != other.object_type) {
+    return object_type < other.object_type;
+  }
+  if (name != other.name) {
+    return name < other.name;
+  }
+  return script < other.script;
+}
+
+/**
+ * \brief Initializes the Lua profiler.
+ *
+ * The profiler is only enabled if the option
+ * "-lua-profiler[=flat|folded]" is present.
+ * The option "-lua-profiler-sampling[=<instructions>]" additionally samples
+ * the Lua call stack every given number of Lua instructions
+ * (1000 by default).
+ *
+ * \param argc command-line arguments number
+ * \param argv command-line arguments
+ */
+void LuaProfiler::initialize(int argc, char** argv) {
+
+  // Check the -lua-profiler and -lua-profiler-sampling options.
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+
+    if (arg.find("-lua-profiler-sampling") == 0) {
+      enabled = true;
+      sampling_interval = 1000;
+      if (arg.find("-lua-profiler-sampling=") == 0) {
+        sampling_interval = std::atoi(arg.substr(23).c_str());
+        if (sampling_interval <= 0) {
+          Debug::error(StringConcat() << "Invalid sampling interval: '" << arg << "'");
+          sampling_interval = 1000;
+        }
+      }
+    }
+    else if (arg == "-lua-profiler" || arg == "-lua-profiler=flat") {
+      enabled = true;
+      format = FORMAT_FLAT;
+    }
+    else if (arg == "-lua-profiler=folded") {
+      enabled = true;
+      format = FORMAT_FOLDED;
+    }
+    else if (arg.find("-lua-profiler=") == 0) {
+      Debug::error(StringConcat() << "Unknown Lua profiler format: '" << arg << "'");
+    }
+  }
+}
+
+/**
+ * \brief Writes the report of the profiler if it was enabled.
+ *
+ * This function should be called when exiting the application,
+ * after the Lua context is closed.
+ */
+void LuaProfiler::quit() {
+
+  if (!enabled) {
+    return;
+  }
+
+  const std::string& file_name = (format == FORMAT_FLAT) ?
+      "lua_profile.txt" : "lua_profile.folded";
+  std::ofstream out(file_name.c_str());
+  if (!out) {
+    Debug::error(StringConcat() << "Cannot write Lua profile '" << file_name << "'");
+  }
+  else if (format == FORMAT_FLAT) {
+    write_flat_report(out);
+  }
+  else {
+    write_folded_report(out);
+  }
+
+  frames.clear();
+  stats.clear();
+  callback_stacks.clear();
+  sampled_stacks.clear();
+  enabled = false;
+}
+
+/**
+ * \brief Returns whether the profiler was enabled from the command line.
+ * \return true if Lua callbacks are measured.
+ */
+bool LuaProfiler::is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Starts measuring a newly created Lua state.
+ *
+ * The allocator of the state is wrapped to count the bytes allocated by
+ * Lua and a hook is installed if sampling is enabled.
+ * The state should not have run any code yet.
+ *
+ * \param l A Lua state.
+ */
+void LuaProfiler::attach(lua_State* l) {
+
+  if (!enabled) {
+    return;
+  }
+
+  original_allocator = lua_getallocf(l, &original_allocator_data);
+  lua_setallocf(l, allocate, NULL);
+
+  if (sampling_interval > 0) {
+    lua_sethook(l, sample, LUA_MASKCOUNT, sampling_interval);
+  }
+}
+
+/**
+ * \brief Notifies the profiler that a Lua function is about to be called.
+ *
+ * The function and its arguments must be on top of the stack.
+ * The stack is left unchanged.
+ *
+ * \param l A Lua state.
+ * \param nb_arguments Number of arguments placed above the function.
+ * \param object_type Type of the object the callback is called on.
+ * \param function_name Name of the callback.
+ */
+void LuaProfiler::begin_call(lua_State* l, int nb_arguments,
+    const std::string& object_type, const std::string& function_name) {
+
+  lua_Debug ar;
+  lua_pushvalue(l, -(nb_arguments + 1));
+  lua_getinfo(l, ">S", &ar);
+
+  Frame frame;
+  frame.id.object_type = object_type;
+  frame.id.name = function_name;
+  frame.id.script = get_source_name(ar);
+
+  std::string label = object_type + ":" + function_name + "@" + frame.id.script;
+  std::replace(label.begin(), label.end(), ';', ',');
+  std::replace(label.begin(), label.end(), ' ', '_');
+  frame.stack = frames.empty() ? label : frames.back().stack + ";" + label;
+
+  frame.start_allocated = allocated_bytes;
+  frame.children_time = 0;
+  frame.start_date = System::get_precise_ticks();
+  last_sample_date = frame.start_date;
+  frames.push_back(frame);
+}
+
+/**
+ * \brief Notifies the profiler that the Lua function passed to the last
+ * call to begin_call() has returned.
+ */
+void LuaProfiler::end_call() {
+
+  Debug::check_assertion(!frames.empty(), "No Lua call to end");
+
+  uint64_t now = System::get_precise_ticks();
+  const Frame& frame = frames.back();
+  uint64_t total_time = now - frame.start_date;
+  uint64_t self_time = total_time - std::min(total_time, frame.children_time);
+
+  std::map<CallbackId, CallbackStats>::iterator it = stats.find(frame.id);
+  if (it == stats.end()) {
+    CallbackStats new_stats;
+    new_stats.nb_calls = 0;
+    new_stats.total_time = 0;
+    new_stats.self_time = 0;
+    new_stats.allocated = 0;
+    it = stats.insert(std::make_pair(frame.id, new_stats)).first;
+  }
+  CallbackStats& callback_stats = it->second;
+  callback_stats.nb_calls++;
+  callback_stats.total_time += total_time;
+  callback_stats.self_time += self_time;
+  callback_stats.allocated += allocated_bytes - frame.start_allocated;
+  callback_stacks[frame.stack] += self_time;
+
+  frames.pop_back();
+  if (!frames.empty()) {
+    frames.back().children_time += total_time;
+  }
+  last_sample_date = now;
+}
+
+/**
+ * \brief Lua allocator that counts allocated bytes and forwards to the
+ * original allocator.
+ * \param ud Unused.
+ * \param ptr The block to reallocate or free, or NULL.
+ * \param osize Original size of the block.
+ * \param nsize New size of the block (0 to free it).
+ * \return The reallocated block.
+ */
+void* LuaProfiler::allocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+
+  if (nsize > osize) {
+    allocated_bytes += nsize - osize;
+  }
+  return original_allocator(original_allocator_data, ptr, osize, nsize);
+}
+
+/**
+ * \brief Lua hook called every sampling_interval instructions.
+ *
+ * Attributes the time elapsed since the previous sample to the current
+ * Lua call stack.
+ *
+ * \param l The Lua state (possibly a coroutine).
+ * \param ar Debug information about the current function.
+ */
+void LuaProfiler::sample(lua_State* l, lua_Debug* /* ar */) {
+
+  uint64_t now = System::get_precise_ticks();
+  uint64_t elapsed = now - last_sample_date;
+  last_sample_date = now;
+
+  std::vector<std::string> lua_frames;
+  lua_Debug info;
+  for (int level = 0; level < 64 && lua_getstack(l, level, &info); ++level) {
+    lua_getinfo(l, "Sn", &info);
+    std::string name = (info.name != NULL) ? info.name : "?";
+    lua_frames.push_back(name + "@" + get_source_name(info));
+  }
+
+  std::string stack = frames.empty() ? "(no callback)" : frames.front().stack.substr(
+      0, frames.front().stack.find(';'));
+  std::vector<std::string>::reverse_iterator it;
+  for (it = lua_frames.rbegin(); it != lua_frames.rend(); ++it) {
+    std::string frame = *it;
+    std::replace(frame.begin(), frame.end(), ';', ',');
+    std::replace(frame.begin(), frame.end(), ' ', '_');
+    stack += ";" + frame;
+  }
+  sampled_stacks[stack] += elapsed;
+}
+
+/**
+ * \brief Writes one line per callback, sorted by decreasing total time.
+ *
+ * If sampling was enabled, the time of each sampled Lua function
+ * is also written.
+ *
+ * \param out The stream to write.
+ */
+void LuaProfiler::write_flat_report(std::ostream& out) {
+
+  typedef std::pair<CallbackId, CallbackStats> Entry;
+  std::vector<Entry> entries(stats.begin(), stats.end());
+  std::sort(entries.begin(), entries.end(), compare_total_time<Entry>);
+
+  out << "# Lua callbacks (times in milliseconds, memory in KB)" << std::endl;
+  out << std::setw(10) << "calls"
+      << std::setw(12) << "total"
+      << std::setw(12) << "self"
+      << std::setw(10) << "average"
+      << std::setw(12) << "allocated"
+      << "  type:callback@script" << std::endl;
+
+  out << std::fixed << std::setprecision(3);
+  std::vector<Entry>::const_iterator it;
+  for (it = entries.begin(); it != entries.end(); ++it) {
+    const CallbackId& id = it->first;
+    const CallbackStats& callback_stats = it->second;
+    out << std::setw(10) << callback_stats.nb_calls
+        << std::setw(12) << (callback_stats.total_time / 1000.0)
+        << std::setw(12) << (callback_stats.self_time / 1000.0)
+        << std::setw(10) << (callback_stats.total_time / 1000.0 / callback_stats.nb_calls)
+        << std::setw(12) << (callback_stats.allocated / 1024.0)
+        << "  " << id.object_type << ":" << id.name << "@" << id.script
+        << std::endl;
+  }
+
+  if (sampling_interval > 0) {
+
+    // Self time of each Lua function: the leaf of each sampled stack.
+    std::map<std::string, uint64_t> functions;
+    std::map<std::string, uint64_t>::const_iterator sit;
+    for (sit = sampled_stacks.begin(); sit != sampled_stacks.end(); ++sit) {
+      const std::string& stack = sit->first;
+      functions[stack.substr(stack.rfind(';') + 1)] += sit->second;
+    }
+
+    std::vector<std::pair<uint64_t, std::string> > sorted_functions;
+    for (sit = functions.begin(); sit != functions.end(); ++sit) {
+      sorted_functions.push_back(std::make_pair(sit->second, sit->first));
+    }
+    std::sort(sorted_functions.rbegin(), sorted_functions.rend());
+
+    out << std::endl << "# Sampled Lua functions (self time in milliseconds)"
+        << std::endl;
+    std::vector<std::pair<uint64_t, std::string> >::const_iterator fit;
+    for (fit = sorted_functions.begin(); fit != sorted_functions.end(); ++fit) {
+      out << std::setw(12) << (fit->first / 1000.0) << "  " << fit->second
+          << std::endl;
+    }
+  }
+}
+
+/**
+ * \brief Writes folded stacks: each line is a semicolon-separated stack
+ * followed by its self time in microseconds.
+ *
+ * If sampling was enabled, stacks are the sampled Lua call stacks.
+ * Otherwise, they are the stacks of nested callbacks.
+ *
+ * \param out The stream to write.
+ */
+void LuaProfiler::write_folded_report(std::ostream& out) {
+
+  const std::map<std::string, uint64_t>& stacks = (sampling_interval > 0) ?
+      sampled_stacks : callback_stacks;
+
+  std::map<std::string, uint64_t>::const_iterator it;
+  for (it = stacks.begin(); it != stacks.end(); ++it) {
+    if (it->second > 0) {
+      out << it->first << " " << it->second << std::endl;
+    }
+  }
+}
+
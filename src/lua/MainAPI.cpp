@@ -41,6 +41,10 @@ void LuaContext::register_main_module() {
       { "save_settings", main_api_save_settings },
       { "get_distance", main_api_get_distance },
       { "get_angle", main_api_get_angle },
+      { "get_lua_memory", main_api_get_lua_memory },
+      { "get_gc_time", main_api_get_gc_time },
+      { "get_gc_time_budget", main_api_get_gc_time_budget },
+      { "set_gc_time_budget", main_api_set_gc_time_budget },
       { NULL, NULL }
   };
   register_functions(main_module_name, functions);
@@ -221,6 +225,63 @@ int LuaContext::main_api_get_angle(lua_State* l) {
   return 1;
 }
 
+/**
+ * \brief Implementation of sol.main.get_lua_memory().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_get_lua_memory(lua_State* l) {
+
+  double memory = lua_gc(l, LUA_GCCOUNT, 0) + lua_gc(l, LUA_GCCOUNTB, 0) / 1024.0;
+
+  lua_pushnumber(l, memory);
+  return 1;
+}
+
+/**
+ * \brief Implementation of sol.main.get_gc_time().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_get_gc_time(lua_State* l) {
+
+  uint32_t gc_time = get_lua_context(l).get_gc_time();
+
+  lua_pushnumber(l, gc_time / 1000.0);
+  return 1;
+}
+
+/**
+ * \brief Implementation of sol.main.get_gc_time_budget().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_get_gc_time_budget(lua_State* l) {
+
+  uint32_t gc_time_budget = get_lua_context(l).get_gc_time_budget();
+
+  lua_pushnumber(l, gc_time_budget / 1000.0);
+  return 1;
+}
+
+/**
+ * \brief Implementation of sol.main.set_gc_time_budget().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_set_gc_time_budget(lua_State* l) {
+
+  double gc_time_budget = luaL_checknumber(l, 1);
+
+  if (gc_time_budget < 0) {
+    arg_error(l, 1, "The time budget must be positive or zero");
+  }
+
+  get_lua_context(l).set_gc_time_budget(uint32_t(gc_time_budget * 1000));
+
+  return 0;
+}
+
 /**
  * \brief Calls sol.main.on_started() if it exists.
  *
@@ -21,7 +21,6 @@
 #include "Treasure.h"
 #include "EquipmentItem.h"
 #include "entities/MapEntities.h"
-#include "entities/Tile.h"
 #include "entities/Tileset.h"
 #include "entities/Destination.h"
 #include "entities/Teletransporter.h"
@@ -56,6 +55,16 @@
 
 const std::string LuaContext::map_module_name = "sol.map";
 
+namespace {
+
+  /**
+   * \brief Biggest radius accepted by map:get_entities_in_radius().
+   *
+   * The side of the square searched must fit in an int.
+   */
+  const int max_query_radius = 0x3FFFFFFF;
+}
+
 /**
  * \brief Initializes the map features provided to Lua.
  */
@@ -85,6 +94,9 @@ void LuaContext::register_map_module() {
       { "get_entity", map_api_get_entity },
       { "has_entity", map_api_has_entity },
       { "get_entities", map_api_get_entities },
+      { "get_entities_by_type", map_api_get_entities_by_type },
+      { "get_entities_in_rectangle", map_api_get_entities_in_rectangle },
+      { "get_entities_in_radius", map_api_get_entities_in_radius },
       { "get_entities_count", map_api_get_entities_count },
       { "has_entities", map_api_has_entities },
       { "set_entities_enabled", map_api_set_entities_enabled },
@@ -734,12 +746,12 @@ int LuaContext::map_api_get_entities(lua_State* l) {
   Map& map = check_map(l, 1);
   const std::string& prefix = luaL_checkstring(l, 2);
 
-  const std::list<MapEntity*> entities =
-    map.get_entities().get_entities_with_prefix(prefix);
+  std::vector<MapEntity*> entities;
+  map.get_entities().get_entities_with_prefix(prefix, entities);
 
-  lua_newtable(l);
-  std::list<MapEntity*>::const_iterator it;
-  for (it = entities.begin(); it != entities.end(); it++) {
+  lua_createtable(l, 0, entities.size());
+  std::vector<MapEntity*>::const_iterator it;
+  for (it = entities.begin(); it != entities.end(); ++it) {
     MapEntity* entity = *it;
     push_entity(l, *entity);
     lua_pushboolean(l, true);
@@ -752,6 +764,138 @@ int LuaContext::map_api_get_entities(lua_State* l) {
   return 3;
 }
 
+/**
+ * \brief Implementation of map:get_entities_by_type().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_get_entities_by_type(lua_State* l) {
+
+  Map& map = check_map(l, 1);
+  EntityType type = check_enum<EntityType>(l, 2, MapEntity::entity_type_names);
+  const std::string& prefix = luaL_optstring(l, 3, "");
+  Layer layer = opt_layer_filter(l, 4);
+
+  std::vector<MapEntity*> entities;
+  map.get_entities().get_entities_by_type(type, entities, prefix, layer);
+
+  push_entity_array(l, entities);
+  return 1;
+}
+
+/**
+ * \brief Implementation of map:get_entities_in_rectangle().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_get_entities_in_rectangle(lua_State* l) {
+
+  Map& map = check_map(l, 1);
+  int x = luaL_checkint(l, 2);
+  int y = luaL_checkint(l, 3);
+  int width = luaL_checkint(l, 4);
+  int height = luaL_checkint(l, 5);
+  Layer layer = opt_layer_filter(l, 6);
+  EntityType type;
+  bool filter_type = opt_entity_type_filter(l, 7, type);
+
+  // No Lua error can happen from here: the vector would not be destroyed.
+  std::vector<MapEntity*> entities;
+  map.get_entities().get_entities_in_rectangle(
+      Rectangle(x, y, width, height), entities, layer);
+  if (filter_type) {
+    filter_entities_by_type(type, entities);
+  }
+
+  push_entity_array(l, entities);
+  return 1;
+}
+
+/**
+ * \brief Implementation of map:get_entities_in_radius().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_get_entities_in_radius(lua_State* l) {
+
+  Map& map = check_map(l, 1);
+  int x = luaL_checkint(l, 2);
+  int y = luaL_checkint(l, 3);
+  int radius = luaL_checkint(l, 4);
+  Layer layer = opt_layer_filter(l, 5);
+  EntityType type;
+  bool filter_type = opt_entity_type_filter(l, 6, type);
+
+  if (radius < 0 || radius > max_query_radius) {
+    arg_error(l, 4, StringConcat() << "Invalid radius: " << radius);
+  }
+
+  // No Lua error can happen from here: the vector would not be destroyed.
+  std::vector<MapEntity*> entities;
+  map.get_entities().get_entities_in_radius(x, y, radius, entities, layer);
+  if (filter_type) {
+    filter_entities_by_type(type, entities);
+  }
+
+  push_entity_array(l, entities);
+  return 1;
+}
+
+/**
+ * \brief Checks an optional layer argument of an entity query.
+ * \param l A Lua context.
+ * \param index Index of the argument in the stack.
+ * \return The layer, or LAYER_NB if the argument is nil or none
+ * (meaning all layers).
+ */
+Layer LuaContext::opt_layer_filter(lua_State* l, int index) {
+
+  if (lua_isnoneornil(l, index)) {
+    return LAYER_NB;
+  }
+
+  int layer = luaL_checkint(l, index);
+  if (layer < LAYER_LOW || layer >= LAYER_NB) {
+    arg_error(l, index, StringConcat() << "Invalid layer: " << layer);
+  }
+  return Layer(layer);
+}
+
+/**
+ * \brief Checks an optional entity type argument of an entity query.
+ * \param l A Lua context.
+ * \param index Index of the type name in the stack.
+ * \param type Set to the type if the argument is present.
+ * \return false if the argument is nil or none (meaning all types).
+ */
+bool LuaContext::opt_entity_type_filter(lua_State* l, int index, EntityType& type) {
+
+  if (lua_isnoneornil(l, index)) {
+    return false;
+  }
+
+  type = check_enum<EntityType>(l, index, MapEntity::entity_type_names);
+  return true;
+}
+
+/**
+ * \brief Removes from a vector the entities that don't have a type.
+ * \param type The type of entities to keep.
+ * \param entities The entities to filter.
+ */
+void LuaContext::filter_entities_by_type(EntityType type,
+    std::vector<MapEntity*>& entities) {
+
+  size_t nb_kept = 0;
+  for (size_t i = 0; i < entities.size(); ++i) {
+    if (entities[i]->get_type() == type) {
+      entities[nb_kept] = entities[i];
+      ++nb_kept;
+    }
+  }
+  entities.resize(nb_kept);
+}
+
 /**
  * \brief Implementation of map:get_entities_count().
  * \param l The Lua context that is calling this function.
@@ -762,10 +906,7 @@ int LuaContext::map_api_get_entities_count(lua_State* l) {
   Map& map = check_map(l, 1);
   const std::string& prefix = luaL_checkstring(l, 2);
 
-  const std::list<MapEntity*> entities =
-    map.get_entities().get_entities_with_prefix(prefix);
-
-  lua_pushinteger(l, entities.size());
+  lua_pushinteger(l, map.get_entities().get_entities_count_with_prefix(prefix));
   return 1;
 }
 
@@ -797,10 +938,10 @@ int LuaContext::map_api_set_entities_enabled(lua_State* l) {
     enabled = lua_toboolean(l, 3);
   }
 
-  std::list<MapEntity*> entities =
-      map.get_entities().get_entities_with_prefix(prefix);
-  std::list<MapEntity*>::iterator it;
-  for (it = entities.begin(); it != entities.end(); it++) {
+  std::vector<MapEntity*> entities;
+  map.get_entities().get_entities_with_prefix(prefix, entities);
+  std::vector<MapEntity*>::iterator it;
+  for (it = entities.begin(); it != entities.end(); ++it) {
     (*it)->set_enabled(enabled);
   }
 
@@ -850,14 +991,13 @@ int LuaContext::map_api_create_tile(lua_State* l) {
     arg_error(l, 1, StringConcat() << "Invalid layer: " << layer);
   }
 
-  MapEntity* entity = new Tile(
+  map.get_entities().add_tile(
       Layer(layer),
       x,
       y,
       width,
       height,
       tile_pattern_id);
-  map.get_entities().add_entity(entity);
 
   return 0;
 }
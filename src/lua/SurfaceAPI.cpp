@@ -25,6 +25,13 @@
 
 const std::string LuaContext::surface_module_name = "sol.surface";
 
+static const std::string blend_mode_names[] = {
+    "blend",
+    "add",
+    "multiply",
+    ""  // Sentinel.
+};
+
 /**
  * \brief Initializes the surface features provided to Lua.
  */
@@ -37,6 +44,8 @@ void LuaContext::register_surface_module() {
       { "get_transparency_color", surface_api_get_transparency_color },
       { "set_transparency_color", surface_api_set_transparency_color },
       { "set_opacity", surface_api_set_opacity },
+      { "get_blend_mode", surface_api_get_blend_mode },
+      { "set_blend_mode", surface_api_set_blend_mode },
       { "draw", drawable_api_draw },
       { "draw_region", drawable_api_draw_region },
       { "fade_in", drawable_api_fade_in },
@@ -208,3 +217,32 @@ int LuaContext::surface_api_set_opacity(lua_State* l) {
   return 0;
 }
 
+/**
+ * \brief Implementation of surface:get_blend_mode().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::surface_api_get_blend_mode(lua_State* l) {
+
+  Surface& surface = check_surface(l, 1);
+
+  push_string(l, blend_mode_names[surface.get_blend_mode()]);
+  return 1;
+}
+
+/**
+ * \brief Implementation of surface:set_blend_mode().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::surface_api_set_blend_mode(lua_State* l) {
+
+  Surface& surface = check_surface(l, 1);
+  Surface::BlendMode blend_mode = check_enum<Surface::BlendMode>(
+      l, 2, blend_mode_names);
+
+  surface.set_blend_mode(blend_mode);
+
+  return 0;
+}
+
@@ -16,11 +16,13 @@
  */
 #include "lua/LuaContext.h"
 #include "lowlevel/Debug.h"
+#include "lowlevel/System.h"
 #include "Timer.h"
 #include "MainLoop.h"
 #include "Game.h"
 #include "Map.h"
 #include <list>
+#include <algorithm>
 #include <lua.hpp>
 
 const std::string LuaContext::timer_module_name = "sol.timer";
@@ -121,8 +123,10 @@ void LuaContext::add_timer(Timer* timer, int context_index, int callback_index)
   Debug::check_assertion(timers.find(timer) == timers.end(),
       "Duplicate timer in the system");
 
-  timers[timer].callback_ref = callback_ref;
-  timers[timer].context = context;
+  LuaTimerData& timer_data = timers[timer];
+  timer_data.callback_ref = callback_ref;
+  timer_data.context = context;
+  timer_data.schedule_id = 0;
 
   Game* game = main_loop.get_game();
   if (game != NULL) {
@@ -141,11 +145,15 @@ void LuaContext::add_timer(Timer* timer, int context_index, int callback_index)
       // In particular, we don't want to suspend timers created during a
       // camera movement.
       // This would be very painful for users.
-      bool initially_suspended = game->is_dialog_enabled();
-      timer->set_suspended(initially_suspended);
+      // Such timers stay on the system clock until the map is suspended
+      // or resumed again.
+      if (!map_clock.is_paused() || game->is_dialog_enabled()) {
+        timer->set_clock(&map_clock);
+      }
     }
   }
   timer->increment_refcount();
+  schedule_timer(timer);
 }
 
 /**
@@ -174,8 +182,6 @@ void LuaContext::remove_timer(Timer* timer) {
  */
 void LuaContext::remove_timers(int context_index) {
 
-  std::list<Timer*> timers_to_remove;
-
   const void* context;
   if (lua_type(l, context_index) == LUA_TUSERDATA) {
     ExportableToLua** userdata = static_cast<ExportableToLua**>(
@@ -189,7 +195,8 @@ void LuaContext::remove_timers(int context_index) {
   std::map<Timer*, LuaTimerData>::iterator it;
   for (it = timers.begin(); it != timers.end(); ++it) {
     Timer* timer = it->first;
-    if (it->second.context == context) {
+    if (it->second.context == context
+        && it->second.callback_ref != LUA_REFNIL) {
       if (!timer->is_finished()) {
         destroy_ref(it->second.callback_ref);
       }
@@ -211,47 +218,171 @@ void LuaContext::destroy_timers() {
     if (!timer->is_finished()) {
       destroy_ref(it->second.callback_ref);
     }
+    timer->set_clock(NULL);
     timer->decrement_refcount();
     if (timer->get_refcount() == 0) {
       delete timer;
     }
   }
   timers.clear();
+  timers_to_remove.clear();
+  timers_queue.clear();
+  map_timers_queue.clear();
+  timers_off_map_clock.clear();
+  timers_resumed_with_map.clear();
+  map_clock = Timer::Clock();
 }
 
 /**
- * \brief Updates all timers currently running for this script.
+ * \brief Puts a running timer in the queue of the clock it depends on.
+ *
+ * This function must be called when a timer is created and each time its
+ * date of next update may have changed, that is, when it is suspended,
+ * resumed or changes its sound or clock settings.
+ * The previous queue entry of the timer, if any, becomes obsolete.
+ *
+ * \param timer A timer.
  */
-void LuaContext::update_timers() {
+void LuaContext::schedule_timer(Timer* timer) {
 
-  // Update all timers.
-  std::map<Timer*, LuaTimerData>::iterator it;
-  for (it = timers.begin(); it != timers.end(); ++it) {
+  std::map<Timer*, LuaTimerData>::iterator it = timers.find(timer);
+  if (it == timers.end() || it->second.callback_ref == LUA_REFNIL) {
+    // Finished or being removed.
+    return;
+  }
 
-    Timer* timer = it->first;
-    int callback_ref = it->second.callback_ref;
-    if (callback_ref != LUA_REFNIL) {
-      // The timer is not being removed: update it.
-      timer->update();
-      if (timer->is_finished()) {
-        do_callback(callback_ref);
-        it->second.callback_ref = LUA_REFNIL;
-        timers_to_remove.push_back(timer);
-      }
+  // Choose the clock.
+  if (!timer->is_suspended_with_map()) {
+    timer->set_clock(NULL);
+  }
+  else if (timer->get_clock() == NULL) {
+    if (!map_clock.is_paused()) {
+      timer->set_clock(&map_clock);
+    }
+    else {
+      // Let it run until the map is suspended or resumed again.
+      timers_off_map_clock.insert(timer);
+    }
+  }
+
+  if (timer->is_suspended()) {
+    // Resuming the map resumes it too.
+    timers_resumed_with_map.insert(timer);
+  }
+
+  std::vector<TimerQueueEntry>& queue = (timer->get_clock() == &map_clock) ?
+      map_timers_queue : timers_queue;
+
+  TimerQueueEntry entry;
+  entry.date = timer->get_next_update_date();
+  entry.schedule_id = next_timer_schedule_id++;
+  entry.timer = timer;
+  it->second.schedule_id = entry.schedule_id;
+
+  queue.push_back(entry);
+  std::push_heap(queue.begin(), queue.end());
+
+  if (queue.size() > 2 * timers.size() + 32) {
+    compact_timer_queue(queue);
+  }
+}
+
+/**
+ * \brief Removes the obsolete entries of a timer queue.
+ * \param queue A timer queue.
+ */
+void LuaContext::compact_timer_queue(std::vector<TimerQueueEntry>& queue) {
+
+  std::vector<TimerQueueEntry> valid_entries;
+  valid_entries.reserve(timers.size());
+
+  std::vector<TimerQueueEntry>::const_iterator it;
+  for (it = queue.begin(); it != queue.end(); ++it) {
+    std::map<Timer*, LuaTimerData>::const_iterator data_it = timers.find(it->timer);
+    if (data_it != timers.end()
+        && data_it->second.schedule_id == it->schedule_id
+        && data_it->second.callback_ref != LUA_REFNIL) {
+      valid_entries.push_back(*it);
+    }
+  }
+
+  queue.swap(valid_entries);
+  std::make_heap(queue.begin(), queue.end());
+}
+
+/**
+ * \brief Updates the timers of a queue whose date of next update is reached.
+ *
+ * Timers that are not due are not touched.
+ *
+ * \param queue A timer queue.
+ * \param now Current date of the clock of this queue.
+ */
+void LuaContext::update_timer_queue(
+    std::vector<TimerQueueEntry>& queue, uint32_t now) {
+
+  std::vector<Timer*> timers_to_reschedule;
+  while (!queue.empty() && queue.front().date <= now) {
+
+    TimerQueueEntry entry = queue.front();
+    std::pop_heap(queue.begin(), queue.end());
+    queue.pop_back();
+
+    std::map<Timer*, LuaTimerData>::iterator it = timers.find(entry.timer);
+    if (it == timers.end()
+        || it->second.schedule_id != entry.schedule_id
+        || it->second.callback_ref == LUA_REFNIL) {
+      // Obsolete entry: the timer was rescheduled or is being removed.
+      continue;
+    }
+
+    Timer* timer = entry.timer;
+    timer->update();
+    if (timer->is_finished()) {
+      do_callback(it->second.callback_ref);
+      it->second.callback_ref = LUA_REFNIL;
+      timers_to_remove.push_back(timer);
+    }
+    else if (!timer->is_suspended()) {
+      // Not finished yet: a clock sound was played.
+      timers_to_reschedule.push_back(timer);
     }
+    // Suspended timers are scheduled again when they get resumed.
+  }
+
+  std::vector<Timer*>::const_iterator it;
+  for (it = timers_to_reschedule.begin(); it != timers_to_reschedule.end(); ++it) {
+    schedule_timer(*it);
+  }
+}
+
+/**
+ * \brief Updates all timers currently running for this script.
+ *
+ * Only the timers whose date of next update is reached are updated.
+ */
+void LuaContext::update_timers() {
+
+  // Update timers that are due.
+  update_timer_queue(timers_queue, System::now());
+  if (!map_clock.is_paused()) {
+    update_timer_queue(map_timers_queue, map_clock.now());
   }
 
   // Destroy the ones that should be removed.
-  std::list<Timer*>::iterator it2;
-  for (it2 = timers_to_remove.begin(); it2 != timers_to_remove.end(); ++it2) {
+  std::list<Timer*>::iterator it;
+  for (it = timers_to_remove.begin(); it != timers_to_remove.end(); ++it) {
 
-    Timer* timer = *it2;
-    it = timers.find(timer);
-    if (it != timers.end()) {
+    Timer* timer = *it;
+    std::map<Timer*, LuaTimerData>::iterator data_it = timers.find(timer);
+    if (data_it != timers.end()) {
       if (!timer->is_finished()) {
-        cancel_callback(it->second.callback_ref);
+        cancel_callback(data_it->second.callback_ref);
       }
-      timers.erase(it);
+      timers.erase(data_it);
+      timers_off_map_clock.erase(timer);
+      timers_resumed_with_map.erase(timer);
+      timer->set_clock(NULL);
       timer->decrement_refcount();
       if (timer->get_refcount() == 0) {
         delete timer;
@@ -267,15 +398,36 @@ void LuaContext::update_timers() {
 /**
  * \brief This function is called when the game (if any) is being suspended
  * or resumed.
+ *
+ * Timers suspended with the map all depend on the map clock, so they are
+ * suspended or resumed at once by pausing or resuming that clock.
+ * When the map is resumed, timers suspended by scripts are resumed too.
+ *
  * \param suspended true if the game is suspended, false if it is resumed.
  */
 void LuaContext::notify_timers_map_suspended(bool suspended) {
 
-  std::map<Timer*, LuaTimerData>::iterator it;
-  for (it = timers.begin(); it != timers.end(); ++it) {
-    Timer* timer = it->first;
-    if (!suspended || timer->is_suspended_with_map()) {
-      timer->notify_map_suspended(suspended);
+  map_clock.set_paused(suspended);
+
+  // Timers that were temporarily running on their own follow the map again.
+  std::set<Timer*> timers_to_attach;
+  timers_to_attach.swap(timers_off_map_clock);
+  std::set<Timer*>::const_iterator it;
+  for (it = timers_to_attach.begin(); it != timers_to_attach.end(); ++it) {
+    Timer* timer = *it;
+    if (timer->is_suspended_with_map()) {
+      timer->set_clock(&map_clock);
+      schedule_timer(timer);
+    }
+  }
+
+  if (!suspended) {
+    std::set<Timer*> timers_to_resume;
+    timers_to_resume.swap(timers_resumed_with_map);
+    for (it = timers_to_resume.begin(); it != timers_to_resume.end(); ++it) {
+      Timer* timer = *it;
+      timer->notify_map_suspended(false);
+      schedule_timer(timer);
     }
   }
 }
@@ -391,6 +543,7 @@ int LuaContext::timer_api_set_with_sound(lua_State* l) {
   }
 
   timer.set_with_sound(with_sound);
+  get_lua_context(l).schedule_timer(&timer);
 
   return 0;
 }
@@ -422,6 +575,7 @@ int LuaContext::timer_api_set_suspended(lua_State* l) {
   }
 
   timer.set_suspended(suspended);
+  get_lua_context(l).schedule_timer(&timer);
 
   return 0;
 }
@@ -456,8 +610,9 @@ int LuaContext::timer_api_set_suspended_with_map(lua_State* l) {
 
   timer.set_suspended_with_map(suspended_with_map);
 
-  Game* game = lua_context.get_main_loop().get_game();
-  timer.notify_map_suspended(game->get_current_map().is_suspended());
+  // The map clock is paused exactly when the map is suspended.
+  timer.notify_map_suspended(lua_context.map_clock.is_paused());
+  lua_context.schedule_timer(&timer);
 
   return 0;
 }